@@ -0,0 +1,823 @@
+//--------------------------------------------------------------------------------
+// Company:		Argonne National Laboratory
+// Division:	Physics
+// Project:		DGS Receiver
+// File:		benchReceiver.cpp
+// Description: End-to-end loopback benchmark.  Serves synthetic traffic with the
+//              IOC request protocol (psNet.h) to one or more dgsReceiver builds
+//              in turn, follows the files they write, and reports throughput and
+//              the time from send() to the bytes landing in the output file.
+//--------------------------------------------------------------------------------
+
+//g++ benchReceiver.cpp -O3 -Wall -Wextra -o benchReceiver -pthread
+
+#define VERSION "1.01"
+//  V1.01: The traffic source also streams to receivers that grant credit (dgsReceiver -S).
+//  V1.00: Built-in traffic source, file follower, MB/s, events/s and latency percentiles.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <algorithm>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "psNet.h"
+
+// BUILD PARAMETERS:
+// MAX_REPLY_SIZE: The largest payload of one SERVER_SUMMARY.
+#define MAX_REPLY_SIZE 10000000
+// MAX_SAMPLES: Latency samples kept per run; later packets are not timed.
+#define MAX_SAMPLES 10000000
+// MAX_FILES: Output files followed per run.
+#define MAX_FILES 4096
+// EXIT_GRACE_MS: After the end of the traffic, time the receiver gets to drain
+//  and exit by itself before it is sent SIGINT (receivers run with -n never exit).
+#define EXIT_GRACE_MS 5000
+// START_TIMEOUT_MS: Time the receiver gets to connect and send its first request.
+#define START_TIMEOUT_MS 10000
+// MAX_WATCHES: Folders followed per run (the run folder and the folder per run).
+#define MAX_WATCHES 16
+// STREAM_POLL_NS: With credit left but nothing due, how long the source waits
+//  before looking again.  Bounds the latency it adds to streamed data.
+#define STREAM_POLL_NS 100000
+
+// Packet layout, as parsed by the receivers.
+#define DIG_SOE 0xAAAAAAAA
+#define TRIG_SOE 0xAAAA0000
+#define TRIG_LENGTH_UINT32 16
+#define DIG_HEADER_LENGTH_UINT32 3
+#define TYPE_D_CH_ID 0xD
+#define TRIG_BOARD_ID 0xF
+// STAMP_WORD: The send time goes into the two words after the header.
+#define STAMP_WORD DIG_HEADER_LENGTH_UINT32
+#define MIN_PACKET_WORDS (STAMP_WORD + 2)
+
+/* traffic settings */
+
+int32_t nboards = 4;
+int32_t nchannels = 10;
+int32_t min_words = 64, max_words = 64;				 /* digitizer packet length after the SOE */
+int32_t reply_size = 65536;							 /* payload bytes per SERVER_SUMMARY, at most */
+double event_rate = 0;								 /* events/s while a burst is on, 0 = as fast as possible */
+int32_t burst_on_ms = 0, burst_off_ms = 0;			 /* on/off cycle, 0 = always on */
+double trigger_fraction = 0;						 /* fraction of events that are trigger packets */
+double duration = 10;								 /* seconds of traffic per receiver */
+const char *outdir = ".";
+const char *receiver_opts = "";
+int8_t keep_files = 0;
+
+/* one benchmark run */
+
+struct benchRun
+{
+	/* traffic source */
+	int32_t lsock;
+	int32_t port;
+	int64_t events, digitizer, triggers;
+	int64_t bytes;
+	int64_t replies, insuff;
+	double tfirst;										 /* first request */
+	double tend;										 /* request after the type D packets */
+	int8_t done;
+	uint64_t rng;
+
+	/* file follower */
+	int32_t ifd;
+	char dir[512];
+	char watched[MAX_WATCHES][1024];						 /* folder of each inotify watch */
+	int64_t *lat;										 /* ns, send to file */
+	int64_t nlat;
+	int64_t landed;
+	int64_t filebytes;
+};
+
+struct followedFile
+{
+	char path[1024];
+	int32_t fd;
+	int64_t offset;
+	uint8_t *partial;
+	int32_t npartial, size;
+};
+
+struct followedFile *files[MAX_FILES];
+int32_t nfiles = 0;
+
+/*----------------------------------------------------------------------*/
+
+/* Monotonic time, the same clock in both processes. */
+int64_t now_ns (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+double now_seconds (void)
+{
+	return now_ns () * 1e-9;
+}
+
+uint32_t next_random (struct benchRun *run)
+{
+	run->rng ^= run->rng << 13;
+	run->rng ^= run->rng >> 7;
+	run->rng ^= run->rng << 17;
+	return run->rng >> 32;
+}
+
+void put_word (uint8_t *p, uint32_t w)
+{
+	uint32_t be = htonl (w);
+
+	memcpy (p, &be, sizeof (be));
+}
+
+uint32_t get_word (const uint8_t *p)
+{
+	uint32_t be;
+
+	memcpy (&be, p, sizeof (be));
+	return ntohl (be);
+}
+
+/*----------------------------------------------------------------------*/
+
+int32_t put_digitizer (uint8_t *p, int32_t board, int32_t ch_id, int32_t length, uint32_t header_type, uint64_t ts)
+{
+	int32_t i;
+
+	put_word (p, DIG_SOE);
+	put_word (p + 4, (length << 16) | (board << 4) | ch_id);
+	put_word (p + 8, ts & 0xFFFFFFFF);
+	put_word (p + 12, (header_type << 16) | ((ts >> 32) & 0xFFFF));
+	for (i = DIG_HEADER_LENGTH_UINT32; i < length; i++)
+		put_word (p + 4 + 4 * i, i);
+	return 4 * (length + 1);
+}
+
+int32_t put_trigger (uint8_t *p, uint64_t ts)
+{
+	const uint32_t trig_soe = TRIG_SOE;
+	int32_t i;
+
+	// the receivers test the start of a trigger packet before swapping it
+	memcpy (p, &trig_soe, sizeof (trig_soe));
+	put_word (p + 4, 1);
+	put_word (p + 8, (ts >> 32) & 0xFFFF);
+	put_word (p + 12, (ts >> 16) & 0xFFFF);
+	put_word (p + 16, ts & 0xFFFF);
+	for (i = 5; i < TRIG_LENGTH_UINT32; i++)
+		put_word (p + 4 * i, i);
+	return 4 * TRIG_LENGTH_UINT32;
+}
+
+/*----------------------------------------------------------------------*/
+
+/* Events due by now: the rate applies while a burst is on. */
+int64_t events_allowed (struct benchRun *run, double t)
+{
+	double on, cycle, ncycles;
+
+	if (burst_on_ms > 0 && burst_off_ms > 0)
+		{
+			cycle = (burst_on_ms + burst_off_ms) * 1e-3;
+			ncycles = (int64_t) (t / cycle);
+			on = ncycles * burst_on_ms * 1e-3 + std::min (t - ncycles * cycle, burst_on_ms * 1e-3);
+			if (event_rate <= 0)
+				return (t - ncycles * cycle < burst_on_ms * 1e-3) ? INT64_MAX : run->events;
+		}
+	else
+		on = t;
+	return (event_rate > 0) ? (int64_t) (on * event_rate) : INT64_MAX;
+}
+
+/* Build one reply payload.  Trigger packets go first (see mockIOC.cpp);
+ * the send time is stamped into the digitizer packets by serve().
+ */
+int32_t fill_reply (struct benchRun *run, uint8_t *p, int32_t *stamps, int32_t *nstamps)
+{
+	static int32_t *length;
+	static int8_t *trigger;
+	static int32_t maxevents;
+	int64_t allowed;
+	int32_t n, i, len = 0, need = 0, ntrig = 0, ch;
+	double t;
+
+	if (!length)
+		{
+			maxevents = reply_size / (4 * (MIN_PACKET_WORDS + 1)) + 1;
+			length = (int32_t *) malloc (maxevents * sizeof (int32_t));
+			trigger = (int8_t *) malloc (maxevents);
+		}
+
+	*nstamps = 0;
+	if (run->done)
+		return 0;
+
+	t = now_seconds () - run->tfirst;
+	allowed = (t >= duration) ? run->events : events_allowed (run, t);
+
+	for (n = 0; n < maxevents && run->events + n < allowed; n++)
+		{
+			trigger[n] = (trigger_fraction > 0 && next_random (run) < trigger_fraction * 4294967296.0);
+			length[n] = trigger[n] ? TRIG_LENGTH_UINT32 - 1 : min_words + (max_words > min_words ? next_random (run) % (max_words - min_words + 1) : 0);
+			if (need + 4 * (length[n] + 1) > reply_size)
+				break;
+			need += 4 * (length[n] + 1);
+			ntrig += trigger[n];
+		}
+
+	for (i = 0; i < n; i++)
+		if (trigger[i])
+			len += put_trigger (p + len, 10 * (run->events + i));
+
+	for (i = 0; i < n; i++)
+		if (!trigger[i])
+			{
+				ch = (run->events + i) % (nboards * nchannels);
+				stamps[(*nstamps)++] = len + 4 * (STAMP_WORD + 1);
+				len += put_digitizer (p + len, 1 + ch / nchannels, ch % nchannels, length[i], 0, 10 * (run->events + i));
+			}
+
+	run->events += n;
+	run->triggers += ntrig;
+	run->digitizer += n - ntrig;
+
+	// end of the traffic: one type D packet per board, and for the trigger files
+	if (t >= duration && len + 16 * (nboards + 1) <= reply_size)
+		{
+			for (i = 0; i < nboards; i++)
+				len += put_digitizer (p + len, 1 + i, TYPE_D_CH_ID, DIG_HEADER_LENGTH_UINT32, 0xF, 10 * run->events);
+			if (run->triggers > 0)
+				len += put_digitizer (p + len, TRIG_BOARD_ID, TYPE_D_CH_ID, DIG_HEADER_LENGTH_UINT32, 0xF, 10 * run->events);
+			run->done = 1;
+		}
+	return len;
+}
+
+/*----------------------------------------------------------------------*/
+
+int32_t send_all (int32_t sock, const uint8_t *p, int32_t len)
+{
+	int32_t n;
+
+	while (len > 0)
+		{
+			n = send (sock, p, len, MSG_NOSIGNAL);
+			if (n <= 0)
+				return -1;
+			p += n;
+			len -= n;
+		}
+	return 0;
+}
+
+/* Build and send one reply, with the send time stamped in as late as
+ * possible.  Streamed replies carry seq, and are only sent with data.
+ * Returns the payload size, or -1 if the receiver went away.
+ */
+int32_t send_reply (struct benchRun *run, int32_t sock, uint8_t *reply, int32_t *stamps, int8_t stream, uint32_t seq)
+{
+	evtServerRetStruct *ret = (evtServerRetStruct *) reply;
+	int32_t j, len, nstamps;
+	uint64_t ts;
+
+	if (run->tfirst == 0)
+		run->tfirst = now_seconds ();
+	if (run->done && run->tend == 0)
+		run->tend = now_seconds ();
+
+	len = fill_reply (run, reply + sizeof (evtServerRetStruct), stamps, &nstamps);
+	if (stream && len == 0)
+		return 0;
+	ret->type = htonl (len == 0 ? INSUFF_DATA : stream ? SERVER_STREAM_SUMMARY : SERVER_SUMMARY);
+	ret->recLen = htonl (len);
+	ret->status = 0;
+	ret->recs = htonl (stream ? seq : len > 0 ? 1 : 0);
+
+	// stamp as late as possible
+	ts = now_ns ();
+	for (j = 0; j < nstamps; j++)
+		{
+			put_word (reply + sizeof (evtServerRetStruct) + stamps[j], ts >> 32);
+			put_word (reply + sizeof (evtServerRetStruct) + stamps[j] + 4, ts & 0xFFFFFFFF);
+		}
+
+	if (send_all (sock, reply, sizeof (evtServerRetStruct) + len) < 0)
+		return -1;
+	run->bytes += len;
+	run->replies++;
+	if (len == 0)
+		run->insuff++;
+	return len;
+}
+
+/* Traffic source: serves one receiver connection until it goes away.
+ * Requests are answered one by one; granted credit is used to stream
+ * data as soon as it is due.
+ */
+void *serve (void *arg)
+{
+	static const struct timespec poll_wait = { 0, STREAM_POLL_NS };
+	struct benchRun *run = (struct benchRun *) arg;
+	struct pollfd pfd;
+	uint32_t in[128];
+	uint8_t *reply;
+	int32_t *stamps;
+	int32_t sock, n, i, type, have = 0, credit = 0, one = 1;
+	uint32_t seq = 0;
+
+	reply = (uint8_t *) malloc (sizeof (evtServerRetStruct) + reply_size);
+	stamps = (int32_t *) malloc ((reply_size / (4 * (MIN_PACKET_WORDS + 1)) + 1) * sizeof (int32_t));
+
+	sock = accept (run->lsock, NULL, NULL);
+	if (sock < 0)
+		return NULL;
+	setsockopt (sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+	pfd.fd = sock;
+	pfd.events = POLLIN;
+
+	while (1)
+		{
+			n = ppoll (&pfd, 1, credit > 0 ? &poll_wait : NULL, NULL);
+			if (n < 0 && errno != EINTR)
+				break;
+			if (n > 0)
+				{
+					n = recv (sock, (char *) in + have, sizeof (in) - have, 0);
+					if (n <= 0)
+						break;
+					have += n;
+				}
+
+			for (i = 0; (i + 1) * 4 <= have; )
+				{
+					type = ntohl (in[i]);
+					if (type == CLIENT_GRANT_CREDIT)
+						{
+							if ((i + 2) * 4 > have)
+								break;
+							credit += ntohl (in[i + 1]);
+							i += 2;
+							continue;
+						}
+					i++;
+					if (send_reply (run, sock, reply, stamps, 0, 0) < 0)
+						goto out;
+				}
+			memmove (in, in + i, have - 4 * i);
+			have -= 4 * i;
+
+			while (credit > 0)
+				{
+					n = send_reply (run, sock, reply, stamps, 1, seq);
+					if (n < 0)
+						goto out;
+					if (n == 0)
+						break;
+					seq++;
+					credit--;
+				}
+		}
+out:
+	if (run->done && run->tend == 0)
+		run->tend = now_seconds ();
+	close (sock);
+	free (reply);
+	free (stamps);
+	return NULL;
+}
+
+/*----------------------------------------------------------------------*/
+
+/* File follower.  The receiver writes GEB header + packet (without the SOE)
+ * records; every digitizer record that lands is timed against its stamp.
+ */
+void follow_read (struct benchRun *run, struct followedFile *f)
+{
+	uint8_t buf[1 << 16];
+	int32_t n, pos, len, words;
+	int64_t now;
+	uint64_t ts;
+
+	while ((n = pread (f->fd, buf, sizeof (buf), f->offset)) > 0)
+		{
+			now = now_ns ();
+			f->offset += n;
+			run->filebytes += n;
+
+			if (f->npartial + n > f->size)
+				{
+					f->size = 2 * (f->npartial + n);
+					f->partial = (uint8_t *) realloc (f->partial, f->size);
+				}
+			memcpy (f->partial + f->npartial, buf, n);
+			f->npartial += n;
+
+			for (pos = 0; pos + 16 <= f->npartial; pos += 16 + len)
+				{
+					memcpy (&len, f->partial + pos + 4, sizeof (len));	// gebData.length, host order
+					if (len < 0 || len > 4 * 0x7FF)
+						{
+							printf ("%s: bad record at %lli, no longer followed\n", f->path, (long long) (f->offset - f->npartial + pos));
+							f->npartial = 0;
+							close (f->fd);
+							f->fd = -1;
+							return;
+						}
+					if (pos + 16 + len > f->npartial)
+						break;
+
+					// a digitizer record repeats its length in word 1; trigger records
+					// (host order, in SINGLE_FILE builds in the same file) do not
+					words = len / 4;
+					if (words >= MIN_PACKET_WORDS && ((get_word (f->partial + pos + 16) >> 16) & 0x7FF) == (uint32_t) words
+						&& ((get_word (f->partial + pos + 16 + 8) >> 16) & 0xF) == 0)
+						{
+							ts = ((uint64_t) get_word (f->partial + pos + 16 + 4 * STAMP_WORD) << 32) | get_word (f->partial + pos + 16 + 4 * STAMP_WORD + 4);
+							if (run->nlat < MAX_SAMPLES)
+								run->lat[run->nlat++] = now - (int64_t) ts;
+							run->landed++;
+						}
+				}
+			memmove (f->partial, f->partial + pos, f->npartial - pos);
+			f->npartial -= pos;
+		}
+}
+
+void follow_file (struct benchRun *run, const char *path)
+{
+	struct followedFile *f;
+	int32_t i;
+
+	// diagnostic dumps and the log are not GEB records
+	if (strstr (path, "diag") || strstr (path, ".log"))
+		return;
+
+	for (i = 0; i < nfiles; i++)
+		if (strcmp (files[i]->path, path) == 0)
+			break;
+	if (i == nfiles)
+		{
+			if (nfiles >= MAX_FILES)
+				return;
+			f = files[nfiles++] = (struct followedFile *) calloc (1, sizeof (struct followedFile));
+			snprintf (f->path, sizeof (f->path), "%s", path);
+			f->fd = open (path, O_RDONLY);
+		}
+	if (files[i]->fd >= 0)
+		follow_read (run, files[i]);
+}
+
+void watch_folder (struct benchRun *run, const char *dir)
+{
+	int32_t wd;
+
+	wd = inotify_add_watch (run->ifd, dir, IN_CREATE | IN_MODIFY);
+	if (wd >= 0 && wd < MAX_WATCHES)
+		snprintf (run->watched[wd], sizeof (run->watched[wd]), "%s", dir);
+}
+
+/* Read whatever inotify reports, or everything under dir if sweep is set. */
+void follow (struct benchRun *run, const char *dir, int8_t sweep)
+{
+	char buf[4096] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+	char path[1024];
+	const struct inotify_event *ev;
+	struct dirent *de;
+	struct stat st;
+	DIR *d;
+	int32_t n, i;
+
+	if (sweep)
+		{
+			d = opendir (dir);
+			if (!d)
+				return;
+			while ((de = readdir (d)) != NULL)
+				{
+					if (de->d_name[0] == '.')
+						continue;
+					snprintf (path, sizeof (path), "%s/%s", dir, de->d_name);
+					if (stat (path, &st) == 0 && S_ISDIR (st.st_mode))
+						follow (run, path, 1);
+					else
+						follow_file (run, path);
+				}
+			closedir (d);
+			return;
+		}
+
+	while ((n = read (run->ifd, buf, sizeof (buf))) > 0)
+		for (i = 0; i < n; i += sizeof (struct inotify_event) + ev->len)
+			{
+				ev = (const struct inotify_event *) (buf + i);
+				if (ev->len == 0 || ev->wd < 0 || ev->wd >= MAX_WATCHES)
+					continue;
+				snprintf (path, sizeof (path), "%s/%s", run->watched[ev->wd], ev->name);
+				// the receiver makes one folder per run; follow it too
+				if (ev->mask & IN_ISDIR)
+					{
+						watch_folder (run, path);
+						follow (run, path, 1);
+					}
+				else
+					follow_file (run, path);
+			}
+}
+
+/*----------------------------------------------------------------------*/
+
+int cmp_int64 (const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+
+	return (x > y) - (x < y);
+}
+
+double percentile_ms (struct benchRun *run, double q)
+{
+	int64_t i = (int64_t) (q * (run->nlat - 1));
+
+	return run->lat[i] * 1e-6;
+}
+
+/*----------------------------------------------------------------------*/
+
+/* Run one receiver build against a fresh traffic source and report. */
+void bench (const char *receiver)
+{
+	struct benchRun run;
+	struct sockaddr_in addr;
+	socklen_t alen = sizeof (addr);
+	struct pollfd pfd;
+	pthread_t server;
+	char hostport[64], logpath[600], optcopy[512], rcvcopy[512], binary[PATH_MAX];
+	char *argv[40], *tok, *path;
+	int32_t argc, status, exited = 0, i, logfd;
+	pid_t pid;
+	double t, tstart, tdone = 0;
+	const char *name, *c;
+
+	memset (&run, 0, sizeof (run));
+	run.rng = 0x9E3779B97F4A7C15ULL;
+	run.lat = (int64_t *) malloc (MAX_SAMPLES * sizeof (int64_t));
+
+	/* traffic source on an ephemeral loopback port */
+
+	run.lsock = socket (AF_INET, SOCK_STREAM, 0);
+	memset (&addr, 0, sizeof (addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+	if (bind (run.lsock, (struct sockaddr *) &addr, sizeof (addr)) < 0 || listen (run.lsock, 1) < 0)
+		{
+			printf ("cannot listen on loopback: %s\n", strerror (errno));
+			exit (1);
+		};
+	getsockname (run.lsock, (struct sockaddr *) &addr, &alen);
+	run.port = ntohs (addr.sin_port);
+	pthread_create (&server, NULL, serve, &run);
+
+	/* scratch folder, watched before the receiver starts */
+
+	snprintf (run.dir, sizeof (run.dir), "%s/bench_XXXXXX", outdir);
+	if (!mkdtemp (run.dir))
+		{
+			printf ("cannot make a folder in %s: %s\n", outdir, strerror (errno));
+			exit (1);
+		};
+	run.ifd = inotify_init1 (IN_NONBLOCK);
+	watch_folder (&run, run.dir);
+
+	/* receiver: <opts> 127.0.0.1:port bench gtd 2000000000 14 */
+
+	snprintf (hostport, sizeof (hostport), "127.0.0.1:%i", run.port);
+	snprintf (optcopy, sizeof (optcopy), "%s", receiver_opts);
+	snprintf (rcvcopy, sizeof (rcvcopy), "%s", receiver);
+	path = strtok (rcvcopy, " ");
+	argc = 0;
+	argv[argc++] = path;
+	for (tok = strtok (NULL, " "); tok && argc < 16; tok = strtok (NULL, " "))
+		argv[argc++] = tok;
+	for (tok = strtok (optcopy, " "); tok && argc < 32; tok = strtok (NULL, " "))
+		argv[argc++] = tok;
+	argv[argc++] = hostport;
+	argv[argc++] = (char *) "bench";
+	argv[argc++] = (char *) "gtd";
+	argv[argc++] = (char *) "2000000000";
+	argv[argc++] = (char *) "14";
+	argv[argc] = NULL;
+
+	snprintf (logpath, sizeof (logpath), "%s/receiver.log", run.dir);
+	if (!realpath (path, binary))
+		{
+			printf ("%s: %s\n", path, strerror (errno));
+			exit (1);
+		};
+	tstart = now_seconds ();
+	pid = fork ();
+	if (pid == 0)
+		{
+			logfd = open (logpath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			dup2 (logfd, 1);
+			dup2 (logfd, 2);
+			if (chdir (run.dir) != 0)
+				_exit (127);
+			execv (binary, argv);
+			_exit (127);
+		}
+
+	/* follow the files until the receiver is gone */
+
+	pfd.fd = run.ifd;
+	pfd.events = POLLIN;
+	while (!exited)
+		{
+			poll (&pfd, 1, 100);
+			follow (&run, NULL, 0);
+
+			if (waitpid (pid, &status, WNOHANG) == pid)
+				{
+					exited = 1;
+					tdone = now_seconds ();
+				}
+			t = now_seconds ();
+			if (!exited && ((run.tend > 0 && t - run.tend > EXIT_GRACE_MS * 1e-3)
+				|| (run.tfirst == 0 && t - tstart > START_TIMEOUT_MS * 1e-3)))
+				{
+					kill (pid, SIGINT);
+					waitpid (pid, &status, 0);
+					exited = 1;
+					tdone = now_seconds ();
+				}
+		}
+
+	// files are flushed on close, so take one last look at everything
+	follow (&run, run.dir, 1);
+	shutdown (run.lsock, SHUT_RDWR);
+	close (run.lsock);
+	pthread_join (server, NULL);
+
+	/* report */
+
+	name = receiver;
+	for (c = receiver; *c && *c != ' '; c++)
+		if (*c == '/')
+			name = c + 1;
+	if (run.tfirst == 0 || run.tend == 0)
+		printf ("%-26s did not finish, see %s\n", name, logpath);
+	else
+		{
+			t = run.tend - run.tfirst;
+			printf ("%-26s %9.1f %11.0f %9.1f", name, run.bytes / 1e6 / t, run.events / t, tdone - run.tend);
+			if (run.nlat > 0)
+				{
+					qsort (run.lat, run.nlat, sizeof (int64_t), cmp_int64);
+					printf (" %9.3f %9.3f %9.3f %9.2f%%\n", percentile_ms (&run, 0.5), percentile_ms (&run, 0.99),
+						percentile_ms (&run, 0.999), 100.0 * run.landed / (run.digitizer > 0 ? run.digitizer : 1));
+				}
+			else
+				printf ("         -         -         -         -\n");
+		}
+	fflush (stdout);
+
+	for (i = 0; i < nfiles; i++)
+		{
+			if (files[i]->fd >= 0)
+				close (files[i]->fd);
+			free (files[i]->partial);
+			free (files[i]);
+		}
+	nfiles = 0;
+	close (run.ifd);
+	free (run.lat);
+	if (!keep_files && WIFEXITED (status) && WEXITSTATUS (status) == 0)
+		{
+			snprintf (logpath, sizeof (logpath), "rm -rf '%s'", run.dir);
+			if (system (logpath) != 0)
+				printf ("could not remove %s\n", run.dir);
+		}
+}
+
+/*----------------------------------------------------------------------*/
+
+void usage (void)
+{
+	printf ("\n");
+	printf ("use: benchReceiver [options] <receiver> [<receiver> ...]\n");
+	printf ("\n");
+	printf ("Runs each receiver build in turn against a built-in IOC on loopback and\n");
+	printf ("prints one line per build.  A receiver may carry its own options, quoted\n");
+	printf ("with the binary; they go before the -R options.  Receivers must write GEB\n");
+	printf ("headers (the default, not -D raw).\n");
+	printf ("e.g: benchReceiver -d 10 -n 4 -c 10 ./dgsReceiver \"./dgsReceiver -F board\"\n");
+	printf ("\n");
+	printf ("traffic:\n");
+	printf ("  -n <boards>     boards (default 4)\n");
+	printf ("  -c <ch>         channels per board, at most 10 (default 10)\n");
+	printf ("  -l <min[:max]>  digitizer packet length in words after the SOE, uniform\n");
+	printf ("                  between min and max, at least %i (default 64)\n", MIN_PACKET_WORDS);
+	printf ("  -s <bytes>      largest SERVER_SUMMARY payload (default 65536)\n");
+	printf ("  -r <rate>       events per second while a burst is on, 0 = as fast as\n");
+	printf ("                  the receiver asks (default 0)\n");
+	printf ("  -b <on:off>     bursts: on for <on> ms, then INSUFF_DATA for <off> ms\n");
+	printf ("  -t <fraction>   fraction of events sent as trigger packets (default 0)\n");
+	printf ("  -d <seconds>    traffic time per receiver (default 10)\n");
+	printf ("\n");
+	printf ("run:\n");
+	printf ("  -o <dir>        where the receivers write (default .); the disk matters\n");
+	printf ("  -R \"<opts>\"     options passed to every receiver, e.g. \"-u -w 8\"\n");
+	printf ("  -k              keep the output folders\n");
+	printf ("\n");
+	printf ("Columns: MB/s and events/s sustained over the traffic time; drain, the\n");
+	printf ("seconds from the end of the traffic until the receiver exited; and the\n");
+	printf ("p50/p99/p999 time from send() to the packet landing in its output file,\n");
+	printf ("in ms, with the percentage of digitizer packets found in the files.\n");
+	printf ("Receivers that save nothing (-n) show no latency.\n");
+	printf ("\n");
+}
+
+/*----------------------------------------------------------------------*/
+
+int main (int argc, char **argv)
+{
+	int32_t opt, i;
+	char *colon;
+
+	while ((opt = getopt (argc, argv, "n:c:l:s:r:b:t:d:o:R:kh")) != -1)
+		switch (opt)
+			{
+			case 'n': nboards = atoi (optarg); break;
+			case 'c': nchannels = atoi (optarg); break;
+			case 'l':
+				min_words = max_words = atoi (optarg);
+				colon = strchr (optarg, ':');
+				if (colon)
+					max_words = atoi (colon + 1);
+				break;
+			case 's': reply_size = atoi (optarg); break;
+			case 'r': event_rate = atof (optarg); break;
+			case 'b':
+				burst_on_ms = atoi (optarg);
+				colon = strchr (optarg, ':');
+				burst_off_ms = colon ? atoi (colon + 1) : 0;
+				break;
+			case 't': trigger_fraction = atof (optarg); break;
+			case 'd': duration = atof (optarg); break;
+			case 'o': outdir = optarg; break;
+			case 'R': receiver_opts = optarg; break;
+			case 'k': keep_files = 1; break;
+			default: usage (); exit (1);
+			}
+
+	if (optind >= argc || nchannels < 1 || nchannels > 10 || nboards < 1 || nboards >= TRIG_BOARD_ID
+		|| min_words < MIN_PACKET_WORDS || max_words < min_words || max_words > 0x7FF
+		|| reply_size < 4 * (max_words + 1) + 16 * (nboards + 1) || reply_size > MAX_REPLY_SIZE
+		|| trigger_fraction < 0 || trigger_fraction > 1 || duration <= 0)
+		{
+			usage ();
+			exit (1);
+		};
+
+	signal (SIGPIPE, SIG_IGN);
+
+	printf ("benchReceiver V%s: %i boards x %i channels, %i..%i words/packet, %i bytes/reply, ",
+		VERSION, nboards, nchannels, min_words, max_words, reply_size);
+	if (event_rate > 0)
+		printf ("%.0f events/s", event_rate);
+	else
+		printf ("unlimited rate");
+	if (burst_on_ms > 0 && burst_off_ms > 0)
+		printf (", bursts %i ms on %i ms off", burst_on_ms, burst_off_ms);
+	printf (", %.0f%% triggers, %.0f s", 100 * trigger_fraction, duration);
+	if (receiver_opts[0])
+		printf (", receiver options \"%s\"", receiver_opts);
+	printf ("\n\n");
+	printf ("%-26s %9s %11s %9s %9s %9s %9s %10s\n", "receiver", "MB/s", "events/s", "drain s", "p50 ms", "p99 ms", "p999 ms", "landed");
+	fflush (stdout);
+
+	for (i = optind; i < argc; i++)
+		bench (argv[i]);
+
+	return 0;
+}
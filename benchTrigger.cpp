@@ -0,0 +1,222 @@
+//--------------------------------------------------------------------------------
+// Company:		Argonne National Laboratory
+// Division:	Physics
+// Project:		DGS Receiver
+// File:		benchTrigger.cpp
+// Description: Micro-benchmark of the trigger packet reformatting.  Times the
+//              per-packet loop the receivers used to run (ntohl of every word,
+//              then packing by hand) against the batched dgsTrigRecords of
+//              dgsDecode.h, scalar and SIMD, and checks they agree.
+//--------------------------------------------------------------------------------
+
+//g++ benchTrigger.cpp -O3 -Wall -Wextra -o benchTrigger
+
+#define VERSION "1.00"
+//  V1.00: Per-packet loop against dgsTrigRecords, scalar and SIMD.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <getopt.h>
+#include <arpa/inet.h>
+
+#include "dgsDecode.h"
+
+// BUILD PARAMETERS:
+// TRIG_BOARD_ID: Board id the receivers put in word 1 of a trigger record.
+#define TRIG_BOARD_ID 0xF
+
+int32_t npackets = 1000000;
+int32_t repeats = 5;
+int32_t batch = DGS_TRIG_BATCH;
+
+int8_t *packets;
+uint32_t *records;
+uint64_t *timestamps;
+
+/*----------------------------------------------------------------------*/
+
+int64_t now_ns (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Trigger packets as an IOC sends them: the SOE, then a 16-bit value in the
+ * low half of each big-endian word.
+ */
+void make_packets (void)
+{
+	const uint32_t trig_soe = 0xAAAA0000;
+	uint64_t rng = 0x9E3779B97F4A7C15ULL;
+	uint32_t w;
+	int32_t i, j;
+
+	for (i = 0; i < npackets; i++)
+		{
+			memcpy (packets + i * DGS_TRIG_PACKET_BYTES, &trig_soe, sizeof (trig_soe));
+			for (j = 1; j < DGS_TRIG_SLOTS; j++)
+				{
+					rng ^= rng << 13;
+					rng ^= rng >> 7;
+					rng ^= rng << 17;
+					w = htonl ((uint32_t) rng & 0xFFFF);
+					memcpy (packets + i * DGS_TRIG_PACKET_BYTES + 4 * j, &w, sizeof (w));
+				}
+		}
+}
+
+/* The loop the receivers ran for every trigger packet. */
+void per_packet (void)
+{
+	uint32_t hdr[DGS_TRIG_SLOTS], *rec;
+	const uint32_t *src;
+	int32_t i, j;
+
+	for (i = 0; i < npackets; i++)
+		{
+			src = (const uint32_t *) (packets + i * DGS_TRIG_PACKET_BYTES);
+			rec = records + i * DGS_TRIG_RECORD_WORDS;
+			for (j = 0; j < DGS_TRIG_SLOTS; j++)
+				hdr[j] = ntohl (src[j]);
+
+			rec[0] = 0xAAAAAAAA;
+			rec[1] = TRIG_BOARD_ID << 4;
+			rec[1] |= DGS_TRIG_RECORD_LENGTH << 16;
+			rec[2] = hdr[4];
+			rec[2] |= hdr[3] << 16;
+			rec[3] = hdr[2];
+			rec[3] |= DGS_TRIG_HEADER_TYPE << 16;
+			rec[3] |= 3 << 26;
+			rec[4] = (hdr[ 1] << 16) + hdr[ 5];
+			rec[5] = (hdr[ 6] << 16) + hdr[ 7];
+			rec[6] = (hdr[ 8] << 16) + hdr[ 9];
+			rec[7] = (hdr[10] << 16) + hdr[11];
+			rec[8] = (hdr[12] << 16) + hdr[13];
+			rec[9] = (hdr[14] << 16) + hdr[15];
+			rec[10] = rec[11] = 0;
+
+			timestamps[i]  = ((uint64_t) (hdr[2])) << 32;
+			timestamps[i] |= ((uint64_t) (hdr[3])) << 16;
+			timestamps[i] |=  (uint64_t) (hdr[4]);
+		}
+}
+
+/* dgsTrigRecords over runs of batch packets, as the writers call it. */
+void batched (void)
+{
+	int32_t i, n;
+
+	for (i = 0; i < npackets; i += n)
+		{
+			n = (npackets - i < batch) ? npackets - i : batch;
+			dgsTrigRecords (packets + i * DGS_TRIG_PACKET_BYTES, n, dgsTrigWord1 (TRIG_BOARD_ID, 0),
+							records + i * DGS_TRIG_RECORD_WORDS, timestamps + i);
+		}
+}
+
+/*----------------------------------------------------------------------*/
+
+/* Best of the repeats, in ns per packet. */
+double time_it (void (*fn) (void))
+{
+	double best = 1e30, t;
+	int64_t t0;
+	int32_t r;
+
+	for (r = 0; r < repeats; r++)
+		{
+			t0 = now_ns ();
+			fn ();
+			t = (double) (now_ns () - t0) / npackets;
+			if (t < best)
+				best = t;
+		}
+	return best;
+}
+
+/* Print one line, and whether the records match the per-packet loop's. */
+int32_t report (const char *name, double ns, double reference, uint32_t *ref, uint64_t *ref_ts)
+{
+	printf ("%-22s %8.2f %10.1f %8.2fx\n", name, ns, 1e3 / ns, reference / ns);
+	if (memcmp (ref, records, (size_t) npackets * DGS_TRIG_RECORD_WORDS * sizeof (uint32_t))
+		|| memcmp (ref_ts, timestamps, (size_t) npackets * sizeof (uint64_t)))
+		{
+			printf ("  MISMATCH with the per-packet loop\n");
+			return 1;
+		}
+	return 0;
+}
+
+void usage (void)
+{
+	printf ("\n");
+	printf ("use: benchTrigger [options]\n");
+	printf ("\n");
+	printf ("Reformats trigger packets in memory with the old per-packet loop and with\n");
+	printf ("dgsTrigRecords, and prints ns and million packets per second for each.\n");
+	printf ("\n");
+	printf ("options:\n");
+	printf ("  -n <packets>  trigger packets per pass (default 1000000)\n");
+	printf ("  -r <n>        passes, the best one counts (default 5)\n");
+	printf ("  -b <n>        packets per dgsTrigRecords call (default %i)\n", DGS_TRIG_BATCH);
+	printf ("\n");
+}
+
+/*----------------------------------------------------------------------*/
+
+int main (int argc, char **argv)
+{
+	uint32_t *reference;
+	uint64_t *reference_ts;
+	double ns_loop;
+	int32_t opt, bad = 0;
+
+	while ((opt = getopt (argc, argv, "n:r:b:h")) != -1)
+		switch (opt)
+			{
+			case 'n': npackets = atoi (optarg); break;
+			case 'r': repeats = atoi (optarg); break;
+			case 'b': batch = atoi (optarg); break;
+			default: usage (); exit (1);
+			}
+	if (npackets < 1 || repeats < 1 || batch < 1)
+		{
+			usage ();
+			exit (1);
+		};
+
+	packets = (int8_t *) malloc ((size_t) npackets * DGS_TRIG_PACKET_BYTES);
+	records = (uint32_t *) malloc ((size_t) npackets * DGS_TRIG_RECORD_WORDS * sizeof (uint32_t));
+	timestamps = (uint64_t *) malloc ((size_t) npackets * sizeof (uint64_t));
+	reference = (uint32_t *) malloc ((size_t) npackets * DGS_TRIG_RECORD_WORDS * sizeof (uint32_t));
+	reference_ts = (uint64_t *) malloc ((size_t) npackets * sizeof (uint64_t));
+	make_packets ();
+
+	dgsDecodeInit ();
+	printf ("benchTrigger V%s: %i trigger packets (%.1f MB), %i per batch, best of %i\n\n",
+		VERSION, npackets, npackets * (double) DGS_TRIG_PACKET_BYTES / 1e6, batch, repeats);
+	printf ("%-22s %8s %10s %9s\n", "", "ns/pkt", "Mpkt/s", "speedup");
+
+	ns_loop = time_it (per_packet);
+	memcpy (reference, records, (size_t) npackets * DGS_TRIG_RECORD_WORDS * sizeof (uint32_t));
+	memcpy (reference_ts, timestamps, (size_t) npackets * sizeof (uint64_t));
+	report ("per-packet loop", ns_loop, ns_loop, reference, reference_ts);
+
+	#ifdef DGS_DECODE_X86
+		if (dgsDecodeLevel >= DGS_DECODE_SSSE3)
+			{
+				memset (records, 0, (size_t) npackets * DGS_TRIG_RECORD_WORDS * sizeof (uint32_t));
+				bad |= report ("batched, ssse3", time_it (batched), ns_loop, reference, reference_ts);
+			}
+	#endif
+	dgsDecodeLevel = DGS_DECODE_SCALAR;
+	memset (records, 0, (size_t) npackets * DGS_TRIG_RECORD_WORDS * sizeof (uint32_t));
+	bad |= report ("batched, scalar", time_it (batched), ns_loop, reference, reference_ts);
+
+	return bad;
+}
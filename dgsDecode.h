@@ -0,0 +1,622 @@
+//--------------------------------------------------------------------------------
+// Company:		Argonne National Laboratory
+// Division:	Physics
+// Project:		DGS Receiver
+// File:		dgsDecode.h
+// Description: Two-pass parse of the big-endian DGS packets.  A received buffer
+//              is first scanned for SOE words and indexed, then the header words
+//              of all its packets are byte-swapped and split into fields with
+//              SSSE3 or AVX2 shuffles (picked at run time, scalar code otherwise).
+//              The writer reads the fields from the compact arrays in dgsHeaders.
+//              With resync, corrupt bytes are listed as PKT_SKIP and the walk
+//              goes on at the next SOE that starts a sound packet.
+//              Runs of trigger packets are reformatted into digitizer-like
+//              records a batch at a time (dgsTrigRecords), for the receivers
+//              and the offline tools alike.
+//--------------------------------------------------------------------------------
+
+#ifndef _DGS_DECODE_H
+#define _DGS_DECODE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(NO_SIMD_DECODE)
+	#define DGS_DECODE_X86
+	#include <immintrin.h>
+#endif
+
+// Packet kinds, as found by dgsIndex.
+#define PKT_BAD		0	// does not start with 0xAAAAXXXX
+#define PKT_DIG		1	// digitizer packet, 0xAAAAAAAA
+#define PKT_TRIG	2	// trigger packet, 0xAAAAXXXX
+#define PKT_SHORT	4	// or'ed in: the header runs past the end of the buffer
+#define PKT_NOSOE	8	// or'ed in: no 0xAAAAAAAA where the packet length says the next one starts
+#define PKT_SKIP	16	// resync: corrupt bytes, up to the next packet (or the end of the buffer)
+
+// DGS_SCAN_BLOCK: Buffer words mapped for SOEs at a time, 32 kB, so that the
+//  walk over the packet lengths finds them still in the cache.
+#define DGS_SCAN_BLOCK 8192
+// DGS_DECODE_RUN: Headers indexed between two decode runs, a multiple of 8.
+#define DGS_DECODE_RUN 64
+
+#define DGS_DIG_HEADER_BYTES 16		// SOE and header words 1..3
+#define DGS_TRIG_PACKET_BYTES 64	// 16 words, SOE included
+#define DGS_TRIG_SLOTS 16			// 16-bit values of a trigger packet, one per word
+#define DGS_TRIG_RECORD_WORDS 12	// reformatted trigger: SOE, words 1..9, two zero words
+#define DGS_TRIG_RECORD_LENGTH 10	// packet length in word 1 of the record
+#define DGS_TRIG_HEADER_TYPE 0xE
+// DGS_TRIG_BATCH: Trigger packets reformatted at a time by the writers.
+#define DGS_TRIG_BATCH 64
+
+/* The packets of one buffer, one array per field.  Fields of
+ * trigger, short, bad and skipped packets are left undefined.
+ */
+struct dgsHeaders
+{
+	int32_t n;
+	int32_t cap;						 /* entries allocated */
+	uint32_t *offset;					 /* byte offset of the SOE in the buffer */
+	uint32_t *kind;
+	uint32_t *ch;						 /* word 1: 3..0 */
+	uint32_t *board;					 /* word 1: 15..4 */
+	uint32_t *length;					 /* word 1: 26..16, in words, SOE excluded */
+	uint32_t *ts_lower;					 /* word 2 */
+	uint32_t *ts_upper;					 /* word 3: 15..0 */
+	uint32_t *header_type;				 /* word 3: 19..16 */
+	uint32_t *event_type;				 /* word 3: 25..23 */
+	int32_t scanned;					 /* buffer words mapped so far */
+	int32_t mapcap;						 /* soe_map words allocated */
+	uint32_t *soe_map;					 /* 4 bits per buffer word, one per byte of a 0xAAAA half */
+	int32_t resyncs;					 /* PKT_SKIP entries */
+	int32_t skipped;					 /* bytes in them */
+	int32_t recovered;					 /* packets after the first one, lost without resync */
+};
+
+#define DGS_DECODE_SCALAR 0
+#define DGS_DECODE_SSSE3 1
+#define DGS_DECODE_AVX2 2
+
+static int32_t dgsDecodeLevel = DGS_DECODE_SCALAR;
+
+/* Pick the widest decoder this CPU runs.  Returns its name. */
+static inline const char *dgsDecodeInit (void)
+{
+	#ifdef DGS_DECODE_X86
+		__builtin_cpu_init ();
+		if (__builtin_cpu_supports ("avx2"))
+			dgsDecodeLevel = DGS_DECODE_AVX2;
+		else if (__builtin_cpu_supports ("ssse3"))
+			dgsDecodeLevel = DGS_DECODE_SSSE3;
+	#endif
+	if (dgsDecodeLevel == DGS_DECODE_AVX2)
+		return "avx2";
+	if (dgsDecodeLevel == DGS_DECODE_SSSE3)
+		return "ssse3";
+	return "scalar";
+}
+
+static inline void dgsDecodeScalar (const int8_t *buffer, struct dgsHeaders *h, int32_t i, int32_t end)
+{
+	uint32_t w[4];
+
+	for (; i < end; i++)
+		{
+			if (h->kind[i] == PKT_BAD || (h->kind[i] & (PKT_SHORT | PKT_SKIP)))
+				continue;
+			memcpy (w, buffer + h->offset[i], sizeof (w));
+			w[1] = __builtin_bswap32 (w[1]);
+			w[2] = __builtin_bswap32 (w[2]);
+			w[3] = __builtin_bswap32 (w[3]);
+			h->ch[i] = w[1] & 0xF;
+			h->board[i] = (w[1] >> 4) & 0xFFF;
+			h->length[i] = (w[1] >> 16) & 0x7FF;
+			h->ts_lower[i] = w[2];
+			h->ts_upper[i] = w[3] & 0xFFFF;
+			h->header_type[i] = (w[3] >> 16) & 0xF;
+			h->event_type[i] = (w[3] >> 23) & 0x7;
+		}
+}
+
+#ifdef DGS_DECODE_X86
+
+/* The 16 header bytes of packet i, or zeros if it has none in the buffer. */
+static inline const void *dgsHeaderBytes (const int8_t *buffer, const struct dgsHeaders *h, int32_t i)
+{
+	static const uint32_t none[4] = { 0, 0, 0, 0 };
+
+	if (h->kind[i] != PKT_BAD && !(h->kind[i] & (PKT_SHORT | PKT_SKIP)))
+		return buffer + h->offset[i];
+	return none;
+}
+
+/* Four packets per step: swap, transpose to one register per header word,
+ * then mask out the fields of all four at once.
+ */
+__attribute__ ((target ("ssse3")))
+static inline int32_t dgsDecodeSSSE3 (const int8_t *buffer, struct dgsHeaders *h, int32_t i, int32_t end)
+{
+	const __m128i swap = _mm_setr_epi8 (3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	__m128i a, b, c, d, t0, t1, t2, t3, w1, w2, w3;
+
+	for (; i + 4 <= end; i += 4)
+		{
+			a = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) dgsHeaderBytes (buffer, h, i)), swap);
+			b = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) dgsHeaderBytes (buffer, h, i + 1)), swap);
+			c = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) dgsHeaderBytes (buffer, h, i + 2)), swap);
+			d = _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) dgsHeaderBytes (buffer, h, i + 3)), swap);
+			t0 = _mm_unpacklo_epi32 (a, b);
+			t1 = _mm_unpacklo_epi32 (c, d);
+			t2 = _mm_unpackhi_epi32 (a, b);
+			t3 = _mm_unpackhi_epi32 (c, d);
+			w1 = _mm_unpackhi_epi64 (t0, t1);
+			w2 = _mm_unpacklo_epi64 (t2, t3);
+			w3 = _mm_unpackhi_epi64 (t2, t3);
+			_mm_storeu_si128 ((__m128i *) &h->ch[i], _mm_and_si128 (w1, _mm_set1_epi32 (0xF)));
+			_mm_storeu_si128 ((__m128i *) &h->board[i], _mm_and_si128 (_mm_srli_epi32 (w1, 4), _mm_set1_epi32 (0xFFF)));
+			_mm_storeu_si128 ((__m128i *) &h->length[i], _mm_and_si128 (_mm_srli_epi32 (w1, 16), _mm_set1_epi32 (0x7FF)));
+			_mm_storeu_si128 ((__m128i *) &h->ts_lower[i], w2);
+			_mm_storeu_si128 ((__m128i *) &h->ts_upper[i], _mm_and_si128 (w3, _mm_set1_epi32 (0xFFFF)));
+			_mm_storeu_si128 ((__m128i *) &h->header_type[i], _mm_and_si128 (_mm_srli_epi32 (w3, 16), _mm_set1_epi32 (0xF)));
+			_mm_storeu_si128 ((__m128i *) &h->event_type[i], _mm_and_si128 (_mm_srli_epi32 (w3, 23), _mm_set1_epi32 (0x7)));
+		}
+	return i;
+}
+
+/* As dgsDecodeSSSE3, with packets i..i+3 in the low lanes and i+4..i+7 in
+ * the high lanes, so the in-lane unpacks leave them in order.
+ */
+__attribute__ ((target ("avx2")))
+static inline int32_t dgsDecodeAVX2 (const int8_t *buffer, struct dgsHeaders *h, int32_t i, int32_t end)
+{
+	const __m256i swap = _mm256_setr_epi8 (3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+										   3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	__m256i v[4], t0, t1, t2, t3, w1, w2, w3;
+	int32_t j;
+
+	for (; i + 8 <= end; i += 8)
+		{
+			for (j = 0; j < 4; j++)
+				{
+					v[j] = _mm256_castsi128_si256 (_mm_loadu_si128 ((const __m128i *) dgsHeaderBytes (buffer, h, i + j)));
+					v[j] = _mm256_inserti128_si256 (v[j], _mm_loadu_si128 ((const __m128i *) dgsHeaderBytes (buffer, h, i + j + 4)), 1);
+					v[j] = _mm256_shuffle_epi8 (v[j], swap);
+				}
+			t0 = _mm256_unpacklo_epi32 (v[0], v[1]);
+			t1 = _mm256_unpacklo_epi32 (v[2], v[3]);
+			t2 = _mm256_unpackhi_epi32 (v[0], v[1]);
+			t3 = _mm256_unpackhi_epi32 (v[2], v[3]);
+			w1 = _mm256_unpackhi_epi64 (t0, t1);
+			w2 = _mm256_unpacklo_epi64 (t2, t3);
+			w3 = _mm256_unpackhi_epi64 (t2, t3);
+			_mm256_storeu_si256 ((__m256i *) &h->ch[i], _mm256_and_si256 (w1, _mm256_set1_epi32 (0xF)));
+			_mm256_storeu_si256 ((__m256i *) &h->board[i], _mm256_and_si256 (_mm256_srli_epi32 (w1, 4), _mm256_set1_epi32 (0xFFF)));
+			_mm256_storeu_si256 ((__m256i *) &h->length[i], _mm256_and_si256 (_mm256_srli_epi32 (w1, 16), _mm256_set1_epi32 (0x7FF)));
+			_mm256_storeu_si256 ((__m256i *) &h->ts_lower[i], w2);
+			_mm256_storeu_si256 ((__m256i *) &h->ts_upper[i], _mm256_and_si256 (w3, _mm256_set1_epi32 (0xFFFF)));
+			_mm256_storeu_si256 ((__m256i *) &h->header_type[i], _mm256_and_si256 (_mm256_srli_epi32 (w3, 16), _mm256_set1_epi32 (0xF)));
+			_mm256_storeu_si256 ((__m256i *) &h->event_type[i], _mm256_and_si256 (_mm256_srli_epi32 (w3, 23), _mm256_set1_epi32 (0x7)));
+		}
+	return i;
+}
+
+#endif // DGS_DECODE_X86
+
+/* Make room for the index of a buffer of size bytes. */
+static inline void dgsReserve (struct dgsHeaders *h, int32_t size)
+{
+	// with resync, a skipped word can sit between every two packets
+	int32_t cap = size / (DGS_DIG_HEADER_BYTES / 2) + 8;
+	int32_t mapcap = size / 32 + 2;
+
+	if (h->cap < cap)
+		{
+			free (h->offset);
+			// all nine field arrays in one block
+			h->offset = (uint32_t *) malloc (9 * cap * sizeof (uint32_t));
+			h->kind = h->offset + cap;
+			h->ch = h->kind + cap;
+			h->board = h->ch + cap;
+			h->length = h->board + cap;
+			h->ts_lower = h->length + cap;
+			h->ts_upper = h->ts_lower + cap;
+			h->header_type = h->ts_upper + cap;
+			h->event_type = h->header_type + cap;
+			h->cap = cap;
+		}
+	if (h->mapcap < mapcap)
+		{
+			free (h->soe_map);
+			h->soe_map = (uint32_t *) malloc (mapcap * sizeof (uint32_t));
+			h->mapcap = mapcap;
+		}
+}
+
+/* Map the 16-bit halves that are 0xAAAA from word i (a multiple of 8) up to
+ * end.  Returns where it stopped.
+ */
+static inline int32_t dgsScanScalar (const uint32_t *w, struct dgsHeaders *h, int32_t i, int32_t end)
+{
+	uint32_t m;
+	int32_t j;
+
+	for (; i < end; i += 8)
+		{
+			m = 0;
+			for (j = 0; j < 8 && i + j < end; j++)
+				m |= ((uint32_t) ((w[i + j] & 0xFFFF) == 0xAAAA) * 0x3u
+					  | (uint32_t) ((w[i + j] >> 16) == 0xAAAA) * 0xCu) << (4 * j);
+			h->soe_map[i / 8] = m;
+		}
+	return end;
+}
+
+#ifdef DGS_DECODE_X86
+
+/* One 16-bit compare and byte mask per 4 words.  SSE2 is always there on x86-64. */
+__attribute__ ((target ("sse2")))
+static inline int32_t dgsScanSSE2 (const uint32_t *w, struct dgsHeaders *h, int32_t i, int32_t end)
+{
+	const __m128i soe = _mm_set1_epi16 ((int16_t) 0xAAAA);
+	uint32_t lo, hi;
+
+	for (; i + 8 <= end; i += 8)
+		{
+			lo = _mm_movemask_epi8 (_mm_cmpeq_epi16 (_mm_loadu_si128 ((const __m128i *) (w + i)), soe));
+			hi = _mm_movemask_epi8 (_mm_cmpeq_epi16 (_mm_loadu_si128 ((const __m128i *) (w + i + 4)), soe));
+			h->soe_map[i / 8] = lo | (hi << 16);
+		}
+	return i;
+}
+
+__attribute__ ((target ("avx2")))
+static inline int32_t dgsScanAVX2 (const uint32_t *w, struct dgsHeaders *h, int32_t i, int32_t end)
+{
+	const __m256i soe = _mm256_set1_epi16 ((int16_t) 0xAAAA);
+
+	for (; i + 8 <= end; i += 8)
+		h->soe_map[i / 8] = _mm256_movemask_epi8 (_mm256_cmpeq_epi16 (_mm256_loadu_si256 ((const __m256i *) (w + i)), soe));
+	return i;
+}
+
+#endif // DGS_DECODE_X86
+
+/* Split the headers of packets i..end-1 into the field arrays. */
+static inline void dgsDecode (const int8_t *buffer, struct dgsHeaders *h, int32_t i, int32_t end)
+{
+	#ifdef DGS_DECODE_X86
+		if (dgsDecodeLevel == DGS_DECODE_AVX2)
+			i = dgsDecodeAVX2 (buffer, h, i, end);
+		if (dgsDecodeLevel >= DGS_DECODE_SSSE3)
+			i = dgsDecodeSSSE3 (buffer, h, i, end);
+	#endif
+	dgsDecodeScalar (buffer, h, i, end);
+}
+
+/* Map the SOE words of the buffer up to at least word need, in blocks of
+ * DGS_SCAN_BLOCK words that the walk then finds still in cache.
+ */
+static inline void dgsScan (const uint32_t *w, int32_t nw, struct dgsHeaders *h, int32_t need)
+{
+	int32_t end = h->scanned + DGS_SCAN_BLOCK;
+
+	if (end <= need)
+		end = (need / 8 + 1) * 8;
+	if (end > nw)
+		end = nw;
+	#ifdef DGS_DECODE_X86
+		if (dgsDecodeLevel == DGS_DECODE_AVX2)
+			h->scanned = dgsScanAVX2 (w, h, h->scanned, end);
+		else
+			h->scanned = dgsScanSSE2 (w, h, h->scanned, end);
+	#endif
+	h->scanned = dgsScanScalar (w, h, h->scanned, end);
+}
+
+/* 0 for a word that is no SOE, PKT_TRIG for 0xAAAAXXXX, PKT_DIG for 0xAAAAAAAA.
+ * Without vector compares, mapping costs more than it saves, so the word is
+ * simply loaded.
+ */
+static inline uint32_t dgsSoe (const int8_t *buffer, int32_t nw, struct dgsHeaders *h, int32_t word)
+{
+	uint32_t x;
+
+	if (word >= nw)
+		return 0;	// a partial word at the end of the buffer
+	#ifdef DGS_DECODE_X86
+		if (word >= h->scanned)
+			dgsScan ((const uint32_t *) buffer, nw, h, word);
+		x = (h->soe_map[word / 8] >> (4 * (word % 8))) & 0xF;
+		if (x == 0xF)
+			return PKT_DIG;
+		if (x & 0x8)
+			return PKT_TRIG;
+	#else
+		(void) h;
+		memcpy (&x, buffer + 4 * word, sizeof (x));
+		if (x == 0xAAAAAAAA)
+			return PKT_DIG;
+		if ((x & 0xFFFF0000) == 0xAAAA0000)
+			return PKT_TRIG;
+	#endif
+	return 0;
+}
+
+/* The first word from word on that is an SOE, or nw.  The map is searched a
+ * block of 8 words at a time, so a run of corrupt data costs one vector
+ * compare per 8 words.
+ */
+static inline int32_t dgsNextSoe (const int8_t *buffer, int32_t nw, struct dgsHeaders *h, int32_t word)
+{
+	#ifdef DGS_DECODE_X86
+		uint32_t m;
+
+		while (word < nw)
+			{
+				if (word >= h->scanned)
+					dgsScan ((const uint32_t *) buffer, nw, h, word);
+				m = h->soe_map[word / 8] >> (4 * (word % 8));
+				if (m == 0)
+					{
+						word = (word / 8 + 1) * 8;
+						continue;
+					}
+				word += __builtin_ctz (m) / 4;
+				if (dgsSoe (buffer, nw, h, word))
+					return word;
+				word++;
+			}
+		return nw;
+	#else
+		while (word < nw && !dgsSoe (buffer, nw, h, word))
+			word++;
+		return word;
+	#endif
+}
+
+/* Where the packet at pos ends, if it looks sound: an SOE, a digitizer
+ * length that covers the header and stays in the buffer, and the next SOE
+ * (of either kind) or the end of the buffer right after it.  -1 otherwise.
+ */
+static inline int32_t dgsPacketEnd (const int8_t *buffer, int32_t size, struct dgsHeaders *h, int32_t pos)
+{
+	int32_t nw = size / 4, next;
+	uint32_t w1, len, soe;
+
+	soe = dgsSoe (buffer, nw, h, pos / 4);
+	if (soe == PKT_DIG)
+		{
+			if (pos + DGS_DIG_HEADER_BYTES > size)
+				return -1;
+			memcpy (&w1, buffer + pos + 4, sizeof (w1));
+			len = (__builtin_bswap32 (w1) >> 16) & 0x7FF;
+			if (len < 3)
+				return -1;
+			next = pos + 4 + len * 4;
+		}
+	else if (soe == PKT_TRIG)
+		next = pos + DGS_TRIG_PACKET_BYTES;
+	else
+		return -1;
+	if (next > size || (next < size && !dgsSoe (buffer, nw, h, next / 4)))
+		return -1;
+	return next;
+}
+
+/* Resync: list the bytes from pos up to the next sound packet as PKT_SKIP
+ * and return where that packet starts, or size if there is none.
+ */
+static inline int32_t dgsResync (const int8_t *buffer, int32_t size, struct dgsHeaders *h, int32_t pos)
+{
+	int32_t nw = size / 4, word = pos / 4 + 1, next;
+
+	while ((word = dgsNextSoe (buffer, nw, h, word)) < nw && dgsPacketEnd (buffer, size, h, 4 * word) < 0)
+		word++;
+	next = (word < nw) ? 4 * word : size;
+	h->offset[h->n] = pos;
+	h->kind[h->n++] = PKT_SKIP;
+	h->resyncs++;
+	h->skipped += next - pos;
+	return next;
+}
+
+/* First pass over a received buffer: map the SOE words, follow the packet
+ * lengths from the start and list the packets found, with their headers
+ * decoded DGS_DECODE_RUN at a time.  A packet start or a length boundary is
+ * a bit test on the map, not a load.  The walk ends after a packet that is
+ * bad, short, too short, or not followed by a 0xAAAAAAAA, so that the writer
+ * reports it where the old per-packet loop did.  With resync, the walk instead
+ * lists the corrupt bytes as PKT_SKIP and goes on (dgsResync).  Packets are
+ * 32-bit aligned, so map nibble i is buffer word i.
+ */
+static inline void dgsIndex (const int8_t *buffer, int32_t size, struct dgsHeaders *h, int32_t resync)
+{
+	int32_t nw = size / 4, pos = 0, next, decoded = 0, first_skip = -1;
+	uint32_t w1, len, soe;
+
+	dgsReserve (h, size);
+	h->n = 0;
+	h->scanned = 0;
+	h->resyncs = h->skipped = h->recovered = 0;
+	while (pos < size)
+		{
+			if (h->n - decoded >= DGS_DECODE_RUN)
+				{
+					dgsDecode (buffer, h, decoded, h->n);
+					decoded = h->n;
+				}
+			if (resync && dgsPacketEnd (buffer, size, h, pos) < 0)
+				{
+					if (first_skip < 0)
+						first_skip = h->n;
+					pos = dgsResync (buffer, size, h, pos);
+					continue;
+				}
+			h->offset[h->n] = pos;
+			soe = dgsSoe (buffer, nw, h, pos / 4);
+			if (soe == PKT_DIG)
+				{
+					if (pos + DGS_DIG_HEADER_BYTES > size)
+						{
+							h->kind[h->n++] = PKT_DIG | PKT_SHORT;
+							break;
+						}
+					memcpy (&w1, buffer + pos + 4, sizeof (w1));
+					len = (__builtin_bswap32 (w1) >> 16) & 0x7FF;
+					next = pos + 4 + len * 4;
+					if (!resync && len >= 3 && next < size && dgsSoe (buffer, nw, h, next / 4) != PKT_DIG)
+						{
+							h->kind[h->n++] = PKT_DIG | PKT_NOSOE;
+							break;
+						}
+					h->kind[h->n++] = PKT_DIG;
+					if (len < 3)
+						break;
+					pos = next;
+				}
+			else if (soe == PKT_TRIG)
+				{
+					if (pos + DGS_TRIG_PACKET_BYTES > size)
+						{
+							h->kind[h->n++] = PKT_TRIG | PKT_SHORT;
+							break;
+						}
+					h->kind[h->n++] = PKT_TRIG;
+					pos += DGS_TRIG_PACKET_BYTES;
+				}
+			else
+				{
+					h->kind[h->n++] = PKT_BAD;
+					break;
+				}
+		}
+	dgsDecode (buffer, h, decoded, h->n);
+	if (first_skip >= 0)
+		h->recovered = h->n - first_skip - h->resyncs;
+}
+
+/* Whether the writer stops at packet k: the kinds dgsIndex ends on, and a
+ * digitizer length below the header or past the end of the buffer.
+ */
+static inline int32_t dgsPacketBad (const struct dgsHeaders *h, int32_t k, int32_t size)
+{
+	if (h->kind[k] == PKT_BAD || (h->kind[k] & (PKT_SHORT | PKT_NOSOE)))
+		return 1;
+	if (h->kind[k] & PKT_DIG)
+		return h->length[k] < 3 || (int64_t) h->offset[k] + 4 + 4 * (int64_t) h->length[k] > size;
+	return 0;
+}
+
+/*----------------------------------------------------------------------*/
+
+/* Word 1 of a reformatted trigger record. */
+static inline uint32_t dgsTrigWord1 (uint32_t board_id, uint32_t ch_id)
+{
+	return ch_id | (board_id << 4) | (DGS_TRIG_RECORD_LENGTH << 16);
+}
+
+/* Pack the 16 slot values of one trigger packet, already in host order, into
+ * a record in the digitizer layout:
+ *
+ *	0	0xAAAAAAAA
+ *	1	word1: length, board and channel (dgsTrigWord1)
+ *	2	timestamp 31:16 | timestamp 15:0		(slots 3, 4)
+ *	3	3 << 26 | header type 0xE | timestamp 47:32	(slot 2)
+ *	4	trigger type | wheel				(slots 1, 5)
+ *	5	multiplicity | user register			(slots 6, 7)
+ *	6	coarse timestamp | trigger bit mask		(slots 8, 9)
+ *	7	tdc offset 0 | tdc offset 1			(slots 10, 11)
+ *	8	tdc offset 2 | tdc offset 3			(slots 12, 13)
+ *	9	vernier AB | vernier CD				(slots 14, 15)
+ *	10, 11	0
+ *
+ * Only the low 16 bits of a slot are used.
+ */
+static inline void dgsTrigPack (const uint32_t *slot, uint32_t word1, uint32_t *rec)
+{
+	int32_t i;
+
+	rec[0] = 0xAAAAAAAA;
+	rec[1] = word1;
+	rec[2] = ((slot[3] & 0xFFFF) << 16) | (slot[4] & 0xFFFF);
+	rec[3] = (3 << 26) | (DGS_TRIG_HEADER_TYPE << 16) | (slot[2] & 0xFFFF);
+	rec[4] = ((slot[1] & 0xFFFF) << 16) | (slot[5] & 0xFFFF);
+	for (i = 5; i < 10; i++)
+		rec[i] = ((slot[2 * i - 4] & 0xFFFF) << 16) | (slot[2 * i - 3] & 0xFFFF);
+	rec[10] = rec[11] = 0;
+}
+
+/* The 48-bit timestamp of a record. */
+static inline uint64_t dgsTrigTimestamp (const uint32_t *rec)
+{
+	return ((uint64_t) (rec[3] & 0xFFFF) << 32) | rec[2];
+}
+
+static inline void dgsTrigRecordsScalar (const int8_t *src, int32_t n, uint32_t word1, uint32_t *rec)
+{
+	uint32_t slot[DGS_TRIG_SLOTS];
+	int32_t i, j;
+
+	for (i = 0; i < n; i++, src += DGS_TRIG_PACKET_BYTES, rec += DGS_TRIG_RECORD_WORDS)
+		{
+			memcpy (slot, src, sizeof (slot));
+			for (j = 1; j < DGS_TRIG_SLOTS; j++)
+				slot[j] = __builtin_bswap32 (slot[j]);
+			dgsTrigPack (slot, word1, rec);
+		}
+}
+
+#ifdef DGS_DECODE_X86
+
+/* One packet per step: the four 16-byte quarters are shuffled straight into
+ * record words 2..5 and 6..9, no per-word swap.  A slot value is bytes 2 and 3
+ * of its big-endian word.
+ */
+__attribute__ ((target ("ssse3")))
+static inline void dgsTrigRecordsSSSE3 (const int8_t *src, int32_t n, uint32_t word1, uint32_t *rec)
+{
+	const __m128i m0 = _mm_setr_epi8 (-1, -1, 15, 14, 11, 10, -1, -1, -1, -1, 7, 6, -1, -1, -1, -1);
+	const __m128i m1 = _mm_setr_epi8 (3, 2, -1, -1, -1, -1, -1, -1, 7, 6, -1, -1, 15, 14, 11, 10);
+	const __m128i m2 = _mm_setr_epi8 (7, 6, 3, 2, 15, 14, 11, 10, -1, -1, -1, -1, -1, -1, -1, -1);
+	const __m128i m3 = _mm_setr_epi8 (-1, -1, -1, -1, -1, -1, -1, -1, 7, 6, 3, 2, 15, 14, 11, 10);
+	const __m128i word3 = _mm_setr_epi32 (0, (3 << 26) | (DGS_TRIG_HEADER_TYPE << 16), 0, 0);
+	const __m128i head = _mm_setr_epi32 ((int32_t) 0xAAAAAAAA, (int32_t) word1, 0, 0);
+	__m128i v0, v1, v2, v3;
+	int32_t i;
+
+	for (i = 0; i < n; i++, src += DGS_TRIG_PACKET_BYTES, rec += DGS_TRIG_RECORD_WORDS)
+		{
+			v0 = _mm_loadu_si128 ((const __m128i *) src);
+			v1 = _mm_loadu_si128 ((const __m128i *) (src + 16));
+			v2 = _mm_loadu_si128 ((const __m128i *) (src + 32));
+			v3 = _mm_loadu_si128 ((const __m128i *) (src + 48));
+			_mm_storel_epi64 ((__m128i *) rec, head);
+			_mm_storeu_si128 ((__m128i *) (rec + 2), _mm_or_si128 (_mm_or_si128 (_mm_shuffle_epi8 (v0, m0), _mm_shuffle_epi8 (v1, m1)), word3));
+			_mm_storeu_si128 ((__m128i *) (rec + 6), _mm_or_si128 (_mm_shuffle_epi8 (v2, m2), _mm_shuffle_epi8 (v3, m3)));
+			_mm_storel_epi64 ((__m128i *) (rec + 10), _mm_setzero_si128 ());
+		}
+}
+
+#endif // DGS_DECODE_X86
+
+/* Reformat n consecutive trigger packets, as received, into records of
+ * DGS_TRIG_RECORD_WORDS words (see dgsTrigPack), with word1 in each.  The
+ * 48-bit timestamps go to ts, unless it is NULL.
+ */
+static inline void dgsTrigRecords (const int8_t *src, int32_t n, uint32_t word1, uint32_t *rec, uint64_t *ts)
+{
+	int32_t i;
+
+	#ifdef DGS_DECODE_X86
+		if (dgsDecodeLevel >= DGS_DECODE_SSSE3)
+			dgsTrigRecordsSSSE3 (src, n, word1, rec);
+		else
+	#endif
+			dgsTrigRecordsScalar (src, n, word1, rec);
+	if (ts)
+		for (i = 0; i < n; i++)
+			ts[i] = dgsTrigTimestamp (rec + i * DGS_TRIG_RECORD_WORDS);
+}
+
+#endif // _DGS_DECODE_H
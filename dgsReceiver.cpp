@@ -16,7 +16,66 @@
 //g++ dgsReceiver.cpp -O3 -o dgsReceiver -lstdc++ -pedantic -Wall -Wextra
 //gcc dgsReceiver.cpp -O3 -o dgsReceiver -lstdc++ -pedantic -Wall -Wextra
 
-#define VERSION "6.57"
+#define VERSION "6.81"
+//  V6.81: Chunk rotation without waiting on the disk: the next chunk's files are opened ahead by
+//         a chunk thread once the largest file is PREOPEN_PERCENT full, and at the switch the old
+//         files are handed to it to write out, fsync, close and make readonly.  Files opened
+//         ahead that get no data are removed.
+//  V6.80: Writeback pacing (-W n, with -o staged): every n MB of a file, writeback of it is
+//         started and the n MB before are waited for and dropped from the page cache, so dirty
+//         and cached data stay at about 2n MB per file and closing a chunk has little to flush.
+//  V6.79: O_DIRECT output (-o direct): staged blocks written past the page cache, each file
+//         preallocated with fallocate ahead of its data, up to <maxfilesize>; the tail block is
+//         padded, written and the file cut back to its length at close.
+//  V6.78: Asynchronous file writes (-q n, with -o staged): full blocks go to a queue per file,
+//         drained by n IO threads, at most -Q MB queued.  Queue depth and write latency per file
+//         are printed with the statistics.
+//  V6.77: Staged file writes (-o staged, the default): each file has a 4 kB-aligned block that
+//         takes the header and payload of a packet together and goes out with one writev once
+//         full, so there is no stdio call or lock per packet.  -o stdio and -o posix (-p) remain.
+//  V6.76: The per-file state is one struct per slot, handed out densely as the files are first
+//         opened, so the per-buffer and close/readonly loops only visit the files in use.
+//         set_readonly uses the names the files were opened with: channel files A-F and the
+//         trigger files are now made readonly too.
+//  V6.75: Trigger packets are reformatted a run at a time with SSSE3 shuffles (dgsTrigRecords in
+//         dgsDecode.h, shared with tcp_Receiver).  Record words 10 and 11 are now written as 0.
+//  V6.74: Resync (-R): a corrupt or misaligned packet no longer costs the rest of its buffer.
+//         The bytes up to the next sound packet are set aside and counted, and parsing goes on.
+//  V6.73: The output mode is picked at run time (-D, -F, -f, -n, -1, -p) instead of at build
+//         time; writeShard is built once per mode and the right one is chosen at start-up.
+//  V6.72: Parallel writing (-j n): the indexed buffer is written by n threads, each owning the
+//         files of the boards in its shard (board % n), so no file is shared between threads.
+//  V6.71: writeEvents2 parses in two passes: the buffer is scanned for SOE words with vector
+//         compares and indexed (packet boundaries checked against the SOE map), then the
+//         index is written out.
+//  V6.70: Packet headers are indexed and decoded a batch at a time in writeEvents2, with SSSE3
+//         or AVX2 byte swaps and field masks picked at run time (dgsDecode.h).
+//  V6.69: Sockets stamp received data (SO_TIMESTAMPNS).  Every buffer is timed from the kernel
+//         receive to the receive thread, the writer and the end of writeEvents2, and the
+//         histograms are summarized every interval and dumped at the end of the run.
+//  V6.68: Credit-based streaming (-S): the IOC is granted -w buffers of credit and streams
+//         sequence-numbered summaries, instead of answering one request per buffer.
+//  V6.67: Reconnect policy set with -r min:max.  A lost connection is retried at once, then with
+//         backoff up to max, which bounds how long after an IOC comes back it is picked up again.
+//         Connects, disconnects, read errors, lost replies and down time are reported per IOC.
+//  V6.66: Low-latency profile (-L): receive thread pinned to a core and spinning instead of
+//         sleeping, busy-polled sockets, TCP_NODELAY and TCP_QUICKACK.  -P runs it SCHED_FIFO.
+//         The request to SERVER_SUMMARY round trip is measured and reported.
+//  V6.65: Socket receive buffers are sized from the recLen the IOC sends (or fixed with -b),
+//         instead of a fixed 64 kB.  Read calls and drain time per reply are reported.
+//  V6.64: SINGLE_FILE builds again.  FILE_PER_BOARD switch, so every file mode can be built
+//         from the command line (see the benchmark target in the Makefile).
+//  V6.63: IOCs may be given as host:port, so several mockIOC servers can run on one host.
+//  V6.62: Receive thread sleeps in epoll_wait/io_uring until data or a connection deadline
+//         is due, instead of the usleep backoff.  Connects time out and retry with backoff.
+//  V6.61: Optional io_uring engine (-u): socket receives into registered ring buffers, and
+//         file buffer flushes batched as linked writes.  Falls back to epoll/stdio.
+//  V6.60: The number of outstanding requests per IOC is set with -w, and with -a it adapts
+//         to the reply mix.  Window and reply type counts are shown in the summary.
+//  V6.59: Network receive and disk writes run on separate threads, decoupled by a ring of
+//         receive buffers sized from each SERVER_SUMMARY recLen.
+//  V6.58: A comma-separated list of IOCs may be given as <server>.  All connections are then
+//         served non-blocking from one epoll loop in a single process, sharing the file tables.
 //  V6.57: Added option (DEBUG_OUTPUT_FILE) that will generate an ASCII debug file for received trigger data.
 //         Also renamed the output files for triggers to help identify them in the data set more easily.
 //  V6.56: Untested version for receiving and storing trigger data to file.
@@ -36,6 +95,11 @@
 
 //============= START OF BUILD CONFIGURATION SWITCHES ==================//
 
+/* The output mode switches below (WRITEGTFORMAT, SINGLESHOT, FULL_FILE_MODE, NO_SAVE...,
+ * USE_POSIX_FILE_LIB, FILE_PER_BOARD, SINGLE_FILE, FILTER_TYPE_F) now only set the defaults
+ * of the matching command line options; see the usage text.
+*/
+
 /* WRITEGTFORMAT:   When defined writes data in GEB format.  When defined,
  * 					this will replace the SOE word with the Geb header.
  * 					When not defined the program will take one less argument
@@ -76,13 +140,18 @@
 //#define  NO_SAVE_BUT_STILL_PROCESS   // MBO 20200722: Receive and process the data, but don't save to disk.
 //#define USE_POSIX_FILE_LIB // MBO 20200616: When defined file IO used POSIX non-blocking library calls,
 							// MBO 20200617: When not defined, data write will use the ANSI C file IO (also non-blocking...)
+//#define FILE_PER_BOARD	// When defined, will write one file per digitizer instead of one per channel.
+#ifndef FILE_PER_BOARD
 #define FILE_PER_CHANNEL	// MBO 20200616: When defined, will write one file per channel
+#endif
 //#define SINGLE_FILE		// MBO 20200624: Overrides FILE_PER_CHANNEL, saves one file per IOC.  auto shut down does not work properly in this mode yet.
 							// MBO 20200626: When neither FILE_PER_CHANNEL nor SINGLE_FILE is defined, will save one file per Digitizer
 #define FOLDER_PER_RUN      // MBO 20220721: When defined, will create a separate subdirectory for each run.
 //#define FILTER_TYPE_F		// MBO 20200626: When defined, will remove all type F headers from output.
 #define DUMP_UNKNOWN_DATA_TO_DISK// MBO 20220801:  Write all unknown data to a diagnostic output file.  (Write trigger data hack enable switch.)
 #define DEBUG_OUTPUT_FILE
+//#define NO_SIMD_DECODE	// When defined, packet headers are decoded with the scalar code only, instead of
+							// the SSSE3/AVX2 code picked at run time.
 
 //============= END OF BUILD CONFIGURATION SWITCHES ==================//
 
@@ -92,9 +161,49 @@
 // BUILD PARAMETERS:
 // SUMMARY_OUTPUT_INTERVAL: The delay between summary update.
 #define SUMMARY_OUTPUT_INTERVAL 5
-// MAXNS: Controls the minimum frequently receiver checks for data during low,
-//  or no event rate.
-#define MAXNS 10000			// MBO 20200615: changed from 100000 to 10000
+// CONNECT_RETRY_MIN_MS, CONNECT_RETRY_MAX_MS: Delay before reconnecting to an IOC
+//  (defaults for -r).  It doubles after each failed attempt and goes back to the
+//  minimum once connected.  The maximum is the longest an IOC that came back can
+//  go unnoticed; a refused connect is cheap, so it is kept short.
+#define CONNECT_RETRY_MIN_MS 10
+#define CONNECT_RETRY_MAX_MS 250
+// CONNECT_TIMEOUT_MS: Give up on a connect() that has not finished by then.
+#define CONNECT_TIMEOUT_MS 3000
+// IDLE_WAIT_MS: Longest the receive thread sleeps when nothing at all is happening.
+#define IDLE_WAIT_MS 1000
+// IDLE_REQUEST_MIN_MS, IDLE_REQUEST_MAX_MS: After INSUFF_DATA, new requests are held
+//  back this long.  The delay doubles while the IOC has no data, and is dropped as
+//  soon as data comes back.  The maximum bounds the latency after an idle period.
+#define IDLE_REQUEST_MIN_MS 1
+#define IDLE_REQUEST_MAX_MS 10
+// MAXIOC: The maximum number of IOC connections served by one receiver process.
+#define MAXIOC 32
+// RCVBUF_MIN: Smallest socket receive buffer (the old fixed size).
+#define RCVBUF_MIN 65536
+// RCVBUF_INITIAL: Receive buffer for an IOC until its recLen has been seen.
+#define RCVBUF_INITIAL 1048576
+// RCVBUF_MAX: Largest receive buffer the auto-tuning asks for.
+#define RCVBUF_MAX 67108864
+// RCVBUF_REPLIES: The buffer holds this many replies of the 99th percentile recLen,
+//  so the next reply can arrive in full while one is being read out.
+#define RCVBUF_REPLIES 2
+// RCVBUF_HISTORY: The recLen histogram is halved once it holds this many replies,
+//  so the tuning follows the recent traffic.
+#define RCVBUF_HISTORY 4096
+// RCVBUF_RETUNE: Replies between looks at the recLen histogram.
+#define RCVBUF_RETUNE 16
+// BUSY_POLL_US: SO_BUSY_POLL time for the sockets in the low-latency profile (-L).
+#define BUSY_POLL_US 50
+// WRITE_THREADS_MAX: Most writer threads (-j).
+#define WRITE_THREADS_MAX 32
+// IO_THREADS_MAX: Most IO threads (-q).
+#define IO_THREADS_MAX 64
+// IO_QUEUE_MB: Default bound on the blocks queued for the IO threads (-Q), in MB.
+#define IO_QUEUE_MB 256
+// PREALLOC_MB: -o direct: how far ahead of its data a file is preallocated, in MB.
+#define PREALLOC_MB 64
+// PREOPEN_PERCENT: The next chunk's files are opened ahead once the largest file is this full.
+#define PREOPEN_PERCENT 75
 
 
 // OTHER PARAMETERS THAT ARE EXPECTED TO RARLEY IF EVER CHANGE:
@@ -123,7 +232,7 @@
 // TRIG_MIN_HEADER_LENGTH_BYTES: The smallest trigger header than can be processed, in
 //	terms of bytes.
 #define TRIG_MIN_HEADER_LENGTH_BYTES TRIG_MIN_HEADER_LENGTH_UINT32 * 4
-#define REFORMATTED_HEADER_LENGTH_UINT32 12
+#define REFORMATTED_HEADER_LENGTH_UINT32 12		// DGS_TRIG_RECORD_WORDS
 #define REFORMATTED_HEADER_LENGTH_BYTES REFORMATTED_HEADER_LENGTH_UINT32 * 4
 
 #define DIG_BOARD_ID_MASK 0xFFF
@@ -140,9 +249,13 @@
 #include <string.h>
 #include <time.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 
 #include <signal.h>
+#include <pthread.h>
+#include <sched.h>
 #include "dgsReceiver.h"
+#include "dgsDecode.h"
 
 #ifdef __WIN32__
 	#define INET_ADDRSTRLEN 16
@@ -154,8 +267,11 @@
 	#include <sys/socket.h>
 	#include <sys/times.h>
 	#include <netinet/in.h>
+	#include <netinet/tcp.h>
 	#include <arpa/inet.h>
 	#include <netdb.h>
+	#include <sys/epoll.h>
+	#include "uring.h"
 
     #define CLK_TCK ((__clock_t) __sysconf (2))
 #endif
@@ -193,41 +309,138 @@ Provided here for reference only.  This is provided by the user.
 #define MAX_GEB_TYPE           24
 */
 
-#ifndef USE_POSIX_FILE_LIB
-    #define FILE_BUF_SIZE_KB 512
-    #define FILE_BUF_SIZE FILE_BUF_SIZE_KB*1024+8
-    #ifdef SINGLE_FILE
-        static char* file_buffer;
-    #else // not SINGLE_FILE
-        static uint32_t min_board_id;
-        static uint32_t max_board_id;
-        #ifdef FILE_PER_CHANNEL
-            #if defined(SINGLESHOT) && defined(FULL_FILE_MODE)
-                static uint16_t write_inhibit[MAXBOARDID][MAXCHID];
-            #endif	//defined
-            static char* file_buffer[MAXBOARDID][MAXCHID];
-        #else // not FILE_PER_CHANNEL
-            #if defined(SINGLESHOT) && defined(FULL_FILE_MODE)
-                static uint16_t write_inhibit[MAXBOARDID];
-            #endif //defined
-            static char* file_buffer[MAXBOARDID];
-        #endif // not FILE_PER_CHANNEL
-    #endif // not SINGLE_FILE
-#endif // not USE_POSIX_FILE_LIB
+#define FILE_BUF_SIZE_KB 512
+#define FILE_BUF_SIZE FILE_BUF_SIZE_KB*1024+8
+#define FILE_STAGE_SIZE (FILE_BUF_SIZE_KB*1024)		// -o staged: block a file is written in
+#define FILE_STAGE_ALIGN 4096
+
+/* Output mode, chosen at run time (-D, -F, -f, -n, -1, -o).  The output
+ * switches above only give the defaults.  writeEvents2 runs the writeShard
+ * instantiation of the mode, so the packet loop does not test it.
+ */
+#define FILES_PER_CHANNEL	0
+#define FILES_PER_BOARD		1
+#define FILES_SINGLE		2
+
+#define SAVE_FILES			0
+#define SAVE_PROCESS_ONLY	1		// NO_SAVE_BUT_STILL_PROCESS
+#define SAVE_NOTHING		2		// NO_SAVE
+
+#define SHOT_OFF			0		// a new chunk when a file is full
+#define SHOT_FIRST			1		// SINGLESHOT: stop when the first file is full
+#define SHOT_ALL			2		// SINGLESHOT and FULL_FILE_MODE: stop when all are full
+
+#define FILE_IO_STDIO		0		// fwrite through a FILE_BUF_SIZE stdio buffer
+#define FILE_IO_POSIX		1		// USE_POSIX_FILE_LIB: a write() per header and payload
+#define FILE_IO_STAGED		2		// a FILE_STAGE_SIZE block per file, written with writev
+
+#ifdef WRITEGTFORMAT
+	#define DEFAULT_GT_FORMAT 1
+#else
+	#define DEFAULT_GT_FORMAT 0
+#endif
+#if defined(SINGLE_FILE)
+	#define DEFAULT_FILE_LAYOUT FILES_SINGLE
+#elif defined(FILE_PER_CHANNEL)
+	#define DEFAULT_FILE_LAYOUT FILES_PER_CHANNEL
+#else
+	#define DEFAULT_FILE_LAYOUT FILES_PER_BOARD
+#endif
+#ifdef FILTER_TYPE_F
+	#define DEFAULT_FILTER_TYPE_F 1
+#else
+	#define DEFAULT_FILTER_TYPE_F 0
+#endif
+#if defined(NO_SAVE)
+	#define DEFAULT_SAVE_MODE SAVE_NOTHING
+#elif defined(NO_SAVE_BUT_STILL_PROCESS)
+	#define DEFAULT_SAVE_MODE SAVE_PROCESS_ONLY
+#else
+	#define DEFAULT_SAVE_MODE SAVE_FILES
+#endif
+#if defined(SINGLESHOT) && defined(FULL_FILE_MODE)
+	#define DEFAULT_SINGLESHOT SHOT_ALL
+#elif defined(SINGLESHOT)
+	#define DEFAULT_SINGLESHOT SHOT_FIRST
+#else
+	#define DEFAULT_SINGLESHOT SHOT_OFF
+#endif
+#ifdef USE_POSIX_FILE_LIB
+	#define DEFAULT_FILE_IO FILE_IO_POSIX
+#else
+	#define DEFAULT_FILE_IO FILE_IO_STAGED
+#endif
+
+/* The files of a chunk are kept by slot: [board][channel] with a file per
+ * channel, [board][0] with a file per board and [0][0] for a single file.
+ * slot_map gives the number of the slot's state, 0 until the slot first
+ * gets a packet; the states are handed out in that order and kept for the
+ * run, so the loops over the files only visit slots[1..nslots].
+ */
+struct ioBlock
+{
+	int8_t *data;									 /* FILE_STAGE_SIZE, aligned */
+	int32_t len;
+	int64_t queued;									 /* -q: nowNs when queued */
+	int32_t fd;										 /* -q: the file and offset it goes to */
+	int64_t off;
+	struct ioBlock *next;
+};
+
+/* The files of a slot in one chunk, when they are not the slot's open
+ * ones: opened ahead for the next chunk, or left to the chunk thread.
+ */
+struct chunkFile
+{
+	FILE *ofile;
+	int32_t ofd;
+	char *name;
+	char *file_buffer;
+	int64_t prealloc;
+#ifdef DEBUG_OUTPUT_FILE
+	FILE *diag_ofile;
+	char *diag_name;
+	char *diag_file_buffer;
+#endif // DEBUG_OUTPUT_FILE
+};
 
+struct slotState
+{
+	FILE *ofile;									 /* stdio */
+	int32_t ofd;									 /* posix and staged */
+	struct ioBlock *stage;							 /* staged: the block being filled */
+	int32_t staged;									 /* bytes in it */
+	int64_t fbytes;									 /* staged: bytes in the blocks before it */
+	int64_t prealloc;								 /* -o direct: fallocate reaches here */
+	int64_t pwindows, pns;							 /* -W: windows paced, ns waited, for the run; io_lock with -q */
+	int32_t inhibit;								 /* -1 all: 0 open, 1 full, 2 never opened */
+	int64_t bytes;									 /* written to the file in this chunk */
+	uint16_t board, ch;
+	char *name;										 /* of the open file, made readonly at close */
+	char *file_buffer;
 #ifdef DEBUG_OUTPUT_FILE
-    #ifndef USE_POSIX_FILE_LIB
-        #ifdef SINGLE_FILE
-            static char* diag_file_buffer;
-        #else // not SINGLE_FILE
-            #ifdef FILE_PER_CHANNEL
-                static char* diag_file_buffer[MAXBOARDID][MAXCHID];
-            #else // not FILE_PER_CHANNEL
-                static char* diag_file_buffer[MAXBOARDID];
-            #endif // not FILE_PER_CHANNEL
-        #endif // not SINGLE_FILE
-    #endif // not USE_POSIX_FILE_LIB
+	FILE *diag_ofile;
+	char *diag_name;
+	char *diag_file_buffer;
 #endif // DEBUG_OUTPUT_FILE
+	int8_t trig;									 /* trigger data: the files are named _trig */
+	int8_t preopen;									 /* open the next chunk's files ahead; chunk_lock */
+	int8_t preopened;								 /* the open files were, and may stay unused */
+	struct chunkFile next;							 /* the next chunk's files, opened ahead; chunk_lock */
+	/* -q: full blocks waiting for the IO threads, under io_lock */
+	struct ioBlock *qhead, *qtail;
+	struct slotState *qnext;						 /* on io_ready */
+	int8_t qbusy;									 /* on io_ready or being written */
+	int8_t qerror;									 /* a queued block failed to write */
+	int32_t qdepth, qpeak;
+	int64_t qwrites, qns, qmaxns;					 /* interval: writes, queued to written */
+	int64_t qseq, qdone;							 /* run: blocks queued, blocks written */
+};
+
+static struct slotState slots[MAXBOARDID * MAXCHID + 1];
+static uint16_t slot_map[MAXBOARDID][MAXCHID];
+static int32_t nslots;								 /* slots[1..nslots] in use */
+static pthread_mutex_t slot_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static int64_t max_file_size;
 
@@ -245,12 +458,57 @@ int32_t fp;
 char fn[512];
 int64_t totbytes = 0;
 int8_t has_connected = 0;
+int8_t use_uring = 0;									 /* -u: io_uring receive and write engine */
+int32_t rcvbuf_fixed = 0;								 /* -b: SO_RCVBUF in bytes, 0 = auto-tuned */
+int8_t low_latency = 0;									 /* -L: spin, busy-poll and quick-ack */
+int32_t rcv_cpu = -1;									 /* -L: core the receive thread is pinned to */
+int32_t rcv_priority = 0;								 /* -P: SCHED_FIFO priority of the receive thread */
+int8_t use_credit = 0;									 /* -S: credit-based streaming protocol */
+int32_t retry_min_ms = CONNECT_RETRY_MIN_MS;			 /* -r: reconnect backoff */
+int32_t retry_max_ms = CONNECT_RETRY_MAX_MS;
+int32_t nwriters = 1;									 /* -j: writer threads, files sharded by board */
+int32_t io_threads = 0;									 /* -q: IO threads, 0 = written in line */
+int32_t io_limit = IO_QUEUE_MB;							 /* -Q: MB queued for them, then blocks */
+int8_t gt_format = DEFAULT_GT_FORMAT;					 /* -D: GEB headers, or raw packets */
+int8_t file_layout = DEFAULT_FILE_LAYOUT;				 /* -F: file per channel, board or IOC */
+int8_t filter_type_f = DEFAULT_FILTER_TYPE_F;			 /* -f: drop type F headers */
+int8_t save_mode = DEFAULT_SAVE_MODE;					 /* -n: write, only process, or only receive */
+int8_t singleshot = DEFAULT_SINGLESHOT;					 /* -1: stop once the files are full */
+int8_t file_io = DEFAULT_FILE_IO;						 /* -o: staged, stdio or posix writes */
+int8_t direct_io = 0;									 /* -o direct: staged, with O_DIRECT */
+int64_t pace_bytes = 0;									 /* -W: writeback window, 0 = off */
+int8_t resync = 0;										 /* -R: skip corrupt data, not the rest of the buffer */
 
 int32_t debug = 1;
 
-#ifdef WRITEGTFORMAT
-	int32_t GEB_TYPE_DGS = 0;
-#endif	//WRITEGTFORMAT
+int32_t GEB_TYPE_DGS = 0;
+
+/* How whole SERVER_SUMMARY replies came off the socket. */
+struct drainStats
+{
+	int32_t replies;
+	int64_t reads;									 /* read calls, header included */
+	int64_t bytes;
+	int32_t readsmax;								 /* most read calls for one reply */
+	int64_t drainns;								 /* first header byte to last payload byte */
+	int64_t drainmax;
+	int8_t reset;									 /* set by the reader, cleared by the receive thread */
+};
+
+/* Latency histogram: 8 bins per power of two, so percentiles are good to 12%. */
+#define LAT_SUB_BITS 3
+#define LAT_BINS (64 << LAT_SUB_BITS)
+
+struct latHist
+{
+	int32_t count[LAT_BINS];
+	int32_t n;
+	int64_t max;									 /* ns */
+	int8_t reset;									 /* set by the reader, cleared by the receive thread */
+};
+
+// RTT_SLOTS: Send times kept per IOC, a power of two of at least MAX_REQUEST_WINDOW.
+#define RTT_SLOTS 64
 
 struct rcvrInstance
 {
@@ -260,107 +518,324 @@ struct rcvrInstance
 	int32_t recSock;
 	int32_t packetsreceived;
 	int32_t packetssent;
-	int32_t seqerrs;
+	int32_t seqerrs;								 /* SERVER_STREAM_SUMMARY out of sequence */
+	uint32_t nextseq;								 /* sequence number expected next */
 	int32_t bytesrec;
+	char host[64];									 /* IOC name, for messages */
+	int8_t state;									 /* RCVR_DISCONNECTED, RCVR_CONNECTING or RCVR_CONNECTED */
+	int64_t deadline;								 /* ms: next connect attempt, connect timeout, or held requests due */
+	int32_t retrydelay;								 /* ms to wait after the next failed connect */
+	int8_t held;									 /* requests held back after INSUFF_DATA */
+	int32_t idledelay;								 /* ms to hold requests after the next INSUFF_DATA */
+	int32_t hdrbytes;								 /* bytes of the reply header received so far */
+	evtServerRetStruct firstreply;					 /* reply header being assembled */
+	int32_t recsize;								 /* payload bytes announced by SERVER_SUMMARY */
+	int32_t bytesret;								 /* payload bytes received so far */
+	int32_t window;									 /* requests kept outstanding with the IOC */
+	int32_t outstanding;							 /* requests sent and not yet answered */
+	int32_t maxrecsize;								 /* largest recsize seen on this connection */
+	int32_t nsummary;								 /* SERVER_SUMMARY replies */
+	int32_t nfull;									 /* SERVER_SUMMARY replies at or near maxrecsize */
+	int32_t ninsuff;								 /* INSUFF_DATA replies */
+	int32_t nsenderoff;								 /* SERVER_SENDER_OFF replies */
+	int32_t adaptreplies, adaptfull, adaptinsuff;	 /* counts since the window last changed */
+	struct rcvBuffer *slot;							 /* ring buffer the payload is read into */
+	int32_t rcvbuf;									 /* SO_RCVBUF asked for, kept across reconnects */
+	int32_t rcvbufset;								 /* SO_RCVBUF the kernel reports having */
+	int32_t reclenhist[32];							 /* recent SERVER_SUMMARY recLen, by power of two */
+	int32_t reclencount;
+	int32_t replyreads;								 /* read calls for the reply in progress */
+	int64_t replystart;								 /* ns: first read of the reply in progress */
+	int64_t tkernel;								 /* ns, realtime: kernel stamp of the data last read */
+	struct drainStats total, interval;
+	int64_t reqsent[RTT_SLOTS];						 /* ns: send time of each outstanding request */
+	uint32_t reqhead;								 /* oldest outstanding request in reqsent */
+	struct latHist rtt, rttinterval;				 /* request sent to SERVER_SUMMARY arriving */
+	int32_t nattempts;								 /* connect attempts */
+	int32_t nconnects;								 /* connections made */
+	int32_t ndisconnects;							 /* connections lost */
+	int32_t nreaderrors;							 /* reads that failed or hit end of file */
+	int32_t requestslost;							 /* requests unanswered when a connection was lost */
+	int64_t byteslost;								 /* payload of replies cut off by a lost connection */
+	int64_t downsince;								 /* ms: when the connection was lost, 0 if never */
+	int64_t downms;									 /* time spent reconnecting after losing a connection */
+	int32_t index;									 /* in rcvr[] */
+	uint32_t urgen;									 /* -u: connection number, carried in user_data */
+	int8_t urbusy;									 /* -u: an operation in flight */
+	int8_t urclosing;								 /* -u: stopped with it in flight, finish on completion */
 };
 
+#define RCVR_DISCONNECTED 0
+#define RCVR_CONNECTING 1
+#define RCVR_CONNECTED 2
+
+// All IOC connections served by this process, and the epoll set they live in.
+struct rcvrInstance *rcvr[MAXIOC];
+int32_t nrcvr = 0;
+int32_t rcvr_epfd = -1;
+
+/* Monotonic nanoseconds, for the receive timing. */
+int64_t nowNs (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Realtime nanoseconds, the clock the kernel stamps received data with. */
+int64_t nowRealNs (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_REALTIME, &ts);
+	return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* Monotonic milliseconds, for the connection deadlines. */
+int64_t nowMs (void)
+{
+	return nowNs () / 1000000;
+}
+
+void latAdd (struct latHist *h, int64_t ns)
+{
+	int32_t e;
+
+	if (h->reset)
+		memset (h, 0, sizeof (*h));
+	if (ns < 0)
+		ns = 0;
+	if (ns < (1 << LAT_SUB_BITS))
+		h->count[ns]++;
+	else
+		{
+			e = 63 - __builtin_clzll (ns);
+			h->count[((e - LAT_SUB_BITS + 1) << LAT_SUB_BITS) + ((ns >> (e - LAT_SUB_BITS)) & ((1 << LAT_SUB_BITS) - 1))]++;
+		}
+	h->n++;
+	if (h->max < ns)
+		h->max = ns;
+}
+
+/* Lower edge of bin i, in ns. */
+int64_t latBinStart (int32_t i)
+{
+	int32_t e;
+
+	if (i < (1 << LAT_SUB_BITS))
+		return i;
+	e = (i >> LAT_SUB_BITS) + LAT_SUB_BITS - 1;
+	return (int64_t) ((1 << LAT_SUB_BITS) + (i & ((1 << LAT_SUB_BITS) - 1))) << (e - LAT_SUB_BITS);
+}
+
+/* Lower edge of the bin holding the given fraction (per mille) of the entries, in ns. */
+int64_t latPercentile (struct latHist *h, int32_t permille)
+{
+	int64_t sum = 0;
+	int32_t i;
+
+	for (i = 0; i < LAT_BINS - 1; i++)
+		{
+			sum += h->count[i];
+			if (sum * 1000 >= (int64_t) h->n * permille)
+				break;
+		}
+	return latBinStart (i);
+}
+
+void printLat (const char *label, struct latHist *h)
+{
+	if (h->n == 0)
+		return;
+	printf ("%s: %i, p50 %.3f ms, p99 %.3f ms, max %.3f ms\n", label, h->n,
+			latPercentile (h, 500) / 1e6, latPercentile (h, 990) / 1e6, h->max / 1e6);
+}
 
 
-//get 10M of mem
-// for DGS we just store to a great big chunk then write to disk
+// DATA_MEM_SIZE: The largest payload a single SERVER_SUMMARY may announce.
+// Ring buffers are grown to the recsize actually seen, up to this limit.
 #define DATA_MEM_SIZE 10000000
-int8_t datamem[DATA_MEM_SIZE];
+
+/*----------------------------------------------------------------------*/
+
+// RCV_RING_SLOTS: Receive buffers the network thread may fill ahead of the writer.
+// One more slot per IOC is added so every connection can hold a partly received
+// buffer without starving the others.
+#define RCV_RING_SLOTS 8
+
+struct rcvBuffer
+{
+	int8_t *data;
+	int32_t size;									 /* bytes allocated */
+	int32_t len;									 /* bytes received */
+	struct rcvrInstance *from;
+	int32_t registered;								 /* size registered as an io_uring fixed buffer */
+	int64_t tkernel;								 /* ns, realtime: kernel receive of the last segment, 0 if not stamped */
+	int64_t treceived;								 /* ns, realtime: complete and queued for the writer */
+};
+
+// The ring is a pool of buffers moving between a free queue and a filled
+// queue. The receive thread takes free buffers and queues them filled; the
+// writer takes filled buffers and gives them back. Both queues are bounded by
+// the pool size, so a slow writer stalls the receive thread, and TCP flow
+// control then pushes back on the IOC.
+struct rcvRing
+{
+	struct rcvBuffer *slot;
+	struct rcvBuffer **freeq;
+	struct rcvBuffer **fullq;
+	int32_t nslots;
+	int32_t freehead, freecount;
+	int32_t fullhead, fullcount;
+	pthread_mutex_t lock;
+	pthread_cond_t hasfree;
+	pthread_cond_t hasfull;
+	int32_t inuse;									 /* buffers filled or being written */
+	int32_t maxinuse;								 /* high-water mark of inuse */
+	int64_t stalls;									 /* times the receive thread waited for a buffer */
+	int64_t buffers;								 /* buffers handed to the writer */
+};
+
+struct rcvRing ring;
+
+void rcvRingInit (int32_t nslots)
+{
+	int32_t i;
+
+	memset (&ring, 0, sizeof (ring));
+	ring.nslots = nslots;
+	ring.slot = (struct rcvBuffer *) calloc (nslots, sizeof (struct rcvBuffer));
+	ring.freeq = (struct rcvBuffer **) calloc (nslots, sizeof (struct rcvBuffer *));
+	ring.fullq = (struct rcvBuffer **) calloc (nslots, sizeof (struct rcvBuffer *));
+	for (i = 0; i < nslots; i++)
+		ring.freeq[i] = &ring.slot[i];
+	ring.freecount = nslots;
+	pthread_mutex_init (&ring.lock, NULL);
+	pthread_cond_init (&ring.hasfree, NULL);
+	pthread_cond_init (&ring.hasfull, NULL);
+}
+
+/* Take a free buffer of at least size bytes, waiting for the writer if
+ * all of them are in use.
+ */
+struct rcvBuffer *rcvRingGetFree (int32_t size)
+{
+	struct rcvBuffer *buf;
+
+	pthread_mutex_lock (&ring.lock);
+	if (ring.freecount == 0)
+		ring.stalls++;
+	while (ring.freecount == 0)
+		pthread_cond_wait (&ring.hasfree, &ring.lock);
+	buf = ring.freeq[ring.freehead];
+	ring.freehead = (ring.freehead + 1) % ring.nslots;
+	ring.freecount--;
+	pthread_mutex_unlock (&ring.lock);
+
+	if (buf->size < size)
+		{
+			free (buf->data);
+			buf->data = (int8_t *) malloc (size);
+			buf->size = size;
+		}
+	buf->len = 0;
+	return buf;
+}
+
+/* Return a buffer to the free queue, either written out or abandoned. */
+void rcvRingRelease (struct rcvBuffer *buf, int32_t written)
+{
+	pthread_mutex_lock (&ring.lock);
+	ring.freeq[(ring.freehead + ring.freecount) % ring.nslots] = buf;
+	ring.freecount++;
+	if (written)
+		ring.inuse--;
+	pthread_cond_signal (&ring.hasfree);
+	pthread_mutex_unlock (&ring.lock);
+}
+
+void rcvRingPutFull (struct rcvBuffer *buf)
+{
+	pthread_mutex_lock (&ring.lock);
+	ring.fullq[(ring.fullhead + ring.fullcount) % ring.nslots] = buf;
+	ring.fullcount++;
+	ring.inuse++;
+	if (ring.maxinuse < ring.inuse)
+		ring.maxinuse = ring.inuse;
+	ring.buffers++;
+	pthread_cond_signal (&ring.hasfull);
+	pthread_mutex_unlock (&ring.lock);
+}
+
+/* Take the next filled buffer, or NULL if none arrived within timeout seconds. */
+struct rcvBuffer *rcvRingGetFull (int32_t timeout)
+{
+	struct rcvBuffer *buf = NULL;
+	struct timespec deadline;
+
+	clock_gettime (CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout;
+
+	pthread_mutex_lock (&ring.lock);
+	while (ring.fullcount == 0)
+		if (pthread_cond_timedwait (&ring.hasfull, &ring.lock, &deadline) == ETIMEDOUT)
+			break;
+	if (ring.fullcount > 0)
+		{
+			buf = ring.fullq[ring.fullhead];
+			ring.fullhead = (ring.fullhead + 1) % ring.nslots;
+			ring.fullcount--;
+		}
+	pthread_mutex_unlock (&ring.lock);
+	return buf;
+}
 
 
 //deprecated for DGS
 int32_t recLenGDig;
 
 
-#ifdef SINGLE_FILE
-	int64_t bytes_written_to_file;
-#else
-	#ifdef FILE_PER_CHANNEL	// MBO 20200616:
-		int64_t bytes_written_to_file[MAXBOARDID][MAXCHID]; // MBO 20200619:  changed to array
-	#else
-		int64_t bytes_written_to_file[MAXBOARDID]; // MBO 20200619:  changed to array
-	#endif
-#endif
-
-#ifndef SINGLESHOT
 int64_t totbytesInLargestFile; // MBO 20200619:  new
-#endif // SINGLESHOT
 #ifdef DUMP_UNKNOWN_DATA_TO_DISK
-    #ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
-        int32_t diag_ofile;
-    #else
-        FILE* diag_unknown_ofile;
-    #endif
+	FILE* diag_unknown_ofile;
 #endif //DUMP_UNKNOWN_DATA_TO_DISK
 
-#ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
-	#define FILE_OPEN_CHECK(file) (file > 0)
-	#ifdef SINGLE_FILE
-			int32_t ofile;
-	#else
-		#ifdef FILE_PER_CHANNEL	// MBO 20200616:
-			int32_t ofile[MAXBOARDID][MAXCHID];
-		#else
-			int32_t ofile[MAXBOARDID];
-		#endif
-	#endif
-#else
-	#define FILE_OPEN_CHECK(file) (file != 0)
-	#ifdef SINGLE_FILE
-			FILE* ofile;
-	#else
-		#ifdef FILE_PER_CHANNEL	// MBO 20200616:
-			FILE* ofile[MAXBOARDID][MAXCHID];	// MBO 20200617:  Normal mode writes changed from POSIX to  ANSI C file iO
-		#else
-			FILE* ofile[MAXBOARDID];			// MBO 20200617:  Normal mode writes changed from POSIX to  ANSI C file iO
-		#endif
-	#endif
-#endif
+int32_t chunck = 0;
+char *runname;
+char *extprefix;
 
-#ifdef DEBUG_OUTPUT_FILE
-    #ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
-        #define FILE_OPEN_CHECK(file) (file > 0)
-        #ifdef SINGLE_FILE
-                int32_t diag_ofile;
-        #else
-            #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                int32_t diag_ofile[MAXBOARDID][MAXCHID];
-            #else
-                int32_t diag_ofile[MAXBOARDID];
-            #endif
-        #endif
+/* file name of a chunk, without the board/channel suffix */
+void chunk_file_name (char *name, int32_t chunk)
+{
+	#ifdef FOLDER_PER_RUN
+		#ifdef __WIN32__
+			sprintf (name, "%s\\%s.%s_%3.3i", runname, runname, extprefix, chunk);
+		#else
+			sprintf (name, "%s/%s.%s_%3.3i", runname, runname, extprefix, chunk);
+		#endif // __WIN32__
     #else
-        #define FILE_OPEN_CHECK(file) (file != 0)
-        #ifdef SINGLE_FILE
-                FILE* diag_ofile;
-        #else
-            #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                FILE* diag_ofile[MAXBOARDID][MAXCHID];	// MBO 20200617:  Normal mode writes changed from POSIX to  ANSI C file iO
-            #else
-                FILE* diag_ofile[MAXBOARDID];			// MBO 20200617:  Normal mode writes changed from POSIX to  ANSI C file iO
-            #endif
-        #endif
-    #endif // USE_POSIX_FILE_LIB
-#endif // DEBUG_OUTPUT_FILE
+        sprintf (name, "%s.%s_%3.3i", runname, extprefix, chunk);
+    #endif // FOLDER_PER_RUN
+}
 
-int32_t chunck = 0;
+void set_file_name (void)
+{
+	chunk_file_name (fn, chunck);
+}
 
-#ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
+// MBO 20200616: POSIX file IO (-p)
 #define FILE_RETRY_LIMIT 50
 #define FILE_WRITE_RETRY_DELAY 10000
 
 int32_t nonblocking_file_write(int32_t fildes, const void *buf, size_t nbyte)
 {
 	int32_t wstat = 0;
-	int32_t siz = 0;
+	size_t siz = 0;
 	int32_t attempts = 0;
 	while (siz != nbyte)
 	{
-		wstat = write (fildes, buf, nbyte);
+		wstat = write (fildes, (const char *) buf + siz, nbyte - siz);
 		if (wstat == -1)
 		{
 			attempts++;
@@ -388,108 +863,1434 @@ int32_t nonblocking_file_write(int32_t fildes, const void *buf, size_t nbyte)
 	}
 	return siz;
 }
-#endif
 
-/*----------------------------------------------------------------------*/
+/* The state of slot [board][ch], handed out on first use.  A slot is only
+ * ever used by the writer thread of its board, so only the count is locked.
+ */
+static inline struct slotState *slotGet (uint32_t board, uint32_t ch)
+{
+	struct slotState *sl;
+
+	if (slot_map[board][ch])
+		return &slots[slot_map[board][ch]];
+
+	pthread_mutex_lock (&slot_lock);
+	sl = &slots[++nslots];
+	sl->board = board;
+	sl->ch = ch;
+	sl->inhibit = 2;
+	slot_map[board][ch] = nslots;
+	pthread_mutex_unlock (&slot_lock);
+	return sl;
+}
 
-char *
-initReceiver (char *srvr_addr)
+/* writev all of iov[0..n-1], picking up after short writes.  0, or -1 on
+ * an error.
+ */
+int32_t writev_all (int32_t fd, struct iovec *iov, int32_t n)
 {
+	ssize_t w;
 
-	struct rcvrInstance *retval;
-	int32_t port;
+	while (n > 0)
+		{
+			w = writev (fd, iov, n);
+			if (w < 0)
+				{
+					if (errno == EINTR || errno == EAGAIN)
+						continue;
+					return -1;
+				}
+			for (; n > 0 && (size_t) w >= iov->iov_len; iov++, n--)
+				w -= iov->iov_len;
+			if (n > 0)
+				{
+					iov->iov_base = (int8_t *) iov->iov_base + w;
+					iov->iov_len -= w;
+				}
+		}
+	return 0;
+}
 
-	if (debug > 0)
-		printf ("initReceiver\n");
+/* A slot as the summary lists it, "12-3 " or "12 ". */
+void print_slot_id (struct slotState *sl)
+{
+	if (file_layout == FILES_PER_CHANNEL)
+		printf ("%i-%i ", sl->board, sl->ch);
+	else
+		printf ("%i ", sl->board);
+}
 
-	port = SERVER_PORT;
+/*----------------------------------------------------------------------*/
 
-	/* create the receiver instance */
-	/* which is also the return value */
-	/* of this function */
+/* Writeback pacing (-W).  Called by whoever writes the file, after each
+ * block, with the bytes from..to it took: for every window of pace_bytes
+ * filled, start its writeback, then wait for the window before it to
+ * reach the disk and drop it from the page cache.  A file then holds about
+ * two windows of dirty or cached pages, and the wait throttles the writer
+ * to the disk instead of letting the kernel flush gigabytes at once.
+ * Returns the windows paced; ns gets the time waited.  The caller adds
+ * them to the slot, under io_lock on an IO thread.
+ */
+int32_t slotPace (int32_t fd, int64_t from, int64_t to, int64_t *ns)
+{
+	int64_t end, t0;
+	int32_t windows = 0;
 
-	retval = (struct rcvrInstance *) calloc (sizeof (struct rcvrInstance), 1);
-	if (!retval)
-		return (0);								 /* error return */
+	*ns = 0;
+	for (end = (from / pace_bytes + 1) * pace_bytes; end <= to; end += pace_bytes)
+		{
+			sync_file_range (fd, end - pace_bytes, pace_bytes, SYNC_FILE_RANGE_WRITE);
+			if (end >= 2 * pace_bytes)
+				{
+					t0 = nowNs ();
+					sync_file_range (fd, end - 2 * pace_bytes, pace_bytes,
+									 SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+					posix_fadvise (fd, end - 2 * pace_bytes, pace_bytes, POSIX_FADV_DONTNEED);
+					*ns += nowNs () - t0;
+				}
+			windows++;
+		}
+	return windows;
+}
 
-	/* create server addressed socket */
+/*----------------------------------------------------------------------*/
 
-	memset (&retval->adr_srvr, 0, sizeof retval->adr_srvr);
-	retval->adr_srvr.sin_family = AF_INET;
-	retval->adr_srvr.sin_port = htons (port);
-	retval->adr_srvr.sin_addr.s_addr = inet_addr (srvr_addr);
+/* Asynchronous writes (-q).  With -o staged a full block is queued on its
+ * file instead of written, and the slot goes on in a spare block.  Files
+ * with blocks queued wait on io_ready; an IO thread takes the first file,
+ * writes its oldest block and puts it back at the end if it has more, so
+ * a file is written by one thread at a time, in order, and a slow file
+ * only holds up the threads that are on it.  At most io_limit blocks are
+ * queued or being written; a writer that would queue more waits (a stall).
+ */
+pthread_mutex_t io_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t io_work = PTHREAD_COND_INITIALIZER;
+pthread_cond_t io_done = PTHREAD_COND_INITIALIZER;
+struct slotState *io_ready, *io_ready_tail;
+struct ioBlock *io_spare;								 /* written blocks, for reuse */
+int32_t io_queued = 0, io_peak = 0;						 /* blocks queued or being written */
+int64_t io_stalls = 0;
+
+/* A block to stage into; io_lock held.  Waits while the queue is full. */
+struct ioBlock *ioBlockGet (void)
+{
+	struct ioBlock *b;
 
-	if (retval->adr_srvr.sin_addr.s_addr == INADDR_NONE)
+	if (io_threads > 0 && io_queued >= io_limit)
 		{
-			printf ("bad server address %s port %d\n", srvr_addr, port);
-			return (0);
-		};
+			io_stalls++;
+			while (io_queued >= io_limit)
+				pthread_cond_wait (&io_done, &io_lock);
+		}
+	if (io_spare)
+		{
+			b = io_spare;
+			io_spare = b->next;
+			return b;
+		}
+	b = (struct ioBlock *) calloc (1, sizeof (struct ioBlock));
+	if (b && posix_memalign ((void **) &b->data, FILE_STAGE_ALIGN, FILE_STAGE_SIZE) != 0)
+		{
+			free (b);
+			b = NULL;
+		}
+	return b;
+}
 
-	retval->len_inet = sizeof (retval->adr_srvr);
-	retval->recSock = -1;
+/* Queue the staged block of a slot, at offset off of its file, for the IO
+ * threads; io_lock held.  The block keeps the file, which may be handed to
+ * the chunk thread before the block is written.
+ */
+void ioQueue (struct slotState *sl, int64_t off)
+{
+	struct ioBlock *b = sl->stage;
+
+	b->len = sl->staged;
+	b->fd = sl->ofd;
+	b->off = off;
+	b->queued = nowNs ();
+	b->next = NULL;
+	if (sl->qtail)
+		sl->qtail->next = b;
+	else
+		sl->qhead = b;
+	sl->qtail = b;
+	sl->qseq++;
+	if (++sl->qdepth > sl->qpeak)
+		sl->qpeak = sl->qdepth;
+	if (++io_queued > io_peak)
+		io_peak = io_queued;
+	sl->stage = NULL;
+	sl->staged = 0;
+
+	if (!sl->qbusy)
+		{
+			sl->qbusy = 1;
+			sl->qnext = NULL;
+			if (io_ready_tail)
+				io_ready_tail->qnext = sl;
+			else
+				io_ready = sl;
+			io_ready_tail = sl;
+			pthread_cond_signal (&io_work);
+		}
+}
 
-	printf ("initReceiver: will use Server addr %s and port: %d\n", srvr_addr, port);
-	fflush (stdout);
+void *ioLoop (void *)
+{
+	struct slotState *sl;
+	struct ioBlock *b;
+	int32_t ok, windows = 0;
+	int64_t ns, pns = 0;
 
-	return (char *) retval;
+	pthread_mutex_lock (&io_lock);
+	while (1)
+		{
+			while (!io_ready)
+				pthread_cond_wait (&io_work, &io_lock);
+			sl = io_ready;
+			io_ready = sl->qnext;
+			if (!io_ready)
+				io_ready_tail = NULL;
+			b = sl->qhead;
+			sl->qhead = b->next;
+			if (!sl->qhead)
+				sl->qtail = NULL;
+			pthread_mutex_unlock (&io_lock);
+
+			ok = (nonblocking_file_write (b->fd, b->data, b->len) == b->len);
+			if (pace_bytes)
+				windows = slotPace (b->fd, b->off, b->off + b->len, &pns);
+
+			pthread_mutex_lock (&io_lock);
+			if (pace_bytes)
+				{
+					sl->pwindows += windows;
+					sl->pns += pns;
+				}
+			ns = nowNs () - b->queued;
+			if (!ok)
+				sl->qerror = 1;
+			sl->qwrites++;
+			sl->qdone++;
+			sl->qns += ns;
+			if (sl->qmaxns < ns)
+				sl->qmaxns = ns;
+			sl->qdepth--;
+			io_queued--;
+			b->next = io_spare;
+			io_spare = b;
+
+			// back to the end of the line, or done
+			if (sl->qhead)
+				{
+					sl->qnext = NULL;
+					if (io_ready_tail)
+						io_ready_tail->qnext = sl;
+					else
+						io_ready = sl;
+					io_ready_tail = sl;
+				}
+			else
+				sl->qbusy = 0;
+			pthread_cond_broadcast (&io_done);
+		}
+	return NULL;
 }
 
-/*-----------------------------------------------------------------------------*/
-
-int32_t
-stopReceiver (char *instancechar)
+/* Start the -q IO threads. */
+void startIO (void)
 {
-	struct rcvrInstance *instance;
+	pthread_t thread;
+	int32_t i;
 
-	if (debug > 0)
-		printf ("stopReceiver\n");
+	for (i = 0; i < io_threads; i++)
+		if (pthread_create (&thread, NULL, ioLoop, NULL) != 0)
+			{
+				printf ("could not start IO thread %i\n", i);
+				exit (1);
+			}
+}
 
-	instance = (struct rcvrInstance *) instancechar;
-	if (!instance)
+/* -o direct: keep PREALLOC_MB reserved ahead of the data, up to the chunk
+ * size.  Reserving the whole chunk for every file at once would ask for
+ * <maxfilesize> times the number of files.
+ */
+void slotPrealloc (struct slotState *sl)
+{
+	int64_t end;
+
+	if (sl->fbytes + FILE_STAGE_SIZE <= sl->prealloc || sl->prealloc >= max_file_size)
+		return;
+	end = sl->fbytes + (int64_t) PREALLOC_MB * 1024 * 1024;
+	if (end > max_file_size)
+		end = max_file_size;
+	if (fallocate (sl->ofd, FALLOC_FL_KEEP_SIZE, sl->prealloc, end - sl->prealloc) == 0)
+		sl->prealloc = end;
+	else
+		sl->prealloc = max_file_size;					 // not supported, or no room: stop trying
+}
+
+/* -q or -o direct: the a and b bytes do not fit the block.  Top it up from
+ * their head, queue it (or write it, aligned as O_DIRECT needs) and stage
+ * the rest in a spare block (or the same one).
+ */
+int32_t slotFill (struct slotState *sl, const void *a, int32_t na, const void *b, int32_t nb)
+{
+	int32_t room = FILE_STAGE_SIZE - sl->staged;
+	int32_t ka = (na < room) ? na : room;
+	int32_t kb = (nb < room - ka) ? nb : room - ka;
+
+	if (sl->qerror)
+		return -1;
+	memcpy (sl->stage->data + sl->staged, a, ka);
+	memcpy (sl->stage->data + sl->staged + ka, b, kb);
+	sl->staged += ka + kb;
+	sl->fbytes += FILE_STAGE_SIZE;
+	if (direct_io)
+		slotPrealloc (sl);
+
+	if (io_threads == 0)
 		{
-			printf ("Null receiver instance in stopReceiver\n");
-			return -1;
+			if (nonblocking_file_write (sl->ofd, sl->stage->data, FILE_STAGE_SIZE) != FILE_STAGE_SIZE)
+				return -1;
 		}
-	if (instance->recSock == -1)
+	else
 		{
-			return 0;
+			pthread_mutex_lock (&io_lock);
+			ioQueue (sl, sl->fbytes - FILE_STAGE_SIZE);
+			sl->stage = ioBlockGet ();
+			pthread_mutex_unlock (&io_lock);
+			if (!sl->stage)
+				return -1;
 		}
-	close (instance->recSock);
-	instance->recSock = -1;
+
+	memcpy (sl->stage->data, (const int8_t *) a + ka, na - ka);
+	memcpy (sl->stage->data + na - ka, (const int8_t *) b + kb, nb - kb);
+	sl->staged = na - ka + nb - kb;
 	return 0;
 }
 
-
-//MBO 20200617: New Function. Lets try to be generous with the socket options
-void setsocketoption(int32_t sock)
+/* IO thread statistics of the interval: the queue, then the files that
+ * had more than one block waiting.
+ */
+void printIO (void)
 {
-	int32_t rcvbuf = 65536;
-	int32_t sndbuf = 65536;
-//	int32_t nodelay = 1;
-	if(setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (char*)(&rcvbuf), sizeof(rcvbuf)))
-		printf("could not set SO_RCVBUF");
-	if(setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (char*)(&sndbuf), sizeof(sndbuf)))
-		printf("could not set SO_SNDBUF");
-//	if(setsockopt(sock, SOL_TCP, TCP_NODELAY, (char*)(&nodelay), sizeof(nodelay)))
-//		printf("could not set TCP_NODELAY");
-	return;
+	struct slotState *sl;
+	int64_t writes = 0, ns = 0, maxns = 0;
+	int32_t i;
+
+	if (io_threads == 0)
+		return;
+	pthread_mutex_lock (&io_lock);
+	for (i = 1; i <= nslots; i++)
+		{
+			writes += slots[i].qwrites;
+			ns += slots[i].qns;
+			if (maxns < slots[i].qmaxns)
+				maxns = slots[i].qmaxns;
+		}
+	printf ("  io: %i threads, %i/%i blocks queued, peak %i, %" PRId64 " stalls; %" PRId64 " writes, latency avg %.1f max %.1f ms\n",
+			io_threads, io_queued, io_limit, io_peak, io_stalls, writes, writes ? ns / 1e6 / writes : 0.0, maxns / 1e6);
+	for (i = 1; i <= nslots; i++)
+		{
+			sl = &slots[i];
+			if (sl->qpeak > 1)
+				{
+					printf ("    file ");
+					print_slot_id (sl);
+					printf ("queue peak %i; %" PRId64 " writes, latency avg %.1f max %.1f ms\n",
+							sl->qpeak, sl->qwrites, sl->qwrites ? sl->qns / 1e6 / sl->qwrites : 0.0, sl->qmaxns / 1e6);
+				}
+			sl->qpeak = sl->qdepth;
+			sl->qwrites = sl->qns = sl->qmaxns = 0;
+		}
+	io_peak = io_queued;
+	io_stalls = 0;
+	pthread_mutex_unlock (&io_lock);
 }
 
+/* Windows paced and time waited for them in the interval. */
+void printPace (void)
+{
+	static int64_t last_windows = 0, last_ns = 0;
+	int64_t windows = 0, ns = 0;
+	int32_t i;
+
+	if (pace_bytes == 0)
+		return;
+	pthread_mutex_lock (&io_lock);
+	for (i = 1; i <= nslots; i++)
+		{
+			windows += slots[i].pwindows;
+			ns += slots[i].pns;
+		}
+	pthread_mutex_unlock (&io_lock);
+	printf ("  writeback: %" PRId64 " windows of %" PRId64 " MB paced, %.1f ms waited\n",
+			windows - last_windows, pace_bytes / 1024 / 1024, (ns - last_ns) / 1e6);
+	last_windows = windows;
+	last_ns = ns;
+}
 
 /*----------------------------------------------------------------------*/
 
-int32_t getReceiverData2 (char *instancechar, int8_t **retptr, int32_t *readsize) {
+/* Whether the data file of a slot is open. */
+template <int32_t IO>
+static inline int32_t slotIsOpen (struct slotState *sl)
+{
+	if (IO != FILE_IO_STDIO)
+		return sl->ofd > 0;
+	return sl->ofile != 0;
+}
 
-	struct rcvrInstance *instance;
-	struct reqPacket request;
-	evtServerRetStruct firstreply;
-	int32_t bytesret = 0;
-	int32_t temptype;
-	int32_t recsize;
-	int32_t numrecs = 0;
-	int32_t numret = 0;
-	int32_t numbytesleft;
-	uint32_t i;
+int32_t slotOpen (struct slotState *sl)
+{
+	return (file_io == FILE_IO_STDIO) ? slotIsOpen<FILE_IO_STDIO> (sl) : slotIsOpen<FILE_IO_STAGED> (sl);
+}
+
+/* -o staged: the a and b bytes do not fit the block.  The block is
+ * completed with their head straight from the caller's memory, written
+ * with one writev, and the rest is staged.  A packet is at most 8 kB, so
+ * the rest always fits.
+ */
+int32_t slotFlush (struct slotState *sl, const void *a, int32_t na, const void *b, int32_t nb)
+{
+	struct iovec iov[3];
+	int32_t room = FILE_STAGE_SIZE - sl->staged;
+	int32_t ka = (na < room) ? na : room;
+	int32_t kb = (nb < room - ka) ? nb : room - ka;
+	int64_t ns;
+
+	if (io_threads > 0 || direct_io)
+		return slotFill (sl, a, na, b, nb);
+
+	iov[0].iov_base = sl->stage->data;
+	iov[0].iov_len = sl->staged;
+	iov[1].iov_base = (void *) a;
+	iov[1].iov_len = ka;
+	iov[2].iov_base = (void *) b;
+	iov[2].iov_len = kb;
+	if (writev_all (sl->ofd, iov, 3) != 0)
+		return -1;
+	sl->fbytes += FILE_STAGE_SIZE;
+	if (pace_bytes)
+		{
+			sl->pwindows += slotPace (sl->ofd, sl->fbytes - FILE_STAGE_SIZE, sl->fbytes, &ns);
+			sl->pns += ns;
+		}
+
+	memcpy (sl->stage->data, (const int8_t *) a + ka, na - ka);
+	memcpy (sl->stage->data + na - ka, (const int8_t *) b + kb, nb - kb);
+	sl->staged = na - ka + nb - kb;
+	return 0;
+}
+
+/* Write the a and b bytes, a header and its payload, to the data file of a
+ * slot.  Returns 0, or -1 on an error.
+ */
+template <int32_t IO>
+static inline int32_t slotWrite (struct slotState *sl, const void *a, int32_t na, const void *b, int32_t nb)
+{
+	if (IO == FILE_IO_STAGED)
+		{
+			if (sl->staged + na + nb > FILE_STAGE_SIZE)
+				return slotFlush (sl, a, na, b, nb);
+			memcpy (sl->stage->data + sl->staged, a, na);
+			memcpy (sl->stage->data + sl->staged + na, b, nb);
+			sl->staged += na + nb;
+			return 0;
+		}
+	if (IO == FILE_IO_POSIX)
+		return (nonblocking_file_write (sl->ofd, a, na) == na
+				&& nonblocking_file_write (sl->ofd, b, nb) == nb) ? 0 : -1;
+	return (fwrite (a, na, 1, sl->ofile) == 1 && fwrite (b, nb, 1, sl->ofile) == 1) ? 0 : -1;
+}
+
+/* Slot channels used by the file layout. */
+int32_t slotChannels (void)
+{
+	return (file_layout == FILES_PER_CHANNEL) ? MAXCHID : 1;
+}
+
+/*----------------------------------------------------------------------*/
+
+/* io_uring write engine (-u).  Data files are stdio streams on top of
+ * fopencookie(), so writeEvents2 is unchanged.  When stdio flushes a file
+ * buffer, the bytes are copied into one of UR_WRITE_BUFFERS registered
+ * buffers and queued.  The queue is submitted once per received buffer:
+ * writes for the same file go in as one chain of linked SQEs, so each file
+ * is written in order and all files are served by a single system call.
+ * With -j the writer threads share the ring under ur_lock; the per-buffer
+ * submit runs after they are done.
+ */
+#define UR_WRITE_BUFFERS 32
+
+struct urFile
+{
+	int32_t fd;
+	int64_t offset;									 /* file offset of the next queued write */
+	int32_t inflight;								 /* writes queued or submitted */
+	int8_t error;
+};
+
+struct urWriteBuf
+{
+	int8_t *data;
+	struct urFile *file;
+	int32_t len;
+	int64_t offset;
+};
+
+struct uring txring;
+int8_t tx_registered = 0;
+struct urWriteBuf urbuf[UR_WRITE_BUFFERS];
+int32_t urfree[UR_WRITE_BUFFERS], nurfree = 0;
+int32_t urpending[UR_WRITE_BUFFERS], nurpending = 0;
+int64_t ur_submits = 0;								 /* io_uring_enter calls for writes */
+int64_t ur_writes = 0;								 /* writes completed */
+pthread_mutex_t ur_lock = PTHREAD_MUTEX_INITIALIZER;
+
+int32_t uringWriteInit (void)
+{
+	struct iovec iov[UR_WRITE_BUFFERS];
+	int32_t i;
+
+	if (uringInit (&txring, 2 * UR_WRITE_BUFFERS) < 0)
+		return -1;
+	for (i = 0; i < UR_WRITE_BUFFERS; i++)
+		{
+			if (posix_memalign ((void **) &urbuf[i].data, 4096, FILE_BUF_SIZE) != 0)
+				return -1;
+			iov[i].iov_base = urbuf[i].data;
+			iov[i].iov_len = FILE_BUF_SIZE;
+			urfree[nurfree++] = i;
+		}
+	tx_registered = (uringRegisterBuffers (&txring, iov, UR_WRITE_BUFFERS) == 0);
+	return 0;
+}
+
+/* Submit everything queued, waiting for at least wait completions, and
+ * recycle the buffers of all writes that finished.
+ */
+void uringWriteSubmit (int32_t wait)
+{
+	struct io_uring_sqe *sqe, *prev;
+	struct io_uring_cqe *cqe;
+	struct urWriteBuf *wb;
+	struct urFile *f;
+	int32_t i, j, b, res, done;
+
+	// group the queue by file, keeping each file's writes in order
+	for (i = 0; i < nurpending; i++)
+		{
+			if (urpending[i] < 0)
+				continue;
+			f = urbuf[urpending[i]].file;
+			prev = NULL;
+			for (j = i; j < nurpending; j++)
+				{
+					b = urpending[j];
+					if (b < 0 || urbuf[b].file != f)
+						continue;
+					sqe = uringGetSqe (&txring);
+					sqe->opcode = tx_registered ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+					sqe->fd = f->fd;
+					sqe->addr = (uint64_t) (uintptr_t) urbuf[b].data;
+					sqe->len = urbuf[b].len;
+					sqe->off = urbuf[b].offset;
+					sqe->buf_index = b;
+					sqe->user_data = b;
+					if (prev)
+						prev->flags |= IOSQE_IO_LINK;
+					prev = sqe;
+					urpending[j] = -1;
+				}
+		}
+	nurpending = 0;
+
+	uringSubmit (&txring, wait, 0);
+	ur_submits++;
+
+	while ((cqe = uringPeekCqe (&txring)) != NULL)
+		{
+			b = cqe->user_data;
+			res = cqe->res;
+			uringCqeSeen (&txring);
+			wb = &urbuf[b];
+
+			// a short write breaks the chain and cancels the rest of it,
+			// so finish those synchronously from the same buffers
+			done = (res > 0) ? res : 0;
+			if (res == -ECANCELED || (res >= 0 && res < wb->len))
+				while (done < wb->len)
+					{
+						res = pwrite (wb->file->fd, wb->data + done, wb->len - done, wb->offset + done);
+						if (res <= 0)
+							break;
+						done += res;
+					}
+			if (done != wb->len)
+				{
+					printf ("FILE WRITE ERROR: io_uring write returned %s\n", strerror (res < 0 ? -res : EIO));
+					wb->file->error = 1;
+				}
+
+			wb->file->inflight--;
+			urfree[nurfree++] = b;
+			ur_writes++;
+		}
+}
+
+ssize_t uringFileWrite (void *cookie, const char *buf, size_t size)
+{
+	struct urFile *f = (struct urFile *) cookie;
+	struct urWriteBuf *wb;
+	size_t n, written = 0;
+
+	pthread_mutex_lock (&ur_lock);
+	if (f->error)
+		{
+			pthread_mutex_unlock (&ur_lock);
+			errno = EIO;
+			return -1;
+		}
+
+	while (written < size)
+		{
+			while (nurfree == 0)
+				uringWriteSubmit (1);
+			wb = &urbuf[urfree[--nurfree]];
+			n = size - written;
+			if (n > FILE_BUF_SIZE)
+				n = FILE_BUF_SIZE;
+			memcpy (wb->data, buf + written, n);
+			wb->file = f;
+			wb->len = n;
+			wb->offset = f->offset;
+			f->offset += n;
+			f->inflight++;
+			urpending[nurpending++] = wb - urbuf;
+			written += n;
+		}
+	pthread_mutex_unlock (&ur_lock);
+	return size;
+}
+
+int uringFileClose (void *cookie)
+{
+	struct urFile *f = (struct urFile *) cookie;
+	int32_t error;
+
+	pthread_mutex_lock (&ur_lock);
+	uringWriteSubmit (0);
+	while (f->inflight > 0)
+		uringWriteSubmit (1);
+	error = f->error;
+	pthread_mutex_unlock (&ur_lock);
+	close (f->fd);
+	free (f);
+	return error ? EOF : 0;
+}
+
+/* fopen (str, "wb") for the data files, through io_uring when enabled. */
+FILE *dataFileOpen (char *str)
+{
+	cookie_io_functions_t funcs = { NULL, uringFileWrite, NULL, uringFileClose };
+	struct urFile *f;
+
+	if (!use_uring)
+		return fopen (str, "wb");
+
+	f = (struct urFile *) calloc (1, sizeof (struct urFile));
+	f->fd = open (str, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (f->fd < 0)
+		{
+			free (f);
+			return NULL;
+		}
+	return fopencookie (f, "wb", funcs);
+}
+
+/* Open the files of a slot in the chunk named base, fopen "wb" style, into
+ * f; str gets the data file's name.  0, -1 on an error, or -2 if the file
+ * exists already, which the writer ends the run for.
+ */
+int32_t chunkFileOpen (struct chunkFile *f, const char *base, struct slotState *sl, char *str)
+{
+	const char *trig = sl->trig ? "_trig" : "";
+	int32_t fd;
+	#ifdef DEBUG_OUTPUT_FILE
+        char diag_str[550];
+	#endif // DEBUG_OUTPUT_FILE
+
+	/* filename */
+	if (file_layout == FILES_SINGLE)
+		sprintf (str, "%s%s", base, trig);
+	else if (file_layout == FILES_PER_CHANNEL)	// MBO 20200616:
+		sprintf (str, "%s%s_%4.4i_%01X", base, trig, sl->board, sl->ch);
+	else
+		sprintf (str, "%s%s_%4.4i", base, trig, sl->board);
+
+	#ifdef DEBUG_OUTPUT_FILE
+		if (file_layout == FILES_SINGLE)
+			sprintf (diag_str, "%s_diag_trig", base);
+		else if (file_layout == FILES_PER_CHANNEL)	// MBO 20200616:
+			sprintf (diag_str, "%s_diag_trig_%4.4i_%01X", base, sl->board, sl->ch);
+		else
+			sprintf (diag_str, "%s_diag_trig_%4.4i", base, sl->board);
+	#endif // DEBUG_OUTPUT_FILE
+
+	/* make sure it does not exist already */
+
+	fd = open (str, O_RDONLY, 0);
+
+	if (fd != -1)
+		{
+			close(fd);
+			return -2;
+		};
+
+	/* open file */
+
+	memset (f, 0, sizeof (struct chunkFile));
+	if (file_io == FILE_IO_STAGED)
+		{
+			if (direct_io)
+				{
+					f->ofd = open (str, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+					if (f->ofd < 0 && errno == EINVAL)
+						{
+							printf ("O_DIRECT not supported for %s, writing it through the page cache\n", str);
+							f->ofd = open (str, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+						}
+					// the first PREALLOC_MB; slotPrealloc keeps ahead from there
+					f->prealloc = (int64_t) PREALLOC_MB * 1024 * 1024;
+					if (f->prealloc > max_file_size)
+						f->prealloc = max_file_size;
+					if (f->ofd > 0 && fallocate (f->ofd, FALLOC_FL_KEEP_SIZE, 0, f->prealloc) != 0)
+						f->prealloc = max_file_size;
+				}
+			else
+				f->ofd = open (str, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		}
+	else if (file_io == FILE_IO_POSIX)	// MBO 20200616: Let's try going faster on writes with O_NONBLOCK
+		f->ofd = open (str, O_WRONLY | O_CREAT | O_NONBLOCK, 0644);
+	else
+		{
+			f->ofile = dataFileOpen (str);
+			if (f->ofile)
+				{
+					f->file_buffer = (char*)malloc(FILE_BUF_SIZE);
+					setvbuf(f->ofile, f->file_buffer, _IOFBF, FILE_BUF_SIZE);
+				}
+		}
+	if (!f->ofile && f->ofd <= 0)
+		{
+			f->ofd = 0;
+			return -1;
+		}
+	f->name = strdup (str);
+
+	#ifdef DEBUG_OUTPUT_FILE
+		if (sl->trig)
+		{
+			f->diag_ofile = fopen (diag_str, "wb");
+			if (f->diag_ofile)
+			{
+				f->diag_file_buffer = (char*)malloc(FILE_BUF_SIZE);
+				setvbuf(f->diag_ofile, f->diag_file_buffer, _IOFBF, FILE_BUF_SIZE);
+				f->diag_name = strdup (diag_str);
+			}
+		}
+	#endif // DEBUG_OUTPUT_FILE
+	return 0;
+}
+
+/* Make the files in f the open files of a slot, at the start of a chunk.
+ * 0, or -1 (f untouched) when no block can be had to stage into.
+ */
+int32_t slotAttach (struct slotState *sl, struct chunkFile *f)
+{
+	// the block is kept for the next chunk's file, unless it was queued
+	if (file_io == FILE_IO_STAGED && !sl->stage)
+		{
+			pthread_mutex_lock (&io_lock);
+			sl->stage = ioBlockGet ();
+			pthread_mutex_unlock (&io_lock);
+			if (!sl->stage)
+				return -1;
+		}
+	sl->ofile = f->ofile;
+	sl->ofd = f->ofd;
+	sl->name = f->name;
+	sl->file_buffer = f->file_buffer;
+	sl->prealloc = f->prealloc;
+	#ifdef DEBUG_OUTPUT_FILE
+		sl->diag_ofile = f->diag_ofile;
+		sl->diag_name = f->diag_name;
+		sl->diag_file_buffer = f->diag_file_buffer;
+	#endif // DEBUG_OUTPUT_FILE
+	memset (f, 0, sizeof (struct chunkFile));
+	sl->staged = 0;
+	sl->fbytes = 0;
+	sl->bytes = 0;
+	sl->inhibit = 0;
+	return 0;
+}
+
+/* Take the open files of a slot into f; the slot reads as closed. */
+void slotDetach (struct slotState *sl, struct chunkFile *f)
+{
+	f->ofile = sl->ofile;
+	f->ofd = sl->ofd;
+	f->name = sl->name;
+	f->file_buffer = sl->file_buffer;
+	f->prealloc = sl->prealloc;
+	#ifdef DEBUG_OUTPUT_FILE
+		f->diag_ofile = sl->diag_ofile;
+		f->diag_name = sl->diag_name;
+		f->diag_file_buffer = sl->diag_file_buffer;
+		sl->diag_ofile = 0;
+		sl->diag_name = 0;
+		sl->diag_file_buffer = 0;
+	#endif // DEBUG_OUTPUT_FILE
+	sl->ofile = 0;
+	sl->ofd = 0;
+	sl->name = 0;
+	sl->file_buffer = 0;
+	sl->bytes = 0;
+}
+
+/*----------------------------------------------------------------------*/
+
+char *
+initReceiver (char *srvr_addr)
+{
+
+	struct rcvrInstance *retval;
+	int32_t port;
+	char addr[64];
+	char *colon;
+
+	if (debug > 0)
+		printf ("initReceiver\n");
+
+	/* dotted decimal address, optionally followed by :port */
+
+	port = SERVER_PORT;
+	snprintf (addr, sizeof (addr), "%s", srvr_addr);
+	colon = strchr (addr, ':');
+	if (colon)
+		{
+			*colon = 0;
+			port = atoi (colon + 1);
+		};
+	srvr_addr = addr;
+
+	/* create the receiver instance */
+	/* which is also the return value */
+	/* of this function */
+
+	retval = (struct rcvrInstance *) calloc (sizeof (struct rcvrInstance), 1);
+	if (!retval)
+		return (0);								 /* error return */
+
+	/* create server addressed socket */
+
+	memset (&retval->adr_srvr, 0, sizeof retval->adr_srvr);
+	retval->adr_srvr.sin_family = AF_INET;
+	retval->adr_srvr.sin_port = htons (port);
+	retval->adr_srvr.sin_addr.s_addr = inet_addr (srvr_addr);
+
+	if (retval->adr_srvr.sin_addr.s_addr == INADDR_NONE)
+		{
+			printf ("bad server address %s port %d\n", srvr_addr, port);
+			return (0);
+		};
+
+	retval->len_inet = sizeof (retval->adr_srvr);
+	retval->recSock = -1;
+	retval->state = RCVR_DISCONNECTED;
+	retval->retrydelay = retry_min_ms;
+	retval->rcvbuf = rcvbuf_fixed ? rcvbuf_fixed : RCVBUF_INITIAL;
+
+	printf ("initReceiver: will use Server addr %s and port: %d\n", srvr_addr, port);
+	fflush (stdout);
+
+	return (char *) retval;
+}
+
+/*-----------------------------------------------------------------------------*/
+
+int32_t
+stopReceiver (char *instancechar)
+{
+	struct rcvrInstance *instance;
+	int32_t lost;
+
+	if (debug > 1)
+		printf ("stopReceiver\n");
+
+	instance = (struct rcvrInstance *) instancechar;
+	if (!instance)
+		{
+			printf ("Null receiver instance in stopReceiver\n");
+			return -1;
+		}
+
+	/* -u: the socket and the ring buffer belong to the operation in flight
+	 * until it completes.  Shut the socket down so that it completes now;
+	 * uringReceiveLoop stops the receiver when it does. */
+	if (use_uring && instance->urbusy)
+		{
+			instance->urclosing = 1;
+			shutdown (instance->recSock, SHUT_RDWR);
+			return 0;
+		}
+
+	/* account for what an established connection took down with it; a
+	 * complete header means a SERVER_SUMMARY whose payload never made it */
+	if (instance->state == RCVR_CONNECTED)
+		{
+			lost = instance->hdrbytes == sizeof (evtServerRetStruct) ? instance->recsize : 0;
+			instance->ndisconnects++;
+			instance->requestslost += instance->outstanding;
+			instance->byteslost += lost;
+			instance->downsince = nowMs ();
+			printf ("lost connection to %s: %i requests unanswered, %i bytes of a reply lost\n", instance->host,
+					instance->outstanding, lost);
+			instance->retrydelay = 0;				 /* first retry at once */
+		}
+	if (instance->slot)
+		{
+			rcvRingRelease (instance->slot, 0);
+			instance->slot = NULL;
+		}
+	instance->hdrbytes = 0;
+	instance->replyreads = 0;
+	if (instance->recSock != -1)
+		{
+			close (instance->recSock);
+			instance->recSock = -1;
+		}
+
+	/* try again later, backing off while the IOC stays unreachable */
+	instance->state = RCVR_DISCONNECTED;
+	instance->deadline = nowMs () + instance->retrydelay;
+	instance->retrydelay = instance->retrydelay ? 2 * instance->retrydelay : retry_min_ms;
+	if (instance->retrydelay > retry_max_ms)
+		instance->retrydelay = retry_max_ms;
+	return 0;
+}
+
+
+//MBO 20200617: New Function. Lets try to be generous with the socket options
+// The receive buffer is now per IOC, see rcvbufTune.  Returns the SO_RCVBUF the
+// kernel reports, which on Linux counts its bookkeeping too (twice the request).
+int32_t setsocketoption(int32_t sock, int32_t rcvbuf)
+{
+	int32_t sndbuf = 65536;
+	socklen_t len = sizeof (rcvbuf);
+	int32_t nodelay = 1;
+	int32_t busypoll = BUSY_POLL_US;
+	int32_t stamp = 1;
+	// SO_RCVBUFFORCE gets past net.core.rmem_max when we have CAP_NET_ADMIN
+	if(setsockopt(sock, SOL_SOCKET, SO_RCVBUFFORCE, (char*)(&rcvbuf), sizeof(rcvbuf)) &&
+	   setsockopt(sock, SOL_SOCKET, SO_RCVBUF, (char*)(&rcvbuf), sizeof(rcvbuf)))
+		printf("could not set SO_RCVBUF");
+	if(setsockopt(sock, SOL_SOCKET, SO_SNDBUF, (char*)(&sndbuf), sizeof(sndbuf)))
+		printf("could not set SO_SNDBUF");
+	// kernel receive times come with the data, see rcvRead
+	if(setsockopt(sock, SOL_SOCKET, SO_TIMESTAMPNS, (char*)(&stamp), sizeof(stamp)))
+		printf("could not set SO_TIMESTAMPNS");
+	// -L: requests go out at once, and reads spin on the device queue briefly before sleeping
+	if(low_latency && setsockopt(sock, SOL_TCP, TCP_NODELAY, (char*)(&nodelay), sizeof(nodelay)))
+		printf("could not set TCP_NODELAY");
+	if(low_latency && setsockopt(sock, SOL_SOCKET, SO_BUSY_POLL, (char*)(&busypoll), sizeof(busypoll)))
+		printf("could not set SO_BUSY_POLL");
+	if(getsockopt(sock, SOL_SOCKET, SO_RCVBUF, (char*)(&rcvbuf), &len))
+		rcvbuf = 0;
+	return rcvbuf;
+}
+
+
+/*----------------------------------------------------------------------*/
+
+/* Record the recLen of a SERVER_SUMMARY and, unless -b fixed the size, grow
+ * the socket receive buffer to RCVBUF_REPLIES replies of the 99th percentile
+ * recLen.  Linux fixes the largest advertised window when the connection is
+ * set up, so TCP_WINDOW_CLAMP is raised along with the buffer.  The size is
+ * kept for reconnects, and never shrinks.
+ */
+void rcvbufTune (struct rcvrInstance *instance)
+{
+	int32_t b, sum, clamp;
+	int64_t target;
+
+	b = instance->recsize > 0 ? 32 - __builtin_clz (instance->recsize) : 0;
+	instance->reclenhist[b]++;
+	if (++instance->reclencount >= RCVBUF_HISTORY)
+		for (b = 0, instance->reclencount = 0; b < 32; b++)
+			instance->reclencount += (instance->reclenhist[b] /= 2);
+
+	if (rcvbuf_fixed || instance->nsummary % RCVBUF_RETUNE != 0)
+		return;
+
+	/* bucket b holds recLen below 1 << b; find the 99th percentile one from the top */
+	for (b = 31, sum = 0; b > 0; b--)
+		{
+			sum += instance->reclenhist[b];
+			if ((int64_t) sum * 100 > instance->reclencount)
+				break;
+		}
+	target = (int64_t) RCVBUF_REPLIES << b;
+	if (target < RCVBUF_MIN)
+		target = RCVBUF_MIN;
+	if (target > RCVBUF_MAX)
+		target = RCVBUF_MAX;
+	if (target <= instance->rcvbuf)
+		return;
+
+	instance->rcvbuf = target;
+	instance->rcvbufset = setsocketoption (instance->recSock, instance->rcvbuf);
+	clamp = instance->rcvbuf;
+	setsockopt (instance->recSock, IPPROTO_TCP, TCP_WINDOW_CLAMP, (char *) &clamp, sizeof (clamp));
+	if (debug > 0) printf ("%s: receive buffer now %i kB\n", instance->host, instance->rcvbufset / 1024);
+}
+
+/*----------------------------------------------------------------------*/
+
+/* Count one read call that returned data, timing the reply from its first one.
+ * In the low-latency profile the quick-ack mode, which the kernel drops again
+ * on its own, is re-armed so the IOC sees our ACKs without delay.
+ */
+void replyRead (struct rcvrInstance *instance)
+{
+	int32_t quickack = 1;
+
+	if (instance->replyreads == 0)
+		instance->replystart = nowNs ();
+	instance->replyreads++;
+	if (low_latency)
+		setsockopt (instance->recSock, IPPROTO_TCP, TCP_QUICKACK, (char *) &quickack, sizeof (quickack));
+}
+
+void drainAdd (struct drainStats *s, int32_t reads, int64_t bytes, int64_t ns)
+{
+	if (s->reset)
+		memset (s, 0, sizeof (*s));
+	s->replies++;
+	s->reads += reads;
+	s->bytes += bytes;
+	s->drainns += ns;
+	if (s->readsmax < reads)
+		s->readsmax = reads;
+	if (s->drainmax < ns)
+		s->drainmax = ns;
+}
+
+/* A whole SERVER_SUMMARY reply is in: account for how it came off the socket. */
+void replyDrained (struct rcvrInstance *instance)
+{
+	int64_t ns;
+
+	ns = nowNs () - instance->replystart;
+	drainAdd (&instance->total, instance->replyreads, instance->recsize + sizeof (evtServerRetStruct), ns);
+	drainAdd (&instance->interval, instance->replyreads, instance->recsize + sizeof (evtServerRetStruct), ns);
+	instance->replyreads = 0;
+}
+
+void printDrain (const char *label, struct drainStats *s, int32_t rcvbufset)
+{
+	if (s->replies == 0 || s->reads == 0)
+		{
+			printf ("%s: rcvbuf %i kB; no replies\n", label, rcvbufset / 1024);
+			return;
+		}
+	printf ("%s: rcvbuf %i kB; %i replies, %.1f reads/reply (max %i), %.1f kB/read, drain %.3f ms avg %.3f max\n",
+			label, rcvbufset / 1024, s->replies, (double) s->reads / s->replies, s->readsmax,
+			(double) s->bytes / s->reads / 1024, (double) s->drainns / s->replies / 1e6, (double) s->drainmax / 1e6);
+}
+
+
+/*----------------------------------------------------------------------*/
+
+// REQUEST_WINDOW: The default number of requests kept outstanding with each IOC.
+#define REQUEST_WINDOW 6
+// MAX_REQUEST_WINDOW: The largest request window, set by hand or by adaptation.
+#define MAX_REQUEST_WINDOW 64
+// ADAPT_INTERVAL: Replies looked at before the adaptive window is reconsidered.
+#define ADAPT_INTERVAL 16
+// FULL_REPLY_PERCENT: A SERVER_SUMMARY at least this percentage of the largest
+//  recsize seen counts as full.
+#define FULL_REPLY_PERCENT 90
+
+#if MAX_REQUEST_WINDOW > RTT_SLOTS
+#error RTT_SLOTS must cover MAX_REQUEST_WINDOW
+#endif
+
+int32_t request_window = REQUEST_WINDOW;
+int8_t adaptive_window = 0;
+
+/* Ask for n more buffers: n requests, or with -S one grant of n credits. */
+int32_t sendRequests (struct rcvrInstance *instance, int32_t n)
+{
+	struct reqPacket request[MAX_REQUEST_WINDOW];
+	struct creditPacket grant;
+	void *packet = request;
+	ssize_t len = n * sizeof (struct reqPacket);
+	int64_t now;
+	int32_t i;
+
+	now = nowNs ();
+	for (i = 0; i < n; i++)
+		{
+			request[i].type = htonl (CLIENT_REQUEST_EVENTS);
+			instance->reqsent[(instance->reqhead + instance->outstanding + i) % RTT_SLOTS] = now;
+		}
+	if (use_credit)
+		{
+			grant.type = htonl (CLIENT_GRANT_CREDIT);
+			grant.credit = htonl (n);
+			packet = &grant;
+			len = sizeof (grant);
+		}
+
+	// MSG_NOSIGNAL: an IOC that went away must not take the receiver down with SIGPIPE
+	if (send (instance->recSock, packet, len, MSG_NOSIGNAL) != len)
+		{
+			printf ("%s: request send failed %s\n", instance->host, strerror (errno));
+			stopReceiver ((char *) instance);
+			return -1;
+		}
+	instance->packetssent += n;
+	instance->outstanding += n;
+	return 0;
+}
+
+/*----------------------------------------------------------------------*/
+
+/* Account for one reply, adapt the window if enabled, and top the
+ * outstanding requests back up to the window.
+ * Full summaries mean the IOC has more buffered than we ask for, so the
+ * window widens; mostly INSUFF_DATA means we ask too often, so it narrows.
+ */
+int32_t replyReceived (struct rcvrInstance *instance, int32_t temptype)
+{
+	int64_t sent;
+
+	/* the IOC answers in order, so this reply is for the oldest request */
+	sent = instance->reqsent[instance->reqhead++ % RTT_SLOTS];
+	instance->outstanding--;
+	instance->adaptreplies++;
+
+	if (temptype == SERVER_SUMMARY)
+		{
+			latAdd (&instance->rtt, instance->replystart - sent);
+			latAdd (&instance->rttinterval, instance->replystart - sent);
+			instance->nsummary++;
+			if (instance->maxrecsize < instance->recsize)
+				instance->maxrecsize = instance->recsize;
+			rcvbufTune (instance);
+			if ((int64_t) instance->recsize * 100 >= (int64_t) instance->maxrecsize * FULL_REPLY_PERCENT)
+				{
+					instance->nfull++;
+					instance->adaptfull++;
+				}
+		}
+	else
+		{
+			instance->ninsuff++;
+			instance->adaptinsuff++;
+		}
+
+	if (adaptive_window && instance->adaptreplies >= ADAPT_INTERVAL)
+		{
+			if (instance->adaptfull * 2 > instance->adaptreplies && instance->window < MAX_REQUEST_WINDOW)
+				instance->window++;
+			else if (instance->adaptinsuff * 2 > instance->adaptreplies && instance->window > 1)
+				instance->window--;
+			instance->adaptreplies = 0;
+			instance->adaptfull = 0;
+			instance->adaptinsuff = 0;
+		}
+
+	/* the IOC has nothing for us: hold the next requests back a little,
+	 * and longer each time, instead of asking again straight away
+	 * (except with -L, which polls the IOC as it polls the socket) */
+	if (temptype != SERVER_SUMMARY && !low_latency)
+		{
+			if (!instance->held)
+				{
+					instance->held = 1;
+					instance->idledelay = instance->idledelay ? 2 * instance->idledelay : IDLE_REQUEST_MIN_MS;
+					if (instance->idledelay > IDLE_REQUEST_MAX_MS)
+						instance->idledelay = IDLE_REQUEST_MAX_MS;
+					instance->deadline = nowMs () + instance->idledelay;
+				}
+			return 0;
+		}
+
+	instance->held = 0;
+	instance->idledelay = 0;
+
+	/* credit is granted in batches, once half the window is used up */
+	if (use_credit && instance->outstanding > instance->window / 2)
+		return 0;
+	if (instance->outstanding < instance->window)
+		return sendRequests (instance, instance->window - instance->outstanding);
+	return 0;
+}
+
+/*----------------------------------------------------------------------*/
+
+/* A connect finished: reset the per-connection state, report the gap if
+ * the connection had been lost before, and send the first requests.
+ * Shared by the epoll and io_uring engines.
+ */
+int32_t linkUp (struct rcvrInstance *instance)
+{
+	int64_t gap;
+
+	instance->state = RCVR_CONNECTED;
+	instance->retrydelay = retry_min_ms;
+	instance->hdrbytes = 0;
+	instance->replyreads = 0;
+	instance->nextseq = 0;
+	instance->nconnects++;
+
+	if (instance->downsince)
+		{
+			gap = nowMs () - instance->downsince;
+			instance->downms += gap;
+			instance->downsince = 0;
+			printf ("reconnected to %s after %.3f s (%i attempts)\n", instance->host, gap / 1e3, instance->nattempts);
+		}
+	else
+		printf ("connected to %s\n", instance->host);
+
+	instance->outstanding = 0;
+	instance->window = request_window;
+	instance->held = 0;
+	instance->idledelay = 0;
+	return sendRequests (instance, instance->window);
+}
+
+// MBO 20200616: Let's try queueing up 6 requests:
+// (now request_window of them, see -w)
+int32_t connected (struct rcvrInstance *instance)
+{
+	struct epoll_event ev;
+	uint32_t i;
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = instance;
+	epoll_ctl (rcvr_epfd, EPOLL_CTL_MOD, instance->recSock, &ev);
+
+	if (linkUp (instance) < 0)
+		return -1;
+
+	if (debug > 0) {
+		struct reqPacket request;
+		request.type = htonl (CLIENT_REQUEST_EVENTS);
+		printf (" sent request data=");
+		for(i=0; i < (sizeof (struct reqPacket)); i++)
+			printf ("%02X ", ((char *) &request)[i]);
+		printf ("\n");
+	}
+	return 0;
+}
+
+/*----------------------------------------------------------------------*/
+
+int32_t connectReceiver (struct rcvrInstance *instance)
+{
+	struct epoll_event ev;
+
+	instance->nattempts++;
+	instance->recSock = socket (AF_INET, SOCK_STREAM, 0);
+
+	if (instance->recSock == -1){
+		printf ("Unable to open socket.\n");
+		return -1;
+	}
+
+	instance->rcvbufset = setsocketoption(instance->recSock, instance->rcvbuf);
+	fcntl (instance->recSock, F_SETFL, fcntl (instance->recSock, F_GETFL) | O_NONBLOCK);
+
+	// Writable means the connect finished, one way or the other.
+	ev.events = EPOLLOUT;
+	ev.data.ptr = instance;
+	epoll_ctl (rcvr_epfd, EPOLL_CTL_ADD, instance->recSock, &ev);
+
+	if (connect (instance->recSock, (struct sockaddr *) &instance->adr_srvr, instance->len_inet) == 0)
+		return connected (instance);
+
+	if (errno != EINPROGRESS){
+		if (has_connected == 1) printf ("connect to %s failed %s\n", instance->host, strerror (errno));
+		stopReceiver ((char *) instance);
+		return -1;
+	}
+
+	instance->state = RCVR_CONNECTING;
+	instance->deadline = nowMs () + CONNECT_TIMEOUT_MS;
+	return 0;
+}
+
+/*----------------------------------------------------------------------*/
+
+int32_t finishConnect (struct rcvrInstance *instance)
+{
+	int32_t err = 0;
+	socklen_t len = sizeof (err);
+
+	getsockopt (instance->recSock, SOL_SOCKET, SO_ERROR, &err, &len);
+	if (err != 0){
+		if (has_connected == 1) printf ("connect to %s failed %s\n", instance->host, strerror (err));
+		stopReceiver ((char *) instance);
+		return -1;
+	}
+	return connected (instance);
+}
+
+/*----------------------------------------------------------------------*/
+
+/* A complete reply header is in instance->firstreply.
+ * Returns 0 if a payload of instance->recsize bytes follows, 1 if the
+ * reply carried no data, and -1 if the connection was dropped.
+ */
+int32_t replyHeader (struct rcvrInstance *instance)
+{
+	int32_t temptype;
+	int32_t numrecs = 0;
+
+	temptype = ntohl (instance->firstreply.type) & 0x000000FF;
+
+	/* streamed summaries carry a sequence number in recs; otherwise the same */
+	if (temptype == SERVER_STREAM_SUMMARY){
+		if (ntohl (instance->firstreply.recs) != instance->nextseq){
+			printf ("%s: sequence error, expected %u got %u\n", instance->host, instance->nextseq, ntohl (instance->firstreply.recs));
+			instance->seqerrs++;
+		}
+		instance->nextseq = ntohl (instance->firstreply.recs) + 1;
+		temptype = SERVER_SUMMARY;
+	}
+
+	if (temptype == SERVER_SUMMARY){
+
+		if (debug > 0) printf ("SERVER_SUMMARY | socket %d \n", instance->recSock);
+
+		// for dgs- this is total size of data to get. not size of each indiv. record.
+		instance->recsize = ntohl (instance->firstreply.recLen);
+		numrecs = ntohl (instance->firstreply.recs);
+
+		if (debug > 0) printf ("recsize =%d numrecs =%d\n", instance->recsize, numrecs);
+
+		if (instance->recsize < 0 || instance->recsize > DATA_MEM_SIZE){
+			printf ("%s: illegal recsize %d, dropping connection\n", instance->host, instance->recsize);
+			stopReceiver ((char *) instance);
+			return -1;
+		}
+
+		/* ask for the next data */
+		if (replyReceived (instance, temptype) < 0)
+			return -1;
+
+		instance->bytesret = 0;
+		instance->slot = rcvRingGetFree (instance->recsize);
+		instance->slot->from = instance;
+		return 0;
+
+	}else if (temptype == INSUFF_DATA){
+
+		if (debug > 2) printf ("received INSUFF_DATA\n");
+
+		/* ask again, after a pause (see replyReceived) */
+		instance->hdrbytes = 0;
+		instance->replyreads = 0;
+		if (replyReceived (instance, temptype) < 0)
+			return -1;
+		return 1;
+
+	}else{
+		/* No point in asking for more; we are bailing out */
+		if (temptype == SERVER_SENDER_OFF){
+			instance->nsenderoff++;
+			if (debug > 0) printf ("temptype == SERVER_SENDER_OFF\n");
+		}else{
+			printf ("Illegal first packet type %d\n", temptype);
+		}
+
+		if (debug > 0) printf ("to close socket\n");
+
+		stopReceiver ((char *) instance);
+		return -1;
+	}
+}
+
+/*----------------------------------------------------------------------*/
+
+/* The whole payload is in instance->slot; hand it to the writer. */
+void payloadDone (struct rcvrInstance *instance)
+{
+	replyDrained (instance);
+	instance->hdrbytes = 0;
+	instance->slot->len = instance->recsize;
+	instance->slot->tkernel = instance->tkernel;
+	instance->slot->treceived = nowRealNs ();
+	instance->tkernel = 0;
+	if (instance->recsize > 0)
+		rcvRingPutFull (instance->slot);
+	else
+		rcvRingRelease (instance->slot, 0);
+	instance->slot = NULL;
+}
+
+/*----------------------------------------------------------------------*/
+
+/* read() that also picks up the kernel receive time (SO_TIMESTAMPNS) of the
+ * last segment it returned, into instance->tkernel.
+ */
+ssize_t rcvRead (struct rcvrInstance *instance, void *buf, size_t len)
+{
+	char control[CMSG_SPACE (sizeof (struct timespec))];
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	struct timespec ts;
+	ssize_t n;
+
+	iov.iov_base = buf;
+	iov.iov_len = len;
+	memset (&msg, 0, sizeof (msg));
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = control;
+	msg.msg_controllen = sizeof (control);
+
+	n = recvmsg (instance->recSock, &msg, 0);
+	if (n > 0)
+		for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg))
+			if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS)
+				{
+					memcpy (&ts, CMSG_DATA (cmsg), sizeof (ts));
+					instance->tkernel = (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+				}
+	return n;
+}
+
+/*----------------------------------------------------------------------*/
+
+/* Advance one connection as far as the data already in the socket allows.
+ * Returns 0 when a complete buffer has been queued on the ring, 1 when the
+ * socket would block first, and -1 if the connection was dropped.
+ */
+int32_t getReceiverData2 (char *instancechar) {
+
+	struct rcvrInstance *instance;
+	int32_t st;
+	int32_t numret = 0;
+	uint32_t i;
 	if (debug > 2) printf ("getReceiverData2\n");
 
 
@@ -499,251 +2300,387 @@ int32_t getReceiverData2 (char *instancechar, int8_t **retptr, int32_t *readsize
         return -1;
     }
 
-	if (instance->recSock == -1){
+	if (instance->recSock == -1)
+		return -1;
 
-        instance->recSock = socket (AF_INET, SOCK_STREAM, 0);
+	while (1){
 
+		if (instance->hdrbytes < (int32_t)(sizeof (evtServerRetStruct))){
 
-        if (instance->recSock == -1){
-            printf ("Unable to open socket.\n");
-            return -1;
-        }
+			numret = rcvRead (instance, ((char *) &instance->firstreply.type) + instance->hdrbytes, sizeof (evtServerRetStruct) - instance->hdrbytes);
 
-        setsocketoption(instance->recSock);
+			if (numret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				return 1;
+			if (numret <= 0){
+				printf ("%s: read returned %d\n", instance->host, numret);
+				instance->nreaderrors++;
+				stopReceiver ((char *) instance);
+				return -1;
+			}
 
-        if (connect (instance->recSock, (struct sockaddr *) &instance->adr_srvr, instance->len_inet) < 0){
-            if (has_connected == 1) printf ("connect failed %s\n", strerror (errno));
-            close (instance->recSock);
-            instance->recSock = -1;
-            return -1;
-        }
+			replyRead (instance);
+			instance->hdrbytes += numret;
 
-        // MBO 20200616: Let's try queueing up 6 requests:
-        request.type = htonl (CLIENT_REQUEST_EVENTS);
-        #ifndef __WIN32__
-			if (write (instance->recSock, &request, sizeof (struct reqPacket)) < 0)
-        #else
-			if (send (instance->recSock, (char*)&request, sizeof (struct reqPacket), 0) < 0)
-        #endif
-            {
-                printf ("request send failed\n");
-                close (instance->recSock);
-                instance->recSock = -1;
-                return -1;
-            }
-        request.type = htonl (CLIENT_REQUEST_EVENTS);
-        #ifndef __WIN32__
-            if (write (instance->recSock, &request, sizeof (struct reqPacket)) < 0)
-        #else
-            if (send (instance->recSock, (char*)&request, sizeof (struct reqPacket), 0) < 0)
-        #endif
-            {
-                printf ("request send failed\n");
-                close (instance->recSock);
-                instance->recSock = -1;
-                return -1;
-            }
-        request.type = htonl (CLIENT_REQUEST_EVENTS);
-        #ifndef __WIN32__
-            if (write (instance->recSock, &request, sizeof (struct reqPacket)) < 0)
-        #else
-            if (send (instance->recSock, (char*)&request, sizeof (struct reqPacket), 0) < 0)
-        #endif
-            {
-                printf ("request send failed\n");
-                close (instance->recSock);
-                instance->recSock = -1;
-                return -1;
-            }
-        request.type = htonl (CLIENT_REQUEST_EVENTS);
-        #ifndef __WIN32__
-            if (write (instance->recSock, &request, sizeof (struct reqPacket)) < 0)
-        #else
-            if (send (instance->recSock, (char*)&request, sizeof (struct reqPacket), 0) < 0)
-        #endif
-            {
-                printf ("request send failed\n");
-                close (instance->recSock);
-                instance->recSock = -1;
-                return -1;
-            }
-        request.type = htonl (CLIENT_REQUEST_EVENTS);
-        #ifndef __WIN32__
-            if (write (instance->recSock, &request, sizeof (struct reqPacket)) < 0)
-        #else
-            if (send (instance->recSock, (char*)&request, sizeof (struct reqPacket), 0) < 0)
-        #endif
-            {
-                printf ("request send failed\n");
-                close (instance->recSock);
-                instance->recSock = -1;
-                return -1;
-            }
-        request.type = htonl (CLIENT_REQUEST_EVENTS);
-        #ifndef __WIN32__
-            if (write (instance->recSock, &request, sizeof (struct reqPacket)) < 0)
-        #else
-            if (send (instance->recSock, (char*)&request, sizeof (struct reqPacket), 0) < 0)
-        #endif
-            {
-                printf ("request send failed\n");
-                close (instance->recSock);
-                instance->recSock = -1;
-                return -1;
-            }else{
-                if (debug > 0) {
-                    printf (" sent request data=");
-                    for(i=0; i < (sizeof (struct reqPacket)); i++)
-                        printf ("%02X ", ((char *) &request)[i]);
-                    printf ("\n");
-                }
-            }
+			if (debug > 2){
+				printf ("received bytes=%d\n", numret);
+				printf ("received data=");
+				for(i=0;i < (sizeof (struct reqPacket)); i++)
+					printf ("%02X ", (((char*)((void *)(&instance->firstreply.type))) + instance->hdrbytes)[i]);
+				printf ("\n");
+			}
+
+			if (instance->hdrbytes < (int32_t)(sizeof (evtServerRetStruct)))
+				continue;
+
+			st = replyHeader (instance);
+			if (st != 0)
+				return st;
 		}
 
-	while (bytesret < (int32_t)(sizeof (evtServerRetStruct))){
-		//	if (debug > 0)
-        //	 printf ("to read socket\n");
+		/* if you got here, there is data to be read */
+		//deg recsize is total butes to read.. not size of one rec.
+		if (instance->bytesret < instance->recsize){
 
-        #ifndef __WIN32__
-        numret = read (instance->recSock, ((char *) &firstreply.type) + bytesret, sizeof (evtServerRetStruct) - bytesret);
-        #else
-        numret = recv (instance->recSock, ((char *) &firstreply.type) + bytesret, sizeof (evtServerRetStruct) - bytesret, 0);
-        #endif
-        if (numret <= 0){
-            if (debug > 0)printf ("Error, no more data: need: %d total: %d\n", (int32_t)(sizeof (evtServerRetStruct)) - (int32_t)(bytesret), (uint32_t)(sizeof (evtServerRetStruct)));
-            break;
-        }else{
-            bytesret += numret;
-
-            if (debug > 2){
-                printf ("received bytes=%d\n", numret);
-                printf ("received data=");
-                for(i=0;i < (sizeof (struct reqPacket)); i++)
-                    printf ("%02X ", (((char*)((void *)(&firstreply.type))) + bytesret)[i]);
-                printf ("\n");
-            }
+			numret = rcvRead (instance, instance->slot->data + instance->bytesret, instance->recsize - instance->bytesret);
 
-        }
-    }
+			if (debug > 0) printf ("got %d bytes	\n", numret);
 
+			if (numret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				return 1;
 
-	if (numret <= 0){
-        printf ("read returned %d\n", numret);
-        return -1;
-    }
+			if (numret == 0){
+				printf (" End of file! \n");
+				instance->nreaderrors++;
+				stopReceiver ((char *) instance);
+				return -1;
+			}
 
-    temptype = ntohl (firstreply.type) & 0x000000FF;
+			if (numret < 0){
+				printf ("read returned %d\n", numret);
+				instance->nreaderrors++;
+				stopReceiver ((char *) instance);
+				return -1;
+			}
 
-	if (temptype == SERVER_SUMMARY){
+			replyRead (instance);
+			instance->bytesret += numret;
+			instance->bytesrec += numret;
+			instance->packetsreceived++;
+		}
 
-        if (debug > 0) printf ("SERVER_SUMMARY | socket %d \n", instance->recSock);
+		if (instance->bytesret == instance->recsize){
+			payloadDone (instance);
+			return 0;
+		}
+	}
+}
 
-        // for dgs- this is total size of data to get. not size of each indiv. record.
-        recsize = ntohl (firstreply.recLen);
-        numrecs = ntohl (firstreply.recs);
+/*----------------------------------------------------------------------*/
 
-        if (debug > 0) printf ("recsize =%d numrecs =%d\n", recsize, numrecs);
+/* Start the connects that are due, give up on those that took too long,
+ * and send the requests held back after INSUFF_DATA once they are due.
+ * Returns how long the caller may sleep until the next deadline, in ms.
+ */
+int32_t connectionTimers (int32_t (*start) (struct rcvrInstance *))
+{
+	struct rcvrInstance *instance;
+	int64_t now, wait;
+	int32_t i;
 
+	now = nowMs ();
+	wait = IDLE_WAIT_MS;
+	for (i = 0; i < nrcvr; i++)
+		{
+			instance = rcvr[i];
+			if (instance->state == RCVR_CONNECTING && now >= instance->deadline)
+				{
+					if (has_connected == 1) printf ("connect to %s timed out\n", instance->host);
+					stopReceiver ((char *) instance);
+				}
+			if (instance->state == RCVR_DISCONNECTED && now >= instance->deadline)
+				start (instance);
+			if (instance->state == RCVR_CONNECTED && instance->held && now >= instance->deadline)
+				{
+					instance->held = 0;
+					if (instance->outstanding < instance->window)
+						sendRequests (instance, instance->window - instance->outstanding);
+				}
+			if ((instance->state != RCVR_CONNECTED || instance->held) && instance->deadline - now < wait)
+				wait = instance->deadline - now;
+		}
+	return wait < 0 ? 0 : wait;
+}
 
-        /* ask for the next data */
-        request.type = htonl (CLIENT_REQUEST_EVENTS);
+/*----------------------------------------------------------------------*/
 
+// BUFFERS_PER_WAKEUP: Complete buffers taken from one connection before
+//  moving on to the next ready one, so a busy IOC cannot starve the others.
+#define BUFFERS_PER_WAKEUP 4
 
-    #ifndef __WIN32__
-        if (write (instance->recSock, &request, sizeof (struct reqPacket)) < 0)
-    #else
-        if (send (instance->recSock, (char*)&request, sizeof (struct reqPacket), 0) < 0)
-    #endif
-        {
-            printf ("request send failed\n");
-            close (instance->recSock);
-            instance->recSock = -1;
-            return -1;
-        }
-    }else{
-        if (temptype == INSUFF_DATA){
+/* Serve every IOC connection from the one epoll set.  Sleeps in epoll_wait
+ * until a socket is ready or a connection deadline is due, so data is picked
+ * up as soon as it arrives and an idle receiver uses no CPU.
+ * Returns the number of complete buffers queued.
+ */
+int32_t getReceiverDataAll (void)
+{
+	struct epoll_event events[MAXIOC];
+	struct rcvrInstance *instance;
+	int32_t i, n, nready, timeout, queued = 0;
 
-            if (debug > 2) printf ("received INSUFF_DATA\n");
+	if (rcvr_epfd == -1)
+		rcvr_epfd = epoll_create1 (0);
 
-            /* go ahead and ask again */
-            request.type = htonl (CLIENT_REQUEST_EVENTS);
-        #ifndef __WIN32__
-            if (write (instance->recSock, &request, sizeof (struct reqPacket)) < 0)
-        #else
-            if (send (instance->recSock, (char*)&request, sizeof (struct reqPacket), 0) < 0)
-        #endif
-            {
-                printf ("request send failed\n");
-                close (instance->recSock);
-                instance->recSock = -1;
-                return -1;
-            }
-            return -1;
-        }else{
-            /* No point in asking for more; we arecsize =16re bailing out */
-            if (temptype == SERVER_SENDER_OFF){
-                if (debug > 0) printf ("temptype == SERVER_SENDER_OFF\n");
-            }else{
-                printf ("Illegal first packet type %d\n", temptype);
-            }
+	timeout = connectionTimers (connectReceiver);
+	if (low_latency)
+		timeout = 0;							 /* spin: no wakeup latency */
 
-            if (debug > 0) printf ("to close socket\n");
+	nready = epoll_wait (rcvr_epfd, events, MAXIOC, timeout);
 
-            close (instance->recSock);
-            instance->recSock = -1;
-            return -1;
-        }
-    }
+	for (i = 0; i < nready; i++){
+		instance = (struct rcvrInstance *) events[i].data.ptr;
 
-	/* if you got here, there is data to be read */
-//!!
-	//recsperbuf = INBUFSIZE / (recsize * 4);
+		if (instance->state == RCVR_CONNECTING){
+			finishConnect (instance);
+			continue;
+		}
 
-//deg recsize is total butes to read.. not size of one rec.
-	numbytesleft = recsize;
+		// Level triggered, so whatever is left is reported again next time.
+		for (n = 0; n < BUFFERS_PER_WAKEUP; n++)
+			if (getReceiverData2 ((char *) instance) != 0)
+				break;
+		queued += n;
+	}
 
-	if (debug > 0) printf ("there is data to be read-numbytesleft =%d \n", numbytesleft);
+	return queued;
+}
 
-	bytesret = 0;
-	while (bytesret < numbytesleft){
 
-	//		if (debug > 0)
-	 //		 printf ("to read data \n");
-    #ifndef __WIN32__
-        numret = read (instance->recSock, datamem + bytesret, numbytesleft - bytesret);
-    #else
-        numret = recv (instance->recSock, (char*)(datamem + bytesret), numbytesleft - bytesret, 0);
-    #endif
+/*----------------------------------------------------------------------*/
+
+/* io_uring receive engine (-u).  Each connection always has exactly one
+ * operation in flight: its connect (with a linked timeout), a receive of
+ * the reply header, or a receive of the payload straight into its ring
+ * buffer.  Ring buffers are registered as fixed buffers, so payload
+ * receives skip the per-call page pinning.  The state handling is shared
+ * with getReceiverData2.  user_data carries the connection's generation,
+ * its index in rcvr[] and the tag, so a completion of a connection that
+ * was since replaced is recognized and dropped.
+ */
+#define UR_CONNECT 1
+#define UR_HEADER 2
+#define UR_PAYLOAD 3
+#define UR_TIMEOUT 4
+#define UR_TAG_MASK 7
+#define UR_TAG_BITS 3
+
+static inline uint64_t urData (struct rcvrInstance *instance, int32_t tag)
+{
+	return ((uint64_t) instance->urgen << 32) | ((uint64_t) instance->index << UR_TAG_BITS) | tag;
+}
 
-        if (debug > 0) printf ("got %d bytes	\n", numret);
+struct uring rxring;
+int8_t rx_registered = 0;
 
-        if (numret <= 0){
-            break;
-        } else{
-            bytesret += numret;
-            instance->bytesrec += bytesret;
-            instance->packetsreceived++;
-        }
-    }
+int32_t uringPost (struct rcvrInstance *instance, int32_t tag)
+{
+	struct io_uring_sqe *sqe;
+	struct iovec iov;
+	int32_t idx;
+	uint32_t need = (tag == UR_CONNECT) ? 2 : 1;
+
+	// a connect and its timeout go in together, so both SQEs are reserved first
+	if (uringSqSpace (&rxring) < need)
+		uringSubmit (&rxring, 0, 0);
+	if (uringSqSpace (&rxring) < need)
+		{
+			printf ("%s: io_uring submission queue full, dropping connection\n", instance->host);
+			stopReceiver ((char *) instance);
+			return -1;
+		}
+	sqe = uringGetSqe (&rxring);
+	sqe->fd = instance->recSock;
+	sqe->user_data = urData (instance, tag);
+	instance->urbusy = 1;
+
+	if (tag == UR_CONNECT)
+		{
+			static struct __kernel_timespec connect_timeout = { CONNECT_TIMEOUT_MS / 1000, (CONNECT_TIMEOUT_MS % 1000) * 1000000 };
+
+			sqe->opcode = IORING_OP_CONNECT;
+			sqe->addr = (uint64_t) (uintptr_t) &instance->adr_srvr;
+			sqe->off = instance->len_inet;
+			sqe->flags |= IOSQE_IO_LINK;
+
+			// cancels the connect with -ECANCELED if it takes too long
+			sqe = uringGetSqe (&rxring);
+			sqe->opcode = IORING_OP_LINK_TIMEOUT;
+			sqe->fd = -1;
+			sqe->addr = (uint64_t) (uintptr_t) &connect_timeout;
+			sqe->len = 1;
+			sqe->user_data = urData (instance, UR_TIMEOUT);
+		}
+	else if (tag == UR_HEADER)
+		{
+			sqe->opcode = IORING_OP_RECV;
+			sqe->addr = (uint64_t) (uintptr_t) ((char *) &instance->firstreply + instance->hdrbytes);
+			sqe->len = sizeof (evtServerRetStruct) - instance->hdrbytes;
+		}
+	else
+		{
+			idx = instance->slot - ring.slot;
+			if (rx_registered && instance->slot->registered != instance->slot->size)
+				{
+					// the buffer was grown since it was last registered
+					iov.iov_base = instance->slot->data;
+					iov.iov_len = instance->slot->size;
+					if (uringUpdateBuffer (&rxring, idx, &iov) < 0)
+						rx_registered = 0;
+					else
+						instance->slot->registered = instance->slot->size;
+				}
+			sqe->opcode = rx_registered ? IORING_OP_READ_FIXED : IORING_OP_RECV;
+			sqe->buf_index = idx;
+			sqe->off = (uint64_t) -1;
+			sqe->addr = (uint64_t) (uintptr_t) (instance->slot->data + instance->bytesret);
+			sqe->len = instance->recsize - instance->bytesret;
+		}
+	return 0;
+}
+
+/*----------------------------------------------------------------------*/
+
+int32_t uringConnect (struct rcvrInstance *instance)
+{
+	instance->nattempts++;
+	instance->urgen++;
+	instance->recSock = socket (AF_INET, SOCK_STREAM, 0);
+	if (instance->recSock == -1)
+		{
+			printf ("Unable to open socket.\n");
+			stopReceiver ((char *) instance);
+			return -1;
+		}
+	instance->rcvbufset = setsocketoption (instance->recSock, instance->rcvbuf);
+	instance->state = RCVR_CONNECTING;
+	// the linked timeout ends the connect, so there is no deadline to watch
+	instance->deadline = INT64_MAX;
+	return uringPost (instance, UR_CONNECT);
+}
+
+/*----------------------------------------------------------------------*/
+
+void *uringReceiveLoop (void *arg)
+{
+	struct io_uring_cqe *cqe;
+	struct rcvrInstance *instance;
+	int32_t tag, res, st, timeout;
+	uint32_t gen;
+
+	(void) arg;
+	while (1)
+		{
+			timeout = connectionTimers (uringConnect);
+
+			// sleep until something completes or a reconnect is due (-L: just look)
+			if (low_latency)
+				uringSubmit (&rxring, 0, 0);
+			else
+				uringSubmit (&rxring, 1, (int64_t) (timeout > 0 ? timeout : 1) * 1000000);
+
+			while ((cqe = uringPeekCqe (&rxring)) != NULL)
+				{
+					instance = rcvr[(uint32_t) cqe->user_data >> UR_TAG_BITS];
+					tag = cqe->user_data & UR_TAG_MASK;
+					gen = cqe->user_data >> 32;
+					res = cqe->res;
+					uringCqeSeen (&rxring);
+
+					// timeouts, and whatever an earlier connection left behind
+					if (tag == UR_TIMEOUT || gen != instance->urgen)
+						continue;
+
+					instance->urbusy = 0;
+					if (instance->urclosing)
+						{
+							instance->urclosing = 0;
+							stopReceiver ((char *) instance);
+							continue;
+						}
+
+					if (tag == UR_CONNECT)
+						{
+							if (res < 0)
+								{
+									if (has_connected == 1) printf ("connect to %s failed %s\n", instance->host, strerror (res == -ECANCELED ? ETIMEDOUT : -res));
+									stopReceiver ((char *) instance);
+									continue;
+								}
+							if (linkUp (instance) == 0)
+								uringPost (instance, UR_HEADER);
+							continue;
+						}
+
+					if (res <= 0)
+						{
+							printf ("%s: read returned %d\n", instance->host, res);
+							instance->nreaderrors++;
+							stopReceiver ((char *) instance);
+							continue;
+						}
+
+					if (tag == UR_HEADER)
+						{
+							replyRead (instance);
+							instance->hdrbytes += res;
+							if (instance->hdrbytes < (int32_t)(sizeof (evtServerRetStruct)))
+								{
+									uringPost (instance, UR_HEADER);
+									continue;
+								}
+							st = replyHeader (instance);
+							if (st < 0)
+								continue;
+							if (st == 1 || instance->recsize > 0)
+								{
+									uringPost (instance, st == 1 ? UR_HEADER : UR_PAYLOAD);
+									continue;
+								}
+						}
+					else
+						{
+							replyRead (instance);
+							instance->bytesret += res;
+							instance->bytesrec += res;
+							instance->packetsreceived++;
+							if (instance->bytesret < instance->recsize)
+								{
+									uringPost (instance, UR_PAYLOAD);
+									continue;
+								}
+						}
+
+					payloadDone (instance);
+					has_connected = 1;
+					uringPost (instance, UR_HEADER);
+				}
+		}
+	return NULL;
+}
 
-	if (numret == 0){
-        printf (" End of file! \n");
-        close (instance->recSock);
-        instance->recSock = -1;
-        return -1;
-    }
-	
-    if (numret < 0){
-        printf ("read returned %d\n", numret);
-        return -1;
-    }
+/*----------------------------------------------------------------------*/
 
-	*retptr = datamem;
-	*readsize = recsize;
-	return 0;
+/* Connection health of one IOC, with the current outage if there is one. */
+void printLink (const char *label, struct rcvrInstance *instance)
+{
+	printf ("%s: %i connects, %i lost, %i read errors, %i attempts; %i requests and %.3f MB lost, down %.1f s",
+			label, instance->nconnects, instance->ndisconnects, instance->nreaderrors, instance->nattempts,
+			instance->requestslost, instance->byteslost / 1e6, instance->downms / 1e3);
+	if (instance->state != RCVR_CONNECTED && instance->downsince)
+		printf (", down for %.1f s now", (nowMs () - instance->downsince) / 1e3);
+	printf ("\n");
 }
 
-
 /*----------------------------------------------------------------------*/
 
 int32_t
@@ -757,11 +2694,144 @@ printPackets (char *instancechar)
 	printf ("Packets received, sent, diff, seqerrs, bytesrec	= %d %d %d %d %d\n",
 					instance->packetsreceived, instance->packetssent,
 					instance->packetsreceived - instance->packetssent, instance->seqerrs, instance->bytesrec);
+	printf ("Request window, summary, full, insuff_data, sender_off	= %d %d %d %d %d\n",
+					instance->window, instance->nsummary, instance->nfull, instance->ninsuff, instance->nsenderoff);
+	printDrain ("Socket", &instance->total, instance->rcvbufset);
+	printLat ("Request to summary round trips", &instance->rtt);
+	printLink ("Connection", instance);
 	return 0;
 }
 
 /*----------------------------------------------------------------------*/
 
+/* Where each buffer spent its time, from the kernel receiving its last
+ * segment to writeEvents2 being done with it (the data is then in the file
+ * buffers).  Filled and read on the writer thread only.
+ */
+#define STAGE_KERNEL 0									 /* kernel receive to receive thread done */
+#define STAGE_QUEUE 1									 /* waiting on the ring for the writer */
+#define STAGE_WRITE 2									 /* parse and write */
+#define STAGE_TOTAL 3									 /* kernel receive (or receive thread) to written */
+#define NSTAGES 4
+
+const char *stage_name[NSTAGES] = { "kernel", "queue", "write", "total" };
+struct latHist stage_run[NSTAGES], stage_interval[NSTAGES];
+
+void stageAdd (int32_t stage, int64_t ns)
+{
+	latAdd (&stage_run[stage], ns);
+	latAdd (&stage_interval[stage], ns);
+}
+
+void stagesDone (struct rcvBuffer *buf, int64_t tparse, int64_t tdone)
+{
+	// the io_uring engine has no kernel stamps
+	if (buf->tkernel)
+		stageAdd (STAGE_KERNEL, buf->treceived - buf->tkernel);
+	stageAdd (STAGE_QUEUE, tparse - buf->treceived);
+	stageAdd (STAGE_WRITE, tdone - tparse);
+	stageAdd (STAGE_TOTAL, tdone - (buf->tkernel ? buf->tkernel : buf->treceived));
+}
+
+/* One line per stage for the summary, then start the next interval. */
+void printStages (void)
+{
+	int32_t i;
+
+	for (i = 0; i < NSTAGES; i++)
+		if (stage_interval[i].n)
+			{
+				printf ("  %-6s p50 %8.3f  p99 %8.3f  max %8.3f ms\n", stage_name[i],
+						latPercentile (&stage_interval[i], 500) / 1e6, latPercentile (&stage_interval[i], 990) / 1e6,
+						stage_interval[i].max / 1e6);
+				stage_interval[i].reset = 1;
+			}
+}
+
+/* The whole run: percentiles, then the populated bins of each stage. */
+void dumpStages (void)
+{
+	static const int32_t permille[] = { 500, 900, 990, 999 };
+	int32_t i, j;
+	int64_t sum;
+
+	printf ("Buffer latency over the run, ms:\n");
+	printf ("  %-6s %10s %9s %9s %9s %9s %9s\n", "stage", "buffers", "p50", "p90", "p99", "p99.9", "max");
+	for (i = 0; i < NSTAGES; i++)
+		{
+			if (stage_run[i].n == 0)
+				continue;
+			printf ("  %-6s %10i", stage_name[i], stage_run[i].n);
+			for (j = 0; j < 4; j++)
+				printf (" %9.3f", latPercentile (&stage_run[i], permille[j]) / 1e6);
+			printf (" %9.3f\n", stage_run[i].max / 1e6);
+		}
+	for (i = 0; i < NSTAGES; i++)
+		{
+			if (stage_run[i].n == 0)
+				continue;
+			printf ("%s histogram (from ms, buffers, cumulative %%):\n", stage_name[i]);
+			for (j = 0, sum = 0; j < LAT_BINS; j++)
+				if (stage_run[i].count[j])
+					{
+						sum += stage_run[i].count[j];
+						printf ("  %12.6f %10i %7.3f\n", latBinStart (j) / 1e6, stage_run[i].count[j], 100.0 * sum / stage_run[i].n);
+					}
+		}
+}
+
+/* -j: writer threads.  Each received buffer is indexed once, then every
+ * thread writes the packets of the boards in its shard (board % nwriters).
+ * A file has exactly one writer, so the FILE handles need no locks and each
+ * channel keeps its packets in order.  The writer thread itself is shard 0.
+ */
+struct writerShard
+{
+	int32_t ret;									 /* writeShard return */
+	int32_t written;								 /* bytes written from this buffer */
+	int32_t closed;									 /* a board was closed */
+	int64_t busyns, bytes;							 /* this interval */
+};
+
+struct writerShard shards[WRITE_THREADS_MAX];
+pthread_barrier_t shard_start, shard_done;
+int8_t writer_failed = 0;
+int8_t *shard_buffer;
+int32_t shard_size;
+struct dgsHeaders shard_index;
+
+/* -R: corrupt stretches skipped, their bytes, and the packets after them
+ * that would have been dropped with the rest of the buffer.
+ */
+int64_t resync_count = 0, resync_skipped = 0, resync_recovered = 0;
+
+void printResync (void)
+{
+	if (resync)
+		printf ("  resync: %" PRId64 " corrupt stretches, %" PRId64 " bytes skipped, %" PRId64 " packets recovered\n",
+				resync_count, resync_skipped, resync_recovered);
+}
+
+/* Time each writer thread spent on its shard, and what it wrote. */
+void printShards (void)
+{
+	int32_t i;
+	int64_t elapsed;
+	static int64_t last = 0;
+
+	elapsed = nowNs () - last;
+	last += elapsed;
+	if (nwriters < 2)
+		return;
+	for (i = 0; i < nwriters; i++)
+		{
+			printf ("  shard %2i busy %5.1f%%  %8.2f MB\n", i, 100.0 * shards[i].busyns / elapsed, shards[i].bytes / 1e6);
+			shards[i].busyns = shards[i].bytes = 0;
+		}
+}
+
+/*----------------------------------------------------------------------*/
+
 int32_t
 print_info (int64_t totbytes)
 {
@@ -774,10 +2844,6 @@ print_info (int64_t totbytes)
 	int32_t i1, i;
 	time_t ticks;
 
-	#ifdef FILE_PER_CHANNEL	// MBO 20200616:
-		int32_t j;
-	#endif
-
 	if (firsttime)
 		{
 			firsttime = 0;
@@ -808,35 +2874,18 @@ print_info (int64_t totbytes)
 	printf ("%7.0f KB/s; ", (float) r1);
 	r1 = (double) (totbytes) / (double) (1024) / (double) (tnow - tstart);
 	printf ("AVG: %7.0f KB/s; ", (float) r1);
+	printf ("ring: %i/%i peak %i stalls %" PRId64 "; ", ring.inuse, ring.nslots, ring.maxinuse, ring.stalls);
 
-	#ifdef SINGLE_FILE
-	#else
-		#ifdef FILE_PER_CHANNEL	// MBO 20200616:
-			for (i = 0; i < MAXBOARDID; i++)
-				for (j = 0; j < MAXCHID; j++)
-					if (FILE_OPEN_CHECK(ofile[i][j]))
-						printf ("%i-%i ",i,j);
-		#else
-			for (i = 0; i < MAXBOARDID; i++)
-				if (FILE_OPEN_CHECK(ofile[i]))
-					printf ("%i ",i);
-		#endif
-	#endif
+	if (file_layout != FILES_SINGLE)
+		for (i = 1; i <= nslots; i++)
+			if (slotOpen (&slots[i]))
+				print_slot_id (&slots[i]);
 
     #ifdef DEBUG_OUTPUT_FILE
-        #ifdef SINGLE_FILE
-        #else
-            #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                for (i = 0; i < MAXBOARDID; i++)
-                    for (j = 0; j < MAXCHID; j++)
-                        if (FILE_OPEN_CHECK(diag_ofile[i][j]))
-                            printf ("%i-%i ",i,j);
-            #else
-                for (i = 0; i < MAXBOARDID; i++)
-                    if (FILE_OPEN_CHECK(diag_ofile[i]))
-                        printf ("%i ",i);
-            #endif
-        #endif
+        if (file_layout != FILES_SINGLE)
+            for (i = 1; i <= nslots; i++)
+                if (slots[i].diag_ofile)
+                    print_slot_id (&slots[i]);
     #endif // DEBUG_OUTPUT_FILE
 
 	/* prime for next */
@@ -855,6 +2904,26 @@ print_info (int64_t totbytes)
 	else
 		printf ("runtime: %ih %4.1fm\n", i1, (float) r1);
 
+	/* request window and reply mix per IOC */
+
+	for (i = 0; i < nrcvr; i++)
+		{
+			printf ("  %s: window %i; %i summary (%i full), %i insuff_data\n", rcvr[i]->host,
+					rcvr[i]->window, rcvr[i]->nsummary, rcvr[i]->nfull, rcvr[i]->ninsuff);
+			// the receive thread starts the next interval with its next reply
+			printDrain ("    socket", &rcvr[i]->interval, rcvr[i]->rcvbufset);
+			printLat ("    round trips", &rcvr[i]->rttinterval);
+			if (rcvr[i]->ndisconnects || rcvr[i]->state != RCVR_CONNECTED)
+				printLink ("    link", rcvr[i]);
+			rcvr[i]->interval.reset = 1;
+			rcvr[i]->rttinterval.reset = 1;
+		}
+	printStages ();
+	printShards ();
+	printIO ();
+	printPace ();
+	printResync ();
+
 	/* done */
 
 	fflush (stdout);
@@ -864,8 +2933,18 @@ print_info (int64_t totbytes)
 
 /*----------------------------------------------------------------------*/
 
-void
-set_readonly ()
+/* "close board file 12-3", "... 12" or "...", as the file layout goes. */
+void print_slot (const char *what, struct slotState *sl)
+{
+	if (file_layout == FILES_SINGLE)
+		printf ("%s\n", what);
+	else if (file_layout == FILES_PER_CHANNEL)
+		printf ("%s %i-%i\n", what, sl->board, sl->ch);
+	else
+		printf ("%s %i\n", what, sl->board);
+}
+
+void set_file_readonly (char *str)
 {
 
 	/* declarations */
@@ -873,333 +2952,409 @@ set_readonly ()
     #ifndef __WIN32__
         int32_t st;
     #endif // __WIN32__
-	char str[550];
-
-	#ifdef SINGLE_FILE
-	#else
-		int32_t i;
-		#ifdef FILE_PER_CHANNEL	// MBO 20200616:
-			int32_t j;
-		#endif
-	#endif
 
 	/* specify readonly for everyone */
 
-	#ifdef SINGLE_FILE
-		sprintf (str, "%s", fn);
-		data_fd = open (str, O_RDWR);
-        #ifndef __WIN32__
-            st = fchmod (data_fd, S_IRUSR | S_IRGRP | S_IROTH);
-        #endif // __WIN32__
-		close (data_fd);
-		ofile = 0;
-		printf ("%s is now readonly\n", str);
-	#else
-		#ifdef FILE_PER_CHANNEL	// MBO 20200616:
-			for (i = 0; i < MAXBOARDID; i++)
-				for (j = 0; j < MAXCHID; j++)
-					if (FILE_OPEN_CHECK(ofile[i][j]))
-                    {
-                        sprintf (str, "%s_%4.4i_%1.1i", fn, i, j);
-                        data_fd = open (str, O_RDWR);
-                        #ifndef __WIN32__
-                            st = fchmod (data_fd, S_IRUSR | S_IRGRP | S_IROTH);
-                        #endif // __WIN32__
-                        close (data_fd);
-                        ofile[i][j] = 0;
-                        printf ("%s is now readonly\n", str);
-                    };
-		#else
-			for (i = 0; i < MAXBOARDID; i++)
-				if (FILE_OPEN_CHECK(ofile[i]))
-                {
-                    sprintf (str, "%s_%4.4i", fn, i);
-                    data_fd = open (str, O_RDWR);
-                    #ifndef __WIN32__
-                        st = fchmod (data_fd, S_IRUSR | S_IRGRP | S_IROTH);
-                    #endif // __WIN32__
-                    close (data_fd);
-                    ofile[i] = 0;
-                    printf ("%s is now readonly\n", str);
-                };
-		#endif // FILE_PER_CHANNEL
-	#endif // SINGLE_FILE
+	data_fd = open (str, O_RDWR);
+    #ifndef __WIN32__
+        st = fchmod (data_fd, S_IRUSR | S_IRGRP | S_IROTH);
+    #endif // __WIN32__
+	close (data_fd);
+	printf ("%s is now readonly\n", str);
+}
+
+/*----------------------------------------------------------------------*/
 
+/* Chunk rotation.  When a chunk ends, the writer only hands the open files
+ * of each slot to the chunk thread (slotRetire) and goes on in the next
+ * chunk's files, which the chunk thread opened ahead once the largest file
+ * was PREOPEN_PERCENT full.  The chunk thread writes the old files' tails,
+ * waits for their queued blocks, syncs, closes them and makes them
+ * readonly, so the writers never wait on a close, fsync or chmod.  Files
+ * opened ahead that got no data in their chunk are removed at its end.
+ */
+struct oldFile
+{
+	struct chunkFile f;
+	struct slotState *sl;
+	struct ioBlock *tail;							 /* staged: the last block, written here */
+	int32_t staged;									 /* bytes in it */
+	int64_t length;									 /* -o direct: cut back to this */
+	int64_t qseq;									 /* -q: written once the slot's qdone gets here */
+	int8_t discard;									 /* opened ahead and never written: removed */
+	struct oldFile *next;
+};
+
+pthread_mutex_t chunk_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t chunk_work = PTHREAD_COND_INITIALIZER;
+pthread_cond_t chunk_idle = PTHREAD_COND_INITIALIZER;
+struct oldFile *chunk_old, *chunk_old_tail;				 /* files to finish, in order */
+int32_t chunk_preopen = -1;								 /* chunk to open files ahead for, until done */
+int8_t chunk_busy = 0;									 /* finishing a file */
+int8_t preopen_asked = 0;								 /* writer: in this chunk */
+
+/* Chunk thread: write out the rest of an old file, close it and make it
+ * readonly, or remove it.
+ */
+void chunkFinish (struct oldFile *o)
+{
+	struct slotState *sl = o->sl;
+
+	if (file_io == FILE_IO_STAGED)
+		{
+			if (o->tail)
+				{
+					if (o->staged > 0 && nonblocking_file_write (o->f.ofd, o->tail->data, o->staged) != o->staged)
+						printf ("FILE WRITE ERROR: BOARD: %i CH: %0X, %i bytes lost at close\n", sl->board, sl->ch, o->staged);
+					pthread_mutex_lock (&io_lock);
+					o->tail->next = io_spare;
+					io_spare = o->tail;
+					pthread_mutex_unlock (&io_lock);
+				}
+			if (io_threads > 0)
+				{
+					// the slot's blocks are written in order: wait for the file's last
+					pthread_mutex_lock (&io_lock);
+					while (sl->qdone < o->qseq)
+						pthread_cond_wait (&io_done, &io_lock);
+					pthread_mutex_unlock (&io_lock);
+					if (sl->qerror)
+						printf ("FILE WRITE ERROR: BOARD: %i CH: %0X, queued blocks lost\n", sl->board, sl->ch);
+				}
+			if (direct_io && ftruncate (o->f.ofd, o->length) != 0)
+				printf ("FILE WRITE ERROR: BOARD: %i CH: %0X, cannot cut back to %" PRId64 " bytes\n", sl->board, sl->ch, o->length);
+		}
+	if (o->f.ofile)
+		{
+			fflush (o->f.ofile);
+			if (fileno (o->f.ofile) >= 0)
+				fsync (fileno (o->f.ofile));
+			fclose (o->f.ofile);
+			free (o->f.file_buffer);
+		}
+	else
+		{
+			if (!o->discard)
+				fsync (o->f.ofd);
+			close (o->f.ofd);
+		}
+	if (o->discard)
+		{
+			unlink (o->f.name);
+			printf ("%s got no data, removed\n", o->f.name);
+		}
+	else
+		{
+			print_slot ("close board file", sl);
+			set_file_readonly (o->f.name);
+		}
+	free (o->f.name);
 	#ifdef DEBUG_OUTPUT_FILE
-        #ifdef SINGLE_FILE
-            sprintf (str, "diag_%s", fn);
-            data_fd = open (str, O_RDWR);
-            #ifndef __WIN32__
-                st = fchmod (data_fd, S_IRUSR | S_IRGRP | S_IROTH);
-            #endif // __WIN32__
-            close (data_fd);
-            diag_ofile = 0;
-            printf ("diag_%s is now readonly\n", str);
-        #else
-            #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                for (i = 0; i < MAXBOARDID; i++)
-                    for (j = 0; j < MAXCHID; j++)
-                        if (FILE_OPEN_CHECK(diag_ofile[i][j]))
-                        {
-                            sprintf (str, "diag_%s_%4.4i_%1.1i", fn, i, j);
-                            data_fd = open (str, O_RDWR);
-                            #ifndef __WIN32__
-                                st = fchmod (data_fd, S_IRUSR | S_IRGRP | S_IROTH);
-                            #endif // __WIN32__
-                            close (data_fd);
-                            diag_ofile[i][j] = 0;
-                            printf ("diag_%s is now readonly\n", str);
-                        };
-            #else
-                for (i = 0; i < MAXBOARDID; i++)
-                    if (FILE_OPEN_CHECK(diag_ofile[i]))
-                        {
-                            sprintf (str, "diag_%s_%4.4i", fn, i);
-                            data_fd = open (str, O_RDWR);
-                            #ifndef __WIN32__
-                                st = fchmod (data_fd, S_IRUSR | S_IRGRP | S_IROTH);
-                            #endif // __WIN32__
-                            close (data_fd);
-                            diag_ofile[i] = 0;
-                            printf ("diag_%s is now readonly\n", str);
-                        };
-            #endif // FILE_PER_CHANNEL
-        #endif // SINGLE_FILE
-    #endif // DEBUG_OUTPUT_FILE
-	/* done */
+		if (o->f.diag_ofile)
+			{
+				fclose (o->f.diag_ofile);
+				free (o->f.diag_file_buffer);
+				if (o->discard)
+					unlink (o->f.diag_name);
+				else
+					{
+						print_slot ("close diag board file", sl);
+						set_file_readonly (o->f.diag_name);
+					}
+				free (o->f.diag_name);
+			};
+	#endif // DEBUG_OUTPUT_FILE
+	free (o);
+}
 
-	return;
+/* Chunk thread: open chunk's files for the slots asked for.  The slots
+ * are those handed out when asked (writers may add more meanwhile), and
+ * preopen and next are only touched under chunk_lock.
+ */
+void chunkPreopen (int32_t chunk)
+{
+	char base[512], str[550];
+	struct chunkFile f;
+	struct slotState *sl;
+	int32_t i, n, want, ret;
 
+	pthread_mutex_lock (&slot_lock);
+	n = nslots;
+	pthread_mutex_unlock (&slot_lock);
+
+	chunk_file_name (base, chunk);
+	for (i = 1; i <= n; i++)
+		{
+			sl = &slots[i];
+			pthread_mutex_lock (&chunk_lock);
+			want = sl->preopen;
+			sl->preopen = 0;
+			pthread_mutex_unlock (&chunk_lock);
+			if (!want)
+				continue;
+			if ((ret = chunkFileOpen (&f, base, sl, str)) == 0)
+				{
+					pthread_mutex_lock (&chunk_lock);
+					sl->next = f;
+					pthread_mutex_unlock (&chunk_lock);
+					printf ("Opened %s ahead\n", str);
+				}
+			else
+				printf ("ERROR: %s %s ahead, trying again with its first data\n",
+						(ret == -2) ? "found an existing" : "failed to open", str);
+		}
 }
 
-/*----------------------------------------------------------------------*/
+void *chunkLoop (void *)
+{
+	struct oldFile *o;
+	int32_t chunk;
+
+	pthread_mutex_lock (&chunk_lock);
+	while (1)
+		{
+			if (chunk_preopen >= 0)
+				{
+					chunk = chunk_preopen;
+					pthread_mutex_unlock (&chunk_lock);
+					chunkPreopen (chunk);
+					pthread_mutex_lock (&chunk_lock);
+					chunk_preopen = -1;
+				}
+			else if (chunk_old)
+				{
+					o = chunk_old;
+					chunk_old = o->next;
+					if (!chunk_old)
+						chunk_old_tail = NULL;
+					chunk_busy = 1;
+					pthread_mutex_unlock (&chunk_lock);
+					chunkFinish (o);
+					pthread_mutex_lock (&chunk_lock);
+					chunk_busy = 0;
+				}
+			else
+				pthread_cond_wait (&chunk_work, &chunk_lock);
+			pthread_cond_broadcast (&chunk_idle);
+		}
+	return NULL;
+}
 
-void set_board_readonly (int32_t board_num)
+/* Start the chunk thread. */
+void startChunks (void)
 {
+	pthread_t thread;
 
-	/* declarations */
+	if (pthread_create (&thread, NULL, chunkLoop, NULL) != 0)
+		{
+			printf ("could not start the chunk thread\n");
+			exit (1);
+		}
+}
 
-	int32_t data_fd;
-    #ifndef __WIN32__
-        int32_t st;
-    #endif // __WIN32__
-	char str[550];
+void chunkPost (struct oldFile *o)
+{
+	pthread_mutex_lock (&chunk_lock);
+	if (chunk_old_tail)
+		chunk_old_tail->next = o;
+	else
+		chunk_old = o;
+	chunk_old_tail = o;
+	pthread_cond_signal (&chunk_work);
+	pthread_mutex_unlock (&chunk_lock);
+}
 
-	#ifdef FILE_PER_CHANNEL	// MBO 20200616:
-		int32_t j;
-	#endif
+/* Wait for the files asked to be opened ahead. */
+void chunk_preopen_wait (void)
+{
+	pthread_mutex_lock (&chunk_lock);
+	while (chunk_preopen >= 0)
+		pthread_cond_wait (&chunk_idle, &chunk_lock);
+	pthread_mutex_unlock (&chunk_lock);
+}
 
-	/* specify readonly for everyone */
+/* Wait until every file handed over is finished. */
+void chunk_wait (void)
+{
+	pthread_mutex_lock (&chunk_lock);
+	while (chunk_preopen >= 0 || chunk_old || chunk_busy)
+		pthread_cond_wait (&chunk_idle, &chunk_lock);
+	pthread_mutex_unlock (&chunk_lock);
+}
 
-	#ifdef SINGLE_FILE
-		sprintf (str, "%s", fn);
-		data_fd = open (str, O_RDWR);
-        #ifndef __WIN32__
-            st = fchmod (data_fd, S_IRUSR | S_IRGRP | S_IROTH);
-        #endif // __WIN32__
-		close (data_fd);
-		ofile = 0;
-		printf ("%s is now readonly\n", str);
-	#else
-		#ifdef FILE_PER_CHANNEL	// MBO 20200616:
-			for (j = 0; j < MAXCHID; j++)
-				if (FILE_OPEN_CHECK(ofile[board_num][j]))
-					{
-						sprintf (str, "%s_%4.4i_%1.1i", fn, board_num, j);
-						data_fd = open (str, O_RDWR);
-                        #ifndef __WIN32__
-                            st = fchmod (data_fd, S_IRUSR | S_IRGRP | S_IROTH);
-                        #endif // __WIN32__
-						close (data_fd);
-						ofile[board_num][j] = 0;
-						printf ("%s is now readonly\n", str);
-					};
-		#else
-			if (FILE_OPEN_CHECK(ofile[board_num]))
+/* Ask for the next chunk's files of the slots that have data in this one. */
+void chunk_preopen_ask (void)
+{
+	int32_t i;
+
+	pthread_mutex_lock (&chunk_lock);
+	for (i = 1; i <= nslots; i++)
+		slots[i].preopen = (slotOpen (&slots[i]) && slots[i].bytes > 0);
+	chunk_preopen = chunck + 1;
+	pthread_cond_signal (&chunk_work);
+	pthread_mutex_unlock (&chunk_lock);
+	preopen_asked = 1;
+}
+
+/* Hand the open files of a slot to the chunk thread; the slot reads as
+ * closed.  The staged tail goes with them, or to the IO threads with -q.
+ */
+void slotRetire (struct slotState *sl)
+{
+	struct oldFile *o;
+
+	if (!slotOpen (sl))
+		return;
+	o = (struct oldFile *) calloc (1, sizeof (struct oldFile));
+	o->sl = sl;
+	o->discard = sl->preopened && sl->bytes == 0;
+	if (file_io == FILE_IO_STAGED)
+		{
+			// -o direct: the tail goes out as whole aligned blocks, zero padded,
+			// and the file is cut back to its length, which also frees the
+			// rest of the fallocate reservation
+			o->length = sl->fbytes + sl->staged;
+			if (direct_io && sl->staged % FILE_STAGE_ALIGN)
 				{
-					sprintf (str, "%s_%4.4i", fn, board_num);
-					data_fd = open (str, O_RDWR);
-                    #ifndef __WIN32__
-                        st = fchmod (data_fd, S_IRUSR | S_IRGRP | S_IROTH);
-                    #endif // __WIN32__
-					close (data_fd);
-					ofile[board_num] = 0;
-					printf ("%s is now readonly\n", str);
-				};
-		#endif
-	#endif
+					memset (sl->stage->data + sl->staged, 0, FILE_STAGE_ALIGN - sl->staged % FILE_STAGE_ALIGN);
+					sl->staged += FILE_STAGE_ALIGN - sl->staged % FILE_STAGE_ALIGN;
+				}
+			if (io_threads > 0)
+				{
+					pthread_mutex_lock (&io_lock);
+					if (sl->staged > 0)
+						ioQueue (sl, sl->fbytes);
+					o->qseq = sl->qseq;
+					pthread_mutex_unlock (&io_lock);
+				}
+			else if (sl->staged > 0)
+				{
+					o->tail = sl->stage;
+					o->staged = sl->staged;
+					sl->stage = NULL;
+				}
+			sl->staged = 0;
+		}
+	slotDetach (sl, &o->f);
+	chunkPost (o);
+}
 
-	#ifdef DEBUG_OUTPUT_FILE
-        #ifdef SINGLE_FILE
-            sprintf (str, "diag_%s", fn);
-            data_fd = open (str, O_RDWR);
-            #ifndef __WIN32__
-                st = fchmod (data_fd, S_IRUSR | S_IRGRP | S_IROTH);
-            #endif // __WIN32__
-            close (data_fd);
-            diag_ofile = 0;
-            printf ("diag_%s is now readonly\n", str);
-        #else // not SINGLE_FILE
-            #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                for (j = 0; j < MAXCHID; j++)
-                    if (FILE_OPEN_CHECK(diag_ofile[board_num][j]))
-                        {
-                            sprintf (str, "diag_%s_%4.4i_%1.1i", fn, board_num, j);
-                            data_fd = open (str, O_RDWR);
-                            #ifndef __WIN32__
-                                st = fchmod (data_fd, S_IRUSR | S_IRGRP | S_IROTH);
-                            #endif // __WIN32__
-                            close (data_fd);
-                            diag_ofile[board_num][j] = 0;
-                            printf ("%s is now readonly\n", str);
-                        };
-            #else // not FILE_PER_CHANNEL
-                if (FILE_OPEN_CHECK(diag_ofile[board_num]))
-                    {
-                        sprintf (str, "%s_%4.4i", fn, board_num);
-                        data_fd = open (str, O_RDWR);
-                        #ifndef __WIN32__
-                            st = fchmod (data_fd, S_IRUSR | S_IRGRP | S_IROTH);
-                        #endif // __WIN32__
-                        close (data_fd);
-                        diag_ofile[board_num] = 0;
-                        printf ("%s is now readonly\n", str);
-                    };
-            #endif // not FILE_PER_CHANNE
-        #endif // not SINGLE_FILE
-    #endif // DEBUG_OUTPUT_FILE
-	/* done */
+/* Take the files a slot had opened ahead into f.  1 if there were any. */
+int32_t slotTakeNext (struct slotState *sl, struct chunkFile *f)
+{
+	pthread_mutex_lock (&chunk_lock);
+	*f = sl->next;
+	memset (&sl->next, 0, sizeof (struct chunkFile));
+	pthread_mutex_unlock (&chunk_lock);
+	return f->ofile || f->ofd > 0;
+}
 
-	return;
+/* Hand the files in f, opened ahead and not used, to the chunk thread to
+ * remove.
+ */
+void chunkDiscard (struct slotState *sl, struct chunkFile *f)
+{
+	struct oldFile *o;
+
+	o = (struct oldFile *) calloc (1, sizeof (struct oldFile));
+	o->sl = sl;
+	o->discard = 1;
+	o->f = *f;
+	chunkPost (o);
+}
+
+/* Remove the files a slot had opened ahead. */
+void slotDiscardNext (struct slotState *sl)
+{
+	struct chunkFile f;
 
+	if (slotTakeNext (sl, &f))
+		chunkDiscard (sl, &f);
 }
 
 /*----------------------------------------------------------------------*/
-void close_all (void)
+
+/* End of a chunk: the old files go to the chunk thread and the ones opened
+ * ahead take their place.  Slots without those open with their first data.
+ */
+void rotate_chunk (void)
 {
 	time_t ticks;
-
-	#ifdef SINGLE_FILE
-	#else
-		int32_t i;
-		#ifdef FILE_PER_CHANNEL	// MBO 20200616:
-			int32_t j;
-		#endif
-	#endif
+	struct slotState *sl;
+	struct chunkFile f;
+	int64_t t0;
+	int32_t i, ahead = 0;
 
 	printf ("\n\nClosing all files at ");
 	ticks = time (NULL);
 	printf ("%.24s\n", ctime (&ticks));
 	fflush (stdout);
 
-	#ifdef SINGLE_FILE
-		if (FILE_OPEN_CHECK(ofile))
+	t0 = nowNs ();
+	chunk_preopen_wait ();
+	for (i = 1; i <= nslots; i++)
 		{
-			#ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
-				close (ofile);
-			#else
-				fclose (ofile
-				free(file_buffer);
-			#endif
-	//		ofile = 0;
-			bytes_written_to_file = 0;
-			printf ("close board file\n");
-		}
-	#else
-		#ifdef FILE_PER_CHANNEL	// MBO 20200616:
-			for (i = 0; i < MAXBOARDID; i++)
-				for (j = 0; j < MAXCHID; j++)
-					if (FILE_OPEN_CHECK(ofile[i][j]))
+			sl = &slots[i];
+			slotRetire (sl);
+			sl->preopened = 0;
+			if (slotTakeNext (sl, &f))
+				{
+					if (slotAttach (sl, &f) == 0)
 						{
-							#ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
-								close (ofile[i][j]);
-							#else
-								fclose (ofile[i][j]);
-								free(file_buffer[i][j]);
-							#endif
-	//						ofile[j][j] = 0;
-							bytes_written_to_file[i][j] = 0;
-							printf ("close board file %i-%i\n", i, j);
-						};
-		#else
-			for (i = 0; i < MAXBOARDID; i++)
-				if (FILE_OPEN_CHECK(ofile[i]))
-					{
-						#ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
-							close (ofile[i]);
-						#else
-							fclose (ofile[i]);
-							free(file_buffer[i]);
-						#endif
-	//					ofile[i] = 0;
-						bytes_written_to_file[i] = 0;
-						printf ("close board file %i\n", i);
-					};
-		#endif
-	#endif
+							sl->preopened = 1;
+							ahead++;
+						}
+					else
+						chunkDiscard (sl, &f);
+				}
+		}
+	totbytesInLargestFile = 0;
+	preopen_asked = 0;
+	printf ("%i files opened ahead taken in %.2f ms\n", ahead, (nowNs () - t0) / 1e6);
+}
 
-	#ifdef DEBUG_OUTPUT_FILE
-        #ifdef SINGLE_FILE
-            if (FILE_OPEN_CHECK(diag_ofile))
-            {
-                #ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
-                    close (diag_ofile);
-                #else
-                    fclose (diag_ofile
-                    free(diag_file_buffer);
-                #endif
-        //		diag_ofile = 0;
-                bytes_written_to_file = 0;
-                printf ("close board file\n");
-            }
-        #else
-            #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                for (i = 0; i < MAXBOARDID; i++)
-                    for (j = 0; j < MAXCHID; j++)
-                        if (FILE_OPEN_CHECK(diag_ofile[i][j]))
-                            {
-                                #ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
-                                    close (diag_ofile[i][j]);
-                                #else
-                                    fclose (diag_ofile[i][j]);
-                                    free(diag_file_buffer[i][j]);
-                                #endif
-        //						diag_ofile[j][j] = 0;
-                                bytes_written_to_file[i][j] = 0;
-                                printf ("close board file %i-%i\n", i, j);
-                            };
-            #else
-                for (i = 0; i < MAXBOARDID; i++)
-                    if (FILE_OPEN_CHECK(diag_ofile[i]))
-                        {
-                            #ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
-                                close (diag_ofile[i]);
-                            #else
-                                fclose (diag_ofile[i]);
-                                free(diag_file_buffer[i]);
-                            #endif
-        //					diag_ofile[i] = 0;
-                            bytes_written_to_file[i] = 0;
-                            printf ("close board file %i\n", i);
-                        };
-            #endif
-        #endif
-	#endif // DEBUG_OUTPUT_FILE
+/* Close everything, and wait until the files are finished. */
+void close_all (void)
+{
+	time_t ticks;
+	int32_t i;
+
+	printf ("\n\nClosing all files at ");
+	ticks = time (NULL);
+	printf ("%.24s\n", ctime (&ticks));
+	fflush (stdout);
 
+	chunk_preopen_wait ();
+	for (i = 1; i <= nslots; i++)
+		{
+			slotRetire (&slots[i]);
+			slotDiscardNext (&slots[i]);
+		}
 
-    #ifndef SINGLESHOT
-        totbytesInLargestFile = 0;
-    #endif // SINGLESHOT
-	set_readonly ();
+	totbytesInLargestFile = 0;
+	preopen_asked = 0;
+	chunk_wait ();
 	return;
 }
+
+int32_t exit_status = 0;								 /* 1 once a file was found to exist */
+
 void stop_receiver (void)
 {
+	int32_t i;
+
+	chunk_wait ();
 	printf ("last statistics:\n");
 	print_info (totbytes);
+	dumpStages ();
+	for (i = 0; i < nrcvr; i++)
+		{
+			printf ("%s: ", rcvr[i]->host);
+			printPackets ((char *) rcvr[i]);
+		}
 	printf ("\nall done/quit\n\n");
 	printf ("$Id: gtReceiver6.c,v %s 2021/11/23 19:51:40 tl Exp $\n", VERSION);
-	exit (0);
+	exit (exit_status);
 }
 
 
@@ -1217,12 +3372,23 @@ void forced_stop (void)
 	return;
 }
 
+/* SIGINT only records the signal.  It lands on the writer thread, which
+ * may hold io_lock, ur_lock or chunk_lock at the time, so the files are
+ * closed from writeLoop, by signal_stop, and never from the handler.
+ */
+volatile sig_atomic_t caught_signal = 0;
+
 void
 signal_catcher (int32_t sigval)
+{
+	caught_signal = sigval;
+}
+
+void signal_stop (void)
 {
 	time_t ticks;
 
-	printf ("\n\nreceived signal <%i> at ", sigval);
+	printf ("\n\nreceived signal <%i> at ", (int32_t) caught_signal);
 	ticks = time (NULL);
 	printf ("%.24s\n", ctime (&ticks));
 	fflush (stdout);
@@ -1234,48 +3400,17 @@ signal_catcher (int32_t sigval)
 
 void exit_if_all_files_closed (void)
 {
+	int32_t i;
 
-	#ifdef SINGLE_FILE
-	#else
-		int32_t i;
-		#ifdef FILE_PER_CHANNEL	// MBO 20200616:
-			int32_t j;
-		#endif
-	#endif
-
-	#ifdef SINGLE_FILE
-		if (FILE_OPEN_CHECK(ofile))
-			return;
-	#else
-		#ifdef FILE_PER_CHANNEL	// MBO 20200616:
-			for (i = 0; i < MAXBOARDID; i++)
-				for (j = 0; j < MAXCHID; j++)
-					if (FILE_OPEN_CHECK(ofile[i][j]))
-						return;
-		#else
-			for (i = 0; i < MAXBOARDID; i++)
-				if (FILE_OPEN_CHECK(ofile[i]))
-						return;
-		#endif
-	#endif
-
-	#ifdef DEBUG_OUTPUT_FILE
-        #ifdef SINGLE_FILE
-            if (FILE_OPEN_CHECK(diag_ofile))
-                return;
-        #else
-            #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                for (i = 0; i < MAXBOARDID; i++)
-                    for (j = 0; j < MAXCHID; j++)
-                        if (FILE_OPEN_CHECK(diag_ofile[i][j]))
-                            return;
-            #else
-                for (i = 0; i < MAXBOARDID; i++)
-                    if (FILE_OPEN_CHECK(diag_ofile[i]))
-                            return;
-            #endif
-        #endif
-	#endif // DEBUG_OUTPUT_FILE
+	for (i = 1; i <= nslots; i++)
+		{
+			if (slotOpen (&slots[i]))
+				return;
+			#ifdef DEBUG_OUTPUT_FILE
+				if (slots[i].diag_ofile)
+					return;
+			#endif // DEBUG_OUTPUT_FILE
+		}
 
 	stop_receiver ();
 }
@@ -1283,105 +3418,23 @@ void exit_if_all_files_closed (void)
 void close_board (int32_t board_num)
 {
 	time_t ticks;
-
-	#ifdef FILE_PER_CHANNEL	// MBO 20200616:
-		int32_t j;
-	#endif
+	int32_t i, j;
+	struct slotState *sl;
 
 	printf ("\n\n \033[31mEnd of data packet received for board #%i at ", board_num);
 	ticks = time (NULL);
 	printf ("%.24s\n \033[0m", ctime (&ticks));
 	fflush (stdout);
 
-	#ifdef SINGLE_FILE
-		if (FILE_OPEN_CHECK(ofile))
-		{
-			#ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
-				close (ofile);
-			#else
-				fclose (ofile);
-				free(file_buffer);
-			#endif
-	//		ofile = 0;
-			bytes_written_to_file = 0;
-			printf ("close board file\n");
-		}
-	#else
-		#ifdef FILE_PER_CHANNEL	// MBO 20200616:
-			for (j = 0; j < MAXCHID; j++)
-				if (FILE_OPEN_CHECK(ofile[board_num][j]))
-					{
-						#ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
-							close (ofile[board_num][j]);
-						#else
-							fclose (ofile[board_num][j]);
-							free(file_buffer[board_num][j]);
-						#endif
-	//					ofile[board_num][j] = 0;
-						bytes_written_to_file[board_num][j] = 0;
-						printf ("close board file %i-%i\n", board_num, j);
-					};
-		#else
-			if (FILE_OPEN_CHECK(ofile[board_num]))
-				{
-					#ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
-						close (ofile[board_num]);
-					#else
-						fclose (ofile[board_num]);
-						free(file_buffer[board_num]);
-					#endif
-	//				ofile[board_num] = 0;
-					bytes_written_to_file[board_num] = 0;
-					printf ("close board file %i\n", board_num);
-				};
-		#endif
-	#endif
-
-    #ifdef DEBUG_OUTPUT_FILE
-        #ifdef SINGLE_FILE
-            if (FILE_OPEN_CHECK(diag_ofile))
-            {
-                #ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
-                    close (diag_ofile);
-                #else
-                    fclose (diag_ofile);
-                    free(diag_file_buffer);
-                #endif
-        //		diag_ofile = 0;
-                printf ("close diag board file\n");
-            }
-        #else
-            #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                for (j = 0; j < MAXCHID; j++)
-                    if (FILE_OPEN_CHECK(diag_ofile[board_num][j]))
-                        {
-                            #ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
-                                close (diag_ofile[board_num][j]);
-                            #else
-                                fclose (diag_ofile[board_num][j]);
-                                free(diag_file_buffer[board_num][j]);
-                            #endif
-        //					diag_ofile[board_num][j] = 0;
-                            printf ("close diag board file %i-%i\n", board_num, j);
-                        };
-            #else
-                if (FILE_OPEN_CHECK(diag_ofile[board_num]))
-                    {
-                        #ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
-                            close (diag_ofile[board_num]);
-                        #else
-                            fclose (diag_ofile[board_num]);
-                            free(diag_file_buffer[board_num]);
-                        #endif
-        //				ofile[board_num] = 0;
-                        printf ("close diag board file %i\n", board_num);
-                    };
-            #endif
-        #endif
-
-    #endif // DEBUG_OUTPUT_FILE
-
-	set_board_readonly (board_num);
+	chunk_preopen_wait ();
+	i = (file_layout == FILES_SINGLE) ? 0 : board_num;
+	for (j = 0; j < slotChannels (); j++)
+		if (slot_map[i][j])
+			{
+				sl = &slots[slot_map[i][j]];
+				slotRetire (sl);
+				slotDiscardNext (sl);
+			}
 	return ;
 }
 
@@ -1396,10 +3449,54 @@ setRecLen (int32_t rl)
 	recLenGDig = rl / 2;
 }
 
-int32_t dumpUnknownDataToDaigFile(int8_t *buffer, int32_t header, int32_t size2write){
-    printf("\033[31m!!!!!!!! %s \033[0m\n", __func__);
+/* Append size2write bytes to the <filename>_DIAG_DATA file.  0 when they
+ * were written, -2 otherwise.
+ */
+int32_t appendDiagData (int8_t *buffer, int32_t size2write)
+{
 	char str[550];
 	int32_t wstat = 0;
+
+	sprintf (str, "%s_DIAG_DATA", fn);
+
+	/* open file */
+	if (file_io == FILE_IO_POSIX)
+	{
+	    int32_t diag_unknown_fd = open (str, O_WRONLY | O_CREAT | O_APPEND | O_NONBLOCK, 0644);
+	    if (diag_unknown_fd < 0)
+	    {
+	        printf ("Can't open or create diagnostic output file.");
+	        return -2;
+	    }
+	    wstat = nonblocking_file_write(diag_unknown_fd, buffer, size2write);
+	    close(diag_unknown_fd);
+	    if (wstat != size2write)
+	    {
+	        printf("Aborting write of %d bytes due to unhandled write error.", size2write);
+	        return -2;
+	    }
+	}
+	else
+	{
+	    diag_unknown_ofile = fopen (str, "ab");
+	    if (!diag_unknown_ofile)
+	    {
+	        printf ("Can't open or create diagnostic output file.\n");
+	        return -2;
+	    }
+	    wstat = fwrite (buffer, size2write, 1, diag_unknown_ofile);
+	    fclose(diag_unknown_ofile);
+	    if (wstat != 1)
+	    {
+	        printf("Aborting write of %d bytes due to unhandled write error.\n", size2write);
+	        return -2;
+	    }
+	}
+	return 0;
+}
+
+int32_t dumpUnknownDataToDaigFile(int8_t *buffer, int32_t header, int32_t size2write){
+    printf("\033[31m!!!!!!!! %s \033[0m\n", __func__);
 	uint32_t *buffer_uint32;
 	buffer_uint32 = (uint32_t *) buffer;
 
@@ -1408,101 +3505,99 @@ int32_t dumpUnknownDataToDaigFile(int8_t *buffer, int32_t header, int32_t size2w
         return -2;
     #else
         // MBO 20220801: Quick hack to get trigger data to disk for inital testing.
-        sprintf (str, "%s_DIAG_DATA", fn);
         //printf ("ooops:	event started with %08X instead of 0xAAAAXXXX.\n  Dumping mysterious data to %s\n", *buffer_uint32, str);
-        printf ("ooops:	event started with %08X instead of 0xAAAAXXXX.\n  Dumping whole buffer to %s\n", header, str);
-
-        /* open file */
-        #ifdef USE_POSIX_FILE_LIB
-            diag_unknown_ofile = open (str, O_WRONLY | O_CREAT | O_APPEND | O_NONBLOCK, 0644);
-            if (!FILE_OPEN_CHECK(diag_unknown_ofile))
-            {
-                printf ("Can't open or create diagnostic output file.");
-                return -2;
-            }
-            wstat = nonblocking_file_write(diag_unknown_ofile, buffer, size2write);
-            if (wstat != size2write)
-            {
-                printf("Aborting write of %d bytes due to unhandled write error.", size2write);
-                return -2;
-            }
-            close(diag_unknown_ofile);
-        #else
-            diag_unknown_ofile = fopen (str, "ab");
-            if (!FILE_OPEN_CHECK(diag_unknown_ofile))
-            {
-                printf ("Can't open or create diagnostic output file.\n");
-                return -2;
-            }
-            wstat = fwrite (buffer, size2write, 1, diag_unknown_ofile);
-            if (wstat != size2write)
-            {
-                printf("Aborting write of %d bytes due to unhandled write error.\n", size2write);
-                return -2;
-            }
-            fclose(diag_unknown_ofile);
-        #endif
+        printf ("ooops:	event started with %08X instead of 0xAAAAXXXX.\n  Dumping whole buffer to %s_DIAG_DATA\n", header, fn);
+        appendDiagData (buffer, size2write);
         return -2;
     #endif
 }
 
+/* -R: bytes dgsIndex could not parse.  They are kept in the diagnostic file
+ * (DUMP_UNKNOWN_DATA_TO_DISK), and the writer goes on with the next packet.
+ */
+void quarantine (int8_t *buffer, int32_t offset, int32_t size)
+{
+	if (debug > 0)
+		printf ("resync: %i corrupt bytes at offset %i skipped\n", size, offset);
+	#ifdef DUMP_UNKNOWN_DATA_TO_DISK
+		appendDiagData (buffer + offset, size);
+	#else
+		(void) buffer;
+	#endif
+}
+
+/*----------------------------------------------------------------------*/
+
+/* A write or open failed: stop the run, or with -j leave it to the writer
+ * thread once all shards are back, so no file is closed under a writer.
+ */
+void writerStop (void)
+{
+	if (nwriters > 1)
+		writer_failed = 1;
+	else
+		forced_stop ();
+}
+
+/* The shard that writes packet k. */
+int32_t packetShard (struct dgsHeaders *dec, int32_t k)
+{
+	if (dec->kind[k] & PKT_SKIP)
+		return 0;										 // one thread keeps the quarantine file
+	if (dec->kind[k] & PKT_TRIG)
+		return 0xF % nwriters;							 // trigger files are board 0xF
+	return dec->board[k] % nwriters;
+}
+
 /*----------------------------------------------------------------------*/
 
+/* Second pass of writeEvents2: write out the indexed packets of one shard.
+ * With one writer that is all of them.  There is an instantiation for every
+ * output mode, picked once by pickWriter; the mode tests below are constants.
+ */
+template <bool GT, int32_t LAYOUT, bool FILTER_F, bool SAVE, int32_t SHOT, int32_t IO>
 int32_t
-writeEvents2 (int8_t *buffer, int32_t size2write, int32_t *writtenBytes)
+writeShard (int8_t *buffer, int32_t size2write, struct dgsHeaders *dec, int32_t shard, int32_t *writtenBytes, int32_t *closed)
 {
 
 	// struct inbuf *inlist = 0;
 	char str[550];
-	#ifdef DEBUG_OUTPUT_FILE
-        char diag_str[550];
-	#endif // DEBUG_OUTPUT_FILE
+	struct chunkFile opened;
 	int32_t wstat = 0, buffer_size;
-	int32_t retval = 0, i;
+	int32_t retval = 0, ret;
 	int32_t goodctr = 0, badctr = 0;
 	uint32_t *buffer_uint32;
-	uint32_t hdr[TRIG_MIN_HEADER_LENGTH_UINT32], t1, t2, t3, t4;
-	uint32_t reformatted_hdr[REFORMATTED_HEADER_LENGTH_UINT32];
-	static int32_t buffer_position = 0; // byte offset within buffer
-	static uint32_t ch_id = 0;
-	static uint32_t board_id = 0;
-	static uint32_t packet_length_in_words = 0;	// length in 32-bit words
-	static int32_t packet_length_in_bytes = 0;	// length in bytes
-//	static uint32_t geo_addr = 0;
-	static uint32_t header_type = 0;
-	static uint32_t event_type = 0;
-//	static uint32_t header_length = 0;
-    static uint32_t timestamp_lower = 0;
-    static uint32_t timestamp_upper = 0;
+	int32_t k = 0;
+	uint32_t *reformatted_hdr = NULL;
+	uint32_t trig_rec[DGS_TRIG_BATCH * REFORMATTED_HEADER_LENGTH_UINT32];
+	uint64_t trig_ts[DGS_TRIG_BATCH];
+	int32_t trig_first = 0, trig_end = 0;		// packets k in trig_rec
+	int32_t buffer_position = 0; // byte offset within buffer
+	uint32_t ch_id = 0;
+	uint32_t board_id = 0;
+	uint32_t slot_board, slot_ch;
+	struct slotState *sl;
+	const void *payload;
+	uint32_t packet_length_in_words = 0;	// length in 32-bit words
+	int32_t packet_length_in_bytes = 0;	// length in bytes
+//	uint32_t geo_addr = 0;
+	uint32_t header_type = 0;
+	uint32_t event_type = 0;
+//	uint32_t header_length = 0;
+    uint32_t timestamp_lower = 0;
+    uint32_t timestamp_upper = 0;
 
     bool is_digitizer_data = true;
 	bool is_trigger_data = true;
-	#ifdef WRITEGTFORMAT
-		GEBDATA Geb;
-	#else
-		const uint32_t soe = SOE;
-	#endif // WRITEGTFORMAT
+	GEBDATA Geb;
+	const uint32_t soe = DIG_SOE;
 
 	*writtenBytes = 0;
-
-	if (debug > 0)
-		{
-			printf ("entered writeEvents2, size2write=%i\n", size2write);
-			fflush (stdout);
-		};
-
-
-
-	if (!buffer) return -3;
-
+	*closed = 0;
 
 	//here evtlen in dgs means len of all events in bytes
 	buffer_size = size2write;
 
-
-	if (debug > 0) printf ("to write %d bytes from ptr %p \n", buffer_size, buffer);
-
-
 	/* intercept the data and write it out */
 	/* in GT GEB/payload format */
 
@@ -1513,13 +3608,42 @@ writeEvents2 (int8_t *buffer, int32_t size2write, int32_t *writtenBytes)
 
 	while (buffer_position < buffer_size)
     {
+        // with -j, skip the boards of the other shards; a bad packet ends
+        // every shard, and only shard 0 reports it
+        if (nwriters > 1)
+        {
+            if (dgsPacketBad (dec, k, buffer_size))
+            {
+                if (shard > 0)
+                    return -2;
+            }
+            else if (packetShard (dec, k) != shard)
+            {
+                k++;
+                buffer_position = (k < dec->n) ? (int32_t) dec->offset[k] : buffer_size;
+                buffer_uint32 = (uint32_t *) (buffer + buffer_position);
+                continue;
+            }
+        }
+
+        // -R: corrupt bytes, set aside by dgsIndex
+        if (dec->kind[k] == PKT_SKIP)
+        {
+            k++;
+            if (SAVE)
+                quarantine (buffer, buffer_position, ((k < dec->n) ? (int32_t) dec->offset[k] : buffer_size) - buffer_position);
+            buffer_position = (k < dec->n) ? (int32_t) dec->offset[k] : buffer_size;
+            buffer_uint32 = (uint32_t *) (buffer + buffer_position);
+            continue;
+        }
+
         // gtReciever 6 method
         // check first word for proper data alignment
-        if ((*buffer_uint32 & ANY_SOE_MASK) != ANY_SOE)
+        if (dec->kind[k] == PKT_BAD)
         {
             return dumpUnknownDataToDaigFile(buffer, buffer_uint32[0], size2write);
         }
-        else if ((*buffer_uint32 & DIG_SOE_MASK) == DIG_SOE)
+        else if (dec->kind[k] & PKT_DIG)
         {
             // If the first word is 0xAAAAAAAA (DIG_SOE), then process as digitizer data.
             is_digitizer_data = true;
@@ -1529,32 +3653,13 @@ writeEvents2 (int8_t *buffer, int32_t size2write, int32_t *writtenBytes)
             buffer_position += sizeof (uint32_t);
             buffer_uint32++;
 
-            if (buffer_position + DIG_MIN_HEADER_LENGTH_BYTES > buffer_size)
+            if (dec->kind[k] & PKT_SHORT)
             {
                 printf ("ooops:	data block has %i extra bytes\n", buffer_size - buffer_position);
                 return -2;
             }
 
-            /* extract the timestamp from the header */
-            /* after swapping the bytes */
-            for (i = 0; i < DIG_MIN_HEADER_LENGTH_UINT32; i++)
-            {
-                hdr[i] = buffer_uint32[i];
-
-                /* before 4 3 2 1 */
-                /*		  | | | | */
-                /* after  1 2 3 4 */
-
-                // MBO 20200616: use ntohl here instead?
-                t1 = (hdr[i] & 0x000000ff) << 24;
-                t2 = (hdr[i] & 0x0000ff00) << 8;
-                t3 = (hdr[i] & 0x00ff0000) >> 8;
-                t4 = (hdr[i] & 0xff000000) >> 24;
-                hdr[i] = t1 + t2 + t3 + t4;
-                /*
-                hdr[i] = ntohl(hdr[i]);	// MBO 20200616:
-                */
-            }
+            /* the header words were swapped and split by dgsDecode */
 
             //************ strip out header bits **************/
             //digitizer format
@@ -1564,28 +3669,30 @@ writeEvents2 (int8_t *buffer, int32_t size2write, int32_t *writtenBytes)
             //2		|                                                          LEADING EDGE DISCRIMINATOR TIMESTAMP[31:0]                                                            |
             //3		|         HEADER LENGTH        |  EVENT TYPE  |  0 | TTS| INT|    HEADER TYPE    |                   LEADING EDGE DISCRIMINATOR TIMESTAMP[47:32]                 |
 
-            ch_id					= (hdr[0] & 0x0000000F) >> 0;	// Word 1: 3..0
-            board_id 				= (hdr[0] & 0x0000FFF0) >> 4;	// Word 1: 15..4
-            packet_length_in_words	= (hdr[0] & 0x07FF0000) >> 16;	// Word 1: 26..16
+            ch_id					= dec->ch[k];			// Word 1: 3..0
+            board_id 				= dec->board[k];			// Word 1: 15..4
+            packet_length_in_words	= dec->length[k];		// Word 1: 26..16
         //	geo_addr				= (hdr[0] & 0xF8000000) >> 27;	// Word 1: 31..27
-            #ifdef WRITEGTFORMAT
-                timestamp_lower 		= (hdr[1] & 0xFFFFFFFF) >> 0;	// Word 2: 31..0
-                timestamp_upper 		= (hdr[2] & 0x0000FFFF) >> 0;	// Word 3: 15..0
-            #endif
-            header_type				= (hdr[2] & 0x000F0000) >> 16;	// Word 3: 19..16
-            event_type				= (hdr[2] & 0x03800000) >> 23;	// Word 3: 25..23
+            if (GT)
+            {
+                timestamp_lower 		= dec->ts_lower[k];		// Word 2: 31..0
+                timestamp_upper 		= dec->ts_upper[k];		// Word 3: 15..0
+            }
+            header_type				= dec->header_type[k];	// Word 3: 19..16
+            event_type				= dec->event_type[k];	// Word 3: 25..23
         //	header_length			= (hdr[2] & 0xFC000000) >> 26;	// Word 3: 31..26
 
             packet_length_in_bytes	= packet_length_in_words * 4;
 
-            #ifdef WRITEGTFORMAT
+            if (GT)
+            {
                 /* create the GEB header */
                 Geb.type = GEB_TYPE_DGS;
                 Geb.length = packet_length_in_bytes;
                 //full 48-bit timestamp stored in 64-bit uint32_t.
                 Geb.timestamp = ((uint64_t)(timestamp_upper)) << 32;
                 Geb.timestamp |= (uint64_t)(timestamp_lower);
-            #endif //WRITEGTFORMAT
+            }
 
             if (buffer_position + packet_length_in_bytes > buffer_size)
             {
@@ -1598,46 +3705,33 @@ writeEvents2 (int8_t *buffer, int32_t size2write, int32_t *writtenBytes)
                 printf ("ooops:	packet_length: %i (%i bytes) is less than minimum required for header(%i Bytes)!! skip block...\n", packet_length_in_words, packet_length_in_bytes, DIG_MIN_HEADER_LENGTH_BYTES);
                 return -2;
             }
-            else if (buffer_position + packet_length_in_bytes < buffer_size)
+            else if (dec->kind[k] & PKT_NOSOE)
             {
-                if (buffer_uint32[packet_length_in_words] != DIG_SOE)
-                {
-                    printf ("ooops:	Packet length should be %i, but 0xAAAAAAAA not found at boundary! Got %08X instead. skip block...\n", packet_length_in_words, buffer_uint32[packet_length_in_words]);
-                    return -2;
-                }
+                printf ("ooops:	Packet length should be %i, but 0xAAAAAAAA not found at boundary! Got %08X instead. skip block...\n", packet_length_in_words, buffer_uint32[packet_length_in_words]);
+                return -2;
             }
         }
-        else if ((*buffer_uint32 & TRIG_SOE_MASK) == TRIG_SOE)
+        else if (dec->kind[k] & PKT_TRIG)
         {
             // If the first word is 0xAAAAXXXX (TRIG_SOE), where XXXX is not AAAA, then process as trigger data.
             is_digitizer_data = false;
             is_trigger_data = true;
 
-            if (buffer_position + TRIG_MIN_HEADER_LENGTH_BYTES > buffer_size)
+            if (dec->kind[k] & PKT_SHORT)
             {
                 printf ("ooops:	data block has %i extra bytes\n", buffer_size - buffer_position);
                 return -2;
             }
 
-            /* extract the timestamp from the header */
-            /* after swapping the bytes */
-            for (i = 0; i < TRIG_MIN_HEADER_LENGTH_UINT32; i++){
-                hdr[i] = ntohl(buffer_uint32[i]);
-
-                /* before 4 3 2 1 */
-                /*		  | | | | */
-                /* after  1 2 3 4 */
-
-                // MBO 20200616: use ntohl here instead?
-                // t1 = (hdr[i] & 0x000000ff) << 24;
-                // t2 = (hdr[i] & 0x0000ff00) << 8;
-                // t3 = (hdr[i] & 0x00ff0000) >> 8;
-                // t4 = (hdr[i] & 0xff000000) >> 24;
-                // hdr[i] = t1 + t2 + t3 + t4;
-                /*
-                hdr[i] = ntohl(hdr[i]);	// MBO 20200616:
-                */
+            /* reformat the run of trigger packets from here on, a batch at a time */
+            if (k >= trig_end)
+            {
+                trig_first = trig_end = k;
+                while (trig_end < dec->n && trig_end - trig_first < DGS_TRIG_BATCH && dec->kind[trig_end] == PKT_TRIG)
+                    trig_end++;
+                dgsTrigRecords (buffer + buffer_position, trig_end - trig_first, dgsTrigWord1 (0xF, 0x0), trig_rec, trig_ts);
             }
+            reformatted_hdr = trig_rec + (k - trig_first) * REFORMATTED_HEADER_LENGTH_UINT32;
 
             //************ reparse into a digitizer like header **************/
             //digitizer format
@@ -1646,47 +3740,23 @@ writeEvents2 (int8_t *buffer, int32_t size2write, int32_t *writtenBytes)
             //1		|     Geo Addr            |                 PACKET LENGTH                        |                    USER PACKET DATA                       |     CHANNEL ID    |
             //2		|                                                          LEADING EDGE DISCRIMINATOR TIMESTAMP[31:0]                                                            |
             //3		|         HEADER LENGTH        |  EVENT TYPE  |  0 | TTS| INT|    HEADER TYPE    |                   LEADING EDGE DISCRIMINATOR TIMESTAMP[47:32]                 |
-            
+            // words 4..9 carry the other trigger fields, see dgsTrigPack (dgsDecode.h)
+
             ch_id		      = 0x0;
-            board_id	      = 0xF; 
-            header_type       = 0xE;
-            
-            // Trim the board id, or "user package data" to the maximum
-            // number of bits supported by the digitizer header.
-            // board_id = board_id & DIG_BOARD_ID_MASK;
-            packet_length_in_words  = 10;
+            board_id	      = 0xF;
+            header_type       = DGS_TRIG_HEADER_TYPE;
+
+            packet_length_in_words  = DGS_TRIG_RECORD_LENGTH;
             packet_length_in_bytes	= packet_length_in_words * 4;
 
-            reformatted_hdr[0] = 0xAAAAAAAA;
-            
-            reformatted_hdr[1]  = ch_id;
-            reformatted_hdr[1] |= board_id << 4;
-            reformatted_hdr[1] |= packet_length_in_words << 16;  // always 8 words payload
-
-            reformatted_hdr[2]  = hdr[4]   ;
-            reformatted_hdr[2] |= hdr[3]  << 16;
-            
-            reformatted_hdr[3]  = hdr[2]   ;
-            reformatted_hdr[3] |= header_type  << 16; // header_type
-            //reformatted_hdr[3] |= 0x0  << 23; // event_type
-            reformatted_hdr[3] |= 3 << 26;
-
-            reformatted_hdr[4] = (hdr[ 1] << 16) + hdr[ 5];
-            reformatted_hdr[5] = (hdr[ 6] << 16) + hdr[ 7];
-            reformatted_hdr[6] = (hdr[ 8] << 16) + hdr[ 9];
-            reformatted_hdr[7] = (hdr[10] << 16) + hdr[11];
-            reformatted_hdr[8] = (hdr[12] << 16) + hdr[13];
-            reformatted_hdr[9] = (hdr[14] << 16) + hdr[15];
-
-            #ifdef WRITEGTFORMAT
+            if (GT)
+            {
                 /* create the GEB header */
                 Geb.type = GEB_TYPE_DGS;
                 Geb.length = packet_length_in_bytes;
                 //full 48-bit timestamp stored in 64-bit uint32_t.
-                Geb.timestamp  = ((uint64_t)(hdr[2])) << 32;
-                Geb.timestamp |= ((uint64_t)(hdr[3])) << 16;
-                Geb.timestamp |=  (uint64_t)(hdr[4]);
-            #endif //WRITEGTFORMAT
+                Geb.timestamp = trig_ts[k - trig_first];
+            }
 
             if (buffer_position + packet_length_in_bytes > buffer_size)
             {
@@ -1716,443 +3786,462 @@ writeEvents2 (int8_t *buffer, int32_t size2write, int32_t *writtenBytes)
         /* see if the proper file is open */
         /* or open it */
 
-        #ifdef FILTER_TYPE_F
-        if(header_type != 0xF) {
-        #else
+        // the file of the packet: [board][channel], [board][0] or [0][0]
+        slot_board = (LAYOUT == FILES_SINGLE) ? 0 : board_id;
+        slot_ch = (LAYOUT == FILES_PER_CHANNEL) ? ch_id : 0;
+
+        if (FILTER_F && (header_type == 0xF))
+        {
+            // -f: type F headers are not written
+        }
         // report an error if the header type is 0xF and the channel number is not > 9
-        if ((header_type == 0xF) && (ch_id <= 9))
+        else if (!FILTER_F && (header_type == 0xF) && (ch_id <= 9))
         {
             printf ("Error: Type F header reported as channel 9 or less. ch_id = %d", ch_id);
         }
+        else if ((sl = slotGet (slot_board, slot_ch)),
+                 (SHOT != SHOT_OFF) && (sl->bytes + packet_length_in_bytes + (GT ? sizeof (GEBDATA) : sizeof (soe)) > (uint64_t) max_file_size))
+        {
+            // -1 first: the run is over; -1 all: this file takes no more
+            if (SHOT == SHOT_FIRST)
+            {
+                printf ("file size limit of %" PRId64 " bytes reached\n", max_file_size);
+                writerStop ();
+                return -4;
+            }
+            sl->inhibit = 1;
+        }
         else
         {
-        #endif
-        #ifdef SINGLE_FILE
-            #ifdef SINGLESHOT
-                #ifdef WRITEGTFORMAT
-                if (bytes_written_to_file + packet_length_in_bytes + sizeof(GEBDATA) > max_file_size)
-                #else
-                if (bytes_written_to_file + packet_length_in_bytes + sizeof(soe) > max_file_size)
-                #endif // WRITEGTFORMAT
+            if (!slotIsOpen<IO> (sl))
+            {
+                sl->trig = is_trigger_data;
+                sl->preopened = 0;
+                printf("First event received from: ");
+                if (LAYOUT != FILES_SINGLE)
+                    printf("BOARD_ID: %3.3i ",board_id);
+                if (LAYOUT == FILES_PER_CHANNEL)	// MBO 20200616:
+                    printf("CH_ID: %01X ",ch_id);
+                ret = chunkFileOpen (&opened, fn, sl, str);
+                if (ret == -2)
+                    {
+                        /* make sure it does not exist already */
+                        printf ("\n");
+                        printf ("----------------------------------------------------\n");
+                        printf ("ERROR: file \"%s\" already exists!!! QUIT!\n", str);
+                        printf ("			 delete file first if you want to overwrite it\n");
+                        printf ("----------------------------------------------------\n");
+                        printf ("\n");
+                        printf ("\n");
+                        exit_status = 1;		// the other files are closed as on a forced stop
+                        writerStop ();
+                        return -4;
+                    };
+                if (ret == 0 && slotAttach (sl, &opened) == 0)
+                    printf ("Opened new file %s\n", str);
+                else
+                    {
+                        printf ("ERROR\nERROR: failed to open file %s, quit\n", str);
+                        writerStop ();
+                        return -4;
+                    };
+            };
+
+            if (SAVE)
+            {
+                /* write the GEB header, or the SOE in raw format, with the payload */
+                if (is_digitizer_data)
+                    payload = buffer + buffer_position;
+                else
                 {
-                    return packet_length_in_bytes + sizeof(soe);
+                    #ifdef DEBUG_OUTPUT_FILE
+                        if (sl->diag_ofile)
+                            for (int32_t i = 0; i < REFORMATTED_HEADER_LENGTH_UINT32; i++)
+                                fprintf(sl->diag_ofile, "%08X\n", reformatted_hdr[i]);
+                    #endif // DEBUG_OUTPUT_FILE
+                    payload = &reformatted_hdr[1];
                 }
-            #endif // SINGLESHOT
-            if (!FILE_OPEN_CHECK(ofile))
-        #else
-        #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-            #ifdef SINGLESHOT
-                #ifdef WRITEGTFORMAT
-                if (bytes_written_to_file[board_id][ch_id] + packet_length_in_bytes + sizeof(GEBDATA) > max_file_size)
-                #else
-                if (bytes_written_to_file[board_id][ch_id] + packet_length_in_bytes + sizeof(soe) > max_file_size)
-                #endif // WRITEGTFORMAT
+                if (GT)
+                    wstat = slotWrite<IO> (sl, &Geb, sizeof (GEBDATA), payload, packet_length_in_bytes);
+                else
+                    wstat = slotWrite<IO> (sl, &soe, sizeof (soe), payload, packet_length_in_bytes);
+                sl->bytes += GT ? sizeof (GEBDATA) : sizeof (soe);
+                *writtenBytes += GT ? sizeof (GEBDATA) : sizeof (soe);
+                if (wstat != 0)
                 {
-                    write_inhibit[board_id][ch_id] = 1;
-                    return packet_length_in_bytes + sizeof(soe);
+                    printf("FILE WRITE ERROR: BOARD: %i CH: %0X", board_id, ch_id);
+                    writerStop ();
+                    return -4;
                 }
-            #endif // SINGLESHOT
+            }
+            sl->bytes += packet_length_in_bytes;
+            *writtenBytes += packet_length_in_bytes;
+        }
+        if (is_trigger_data)
+        {
+            buffer_position += TRIG_MIN_HEADER_LENGTH_BYTES;
+        }
+        else
+        {
+            buffer_position += packet_length_in_bytes;
+        }
+        buffer_uint32 = (uint32_t *) (buffer + buffer_position);
+        k++;
+
+//		if (header_type == 0xF)
+//		{
+//			printf("\n\ntype F: %08X %08X %08X %X %X \n\n", hdr[0],  hdr[1],  hdr[2], event_type, ch_id);
+//		}
+
+        if ((header_type == 0xF) && (event_type == 0x0) && (ch_id == 0xD))
+        {
+            close_board(board_id);
+            if (nwriters > 1)
+                *closed = 1;	// all shards may still be writing
+            else
+                exit_if_all_files_closed();
+        }
+    };
+
+	if (badctr)
+		printf ("%d write failures out of %d packets\n", badctr, badctr + goodctr);
+
+
+	return retval;
+}
+
+/*----------------------------------------------------------------------*/
+
+/* Resolve the output mode into a writeShard instantiation, one setting at a time. */
+typedef int32_t (*writeShardFn) (int8_t *, int32_t, struct dgsHeaders *, int32_t, int32_t *, int32_t *);
+writeShardFn writeShardMode;
+
+template <bool GT, int32_t LAYOUT, bool FILTER_F, bool SAVE, int32_t SHOT>
+writeShardFn pickIO (void)
+{
+	if (file_io == FILE_IO_POSIX)
+		return writeShard<GT, LAYOUT, FILTER_F, SAVE, SHOT, FILE_IO_POSIX>;
+	if (file_io == FILE_IO_STDIO)
+		return writeShard<GT, LAYOUT, FILTER_F, SAVE, SHOT, FILE_IO_STDIO>;
+	return writeShard<GT, LAYOUT, FILTER_F, SAVE, SHOT, FILE_IO_STAGED>;
+}
+
+template <bool GT, int32_t LAYOUT, bool FILTER_F, bool SAVE>
+writeShardFn pickShot (void)
+{
+	if (singleshot == SHOT_FIRST)
+		return pickIO<GT, LAYOUT, FILTER_F, SAVE, SHOT_FIRST> ();
+	if (singleshot == SHOT_ALL && LAYOUT != FILES_SINGLE)	// one file: all is first
+		return pickIO<GT, LAYOUT, FILTER_F, SAVE, SHOT_ALL> ();
+	if (singleshot == SHOT_ALL)
+		return pickIO<GT, LAYOUT, FILTER_F, SAVE, SHOT_FIRST> ();
+	return pickIO<GT, LAYOUT, FILTER_F, SAVE, SHOT_OFF> ();
+}
+
+template <bool GT, int32_t LAYOUT, bool FILTER_F>
+writeShardFn pickSave (void)
+{
+	if (save_mode == SAVE_FILES)
+		return pickShot<GT, LAYOUT, FILTER_F, true> ();
+	return pickShot<GT, LAYOUT, FILTER_F, false> ();
+}
+
+template <bool GT, int32_t LAYOUT>
+writeShardFn pickFilter (void)
+{
+	if (filter_type_f)
+		return pickSave<GT, LAYOUT, true> ();
+	return pickSave<GT, LAYOUT, false> ();
+}
+
+template <bool GT>
+writeShardFn pickLayout (void)
+{
+	if (file_layout == FILES_SINGLE)
+		return pickFilter<GT, FILES_SINGLE> ();
+	if (file_layout == FILES_PER_BOARD)
+		return pickFilter<GT, FILES_PER_BOARD> ();
+	return pickFilter<GT, FILES_PER_CHANNEL> ();
+}
+
+writeShardFn pickWriter (void)
+{
+	if (gt_format)
+		return pickLayout<true> ();
+	return pickLayout<false> ();
+}
+
+/*----------------------------------------------------------------------*/
+
+/* Write the current buffer's share of one shard. */
+void runShard (int32_t shard)
+{
+	struct writerShard *sh = &shards[shard];
+	int64_t t0;
+
+	t0 = nowNs ();
+	sh->ret = writeShardMode (shard_buffer, shard_size, &shard_index, shard, &sh->written, &sh->closed);
+	sh->busyns += nowNs () - t0;
+	sh->bytes += sh->written;
+}
+
+/* Writer threads for shards 1..nwriters-1: one buffer per round. */
+void *shardLoop (void *arg)
+{
+	int32_t shard = (int32_t) (intptr_t) arg;
+
+	while (1)
+		{
+			pthread_barrier_wait (&shard_start);
+			runShard (shard);
+			pthread_barrier_wait (&shard_done);
+		}
+	return NULL;
+}
+
+/* Start the -j writer threads.  Called with SIGINT blocked, which they inherit. */
+void startShards (void)
+{
+	pthread_t thread;
+	int32_t i;
+
+	if (nwriters < 2)
+		return;
+	pthread_barrier_init (&shard_start, NULL, nwriters);
+	pthread_barrier_init (&shard_done, NULL, nwriters);
+	for (i = 1; i < nwriters; i++)
+		if (pthread_create (&thread, NULL, shardLoop, (void *) (intptr_t) i) != 0)
+			{
+				printf ("could not start writer thread %i\n", i);
+				exit (1);
+			}
+}
+
+/* Have all shards write the indexed buffer and wait for them. */
+int32_t writeShards (int8_t *buffer, int32_t size2write, int32_t *writtenBytes)
+{
+	int32_t i, st = 0, closed = 0;
+
+	shard_buffer = buffer;
+	shard_size = size2write;
+	pthread_barrier_wait (&shard_start);
+	runShard (0);
+	pthread_barrier_wait (&shard_done);
+
+	*writtenBytes = 0;
+	for (i = 0; i < nwriters; i++)
+		{
+			*writtenBytes += shards[i].written;
+			closed |= shards[i].closed;
+			if (shards[i].ret < st)
+				st = shards[i].ret;
+		}
+
+	if (writer_failed)
+		forced_stop ();
+	if (closed)
+		exit_if_all_files_closed ();
+	return st;
+}
+
+/* Parse one received buffer and write its packets out: index it
+ * (dgsDecode.h), then write with one thread, or with -j a shard per thread.
+ */
+int32_t
+writeEvents2 (int8_t *buffer, int32_t size2write, int32_t *writtenBytes)
+{
+	if (debug > 0)
+		{
+			printf ("entered writeEvents2, size2write=%i\n", size2write);
+			fflush (stdout);
+		};
+
+	if (!buffer) return -3;
+
+	if (debug > 0) printf ("to write %d bytes from ptr %p \n", size2write, buffer);
+
+	/* first pass: index the packets and decode their headers */
+	dgsIndex (buffer, size2write, &shard_index, resync);
+	if (shard_index.resyncs)
+		{
+			resync_count += shard_index.resyncs;
+			resync_skipped += shard_index.skipped;
+			resync_recovered += shard_index.recovered;
+		}
+
+	/* second pass: hand each packet to its file */
+	if (nwriters > 1)
+		return writeShards (buffer, size2write, writtenBytes);
+	return writeShardMode (buffer, size2write, &shard_index, 0, writtenBytes, &shards[0].closed);
+}
+
+
+/*----------------------------------------------------------------------*/
+
+/* Network side: keep every IOC connection drained into the ring.
+ * getReceiverDataAll blocks while there is nothing to do, or spins with -L.
+ */
+void *receiveLoop (void *arg)
+{
+	(void) arg;
+	while (1)
+		if (getReceiverDataAll () > 0)
+			has_connected = 1;
+	return NULL;
+}
+
+/*----------------------------------------------------------------------*/
+
+/* Writer side: parse and store one received buffer. */
+void writeBuffer (int8_t *input1, int32_t num_bytes_read)
+{
+	int32_t st = 0, nwritten;
+	int32_t i, all_inhibited;
+
+	/* if we get here we have data to dump to disk */
+	if (save_mode != SAVE_PROCESS_ONLY)
+		{
+			if (singleshot == SHOT_ALL)
+				{
+					if (nslots > 0)
+					{
+						all_inhibited = 1;
+						for (i = 1; i <= nslots; i++)
+							if (slots[i].inhibit == 0)
+								all_inhibited = 0;
+						if (all_inhibited == 1)
+							forced_stop();
+					}
+				}
+			else if ((singleshot == SHOT_OFF) && ((totbytesInLargestFile + num_bytes_read) > max_file_size))
+				{
+
+					/* set the new file name */
+
+					#ifdef __WIN32__
+						printf ("file size reached %I64d of %I64d limit\n", totbytesInLargestFile, max_file_size);
+					#else
+						printf ("file size reached %" PRId64 " of %" PRId64 " limit\n", totbytesInLargestFile, max_file_size);
+						
+					#endif // __WIN32__
+
+					/* hand the old files over, go on in the ones opened ahead */
+					rotate_chunk();
+
+					chunck++;
+					set_file_name ();
+
+					printf ("Starting new data chunk: #%3.3i\n", chunck);
+					fflush (stdout);
+
+//									print_info (totbytes);
+				}
+		}
+
+
+
+	if (save_mode != SAVE_NOTHING)
+		{
+			st = writeEvents2 (input1, num_bytes_read, &nwritten);
+
+			if (st == 0)
+				{
+					// ok
+				}
+			else if(st <= -3)
+				{
+					printf ("failed to write data to disk\n");
+				}
+			else if(st == -2)
+				{
+				#ifndef DUMP_UNKNOWN_DATA_TO_DISK
+					printf ("skipping data block\n");
+				#endif
+				}
+			else if(st == -1)
+				{
+					printf ("unknown fault\n");
+				}
+		}
+	else
+		nwritten = num_bytes_read;
 
-            if (!FILE_OPEN_CHECK(ofile[board_id][ch_id]))
-        #else
-            #ifdef SINGLESHOT
-                #ifdef WRITEGTFORMAT
-                if (bytes_written_to_file[board_id] + packet_length_in_bytes + sizeof(GEBDATA) > max_file_size)
-                #else
-                if (bytes_written_to_file[board_id] + packet_length_in_bytes + sizeof(soe) > max_file_size)
-                #endif // WRITEGTFORMAT
-                {
-                    write_inhibit[board_id] = 1;
-                    return packet_length_in_bytes + sizeof(soe);
-                }
-            #endif // SINGLESHOT
-            if (!FILE_OPEN_CHECK(ofile[board_id]))
-        #endif
-        #endif // else of ifdef SINGLE_FILE
-            {
-                if (is_trigger_data)
-                {
-                    /* filename */
-                    #ifdef SINGLE_FILE
-                            sprintf (str, "trig_%s", fn);
-                    #else
-                        #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                            sprintf (str, "%s_trig_%4.4i_%01X", fn, board_id, ch_id);
-                        #else
-                            sprintf (str, "%s_trig_%4.4i", fn, board_id);
-                        #endif
-                    #endif
+	/* keep user informed */
 
-                    #ifdef DEBUG_OUTPUT_FILE
-                        #ifdef SINGLE_FILE
-                                sprintf (diag_str, "%s_diag_trig", fn);
-                        #else
-                            #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                                sprintf (diag_str, "%s_diag_trig_%4.4i_%01X", fn, board_id, ch_id);
-                            #else
-                                sprintf (diag_str, "%s_diag_trig_%4.4i", fn, board_id);
-                            #endif
-                        #endif
-                    #endif // DEBUG_OUTPUT_FILE
-                }
-                else
-                {
-                    /* filename */
-                    #ifdef SINGLE_FILE
-                            sprintf (str, "%s", fn);
-                    #else
-                        #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                            sprintf (str, "%s_%4.4i_%01X", fn, board_id, ch_id);
-                        #else
-                            sprintf (str, "%s_%4.4i", fn, board_id);
-                        #endif
-                    #endif
-                }
-                /* make sure it does not exist already */
+	totbytes += nwritten;
+#if(0)
+	printf ("nwritten=%i, totbytes=%lli\n", nwritten, totbytes);
+#endif
 
-                fp = open (str, O_RDONLY, 0);
+	/* new files */
 
-                if (fp != -1)
-                    {
-                        printf ("\n");
-                        printf ("----------------------------------------------------\n");
-                        printf ("ERROR: file \"%s\" already exists!!! QUIT!\n", str);
-                        printf ("			 delete file first if you want to overwrite it\n");
-                        printf ("----------------------------------------------------\n");
-                        printf ("\n");
-                        printf ("\n");
-                        close(fp);
-                        exit (1);
-                    };
+	/* NOTE: we close all files at the same time	*/
+	/* so that they all have the same time stamp	*/
+	/* range because that makes it much easier	*/
+	/* to merger the data later on */
 
-                /* open file */
-                #ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
-                    #ifdef SINGLE_FILE
-                        ofile = open (str, O_WRONLY | O_CREAT | O_NONBLOCK, 0644);
-                    #else
-                        #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                            // MBO 20200616: Let's try going faster on writes with O_NONBLOCK
-                            ofile[board_id][ch_id] = open (str, O_WRONLY | O_CREAT | O_NONBLOCK, 0644);
-                        #else
-                            // MBO 20200616: Let's try going faster on writes with O_NONBLOCK
-                            ofile[board_id] = open (str, O_WRONLY | O_CREAT | O_NONBLOCK, 0644);
-                        #endif
-                    #endif
-                #else
-                    #ifdef SINGLE_FILE
-                        ofile = fopen (str, "wb");
-                        file_buffer = (char*)malloc(FILE_BUF_SIZE);
-                        setvbuf(ofile, file_buffer, _IOFBF, FILE_BUF_SIZE);
-                    #else
-                        #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                            ofile[board_id][ch_id] = fopen (str, "wb");
-                            #if defined(SINGLESHOT) && defined(FULL_FILE_MODE)
-                                write_inhibit[board_id][ch_id] = 0;
-                            #endif
-                            file_buffer[board_id][ch_id] = (char*)malloc(FILE_BUF_SIZE);
-                            setvbuf(ofile[board_id][ch_id], file_buffer[board_id][ch_id], _IOFBF, FILE_BUF_SIZE);
-                        #else
-                            ofile[board_id] = fopen (str, "wb");
-                            #if defined(SINGLESHOT) && defined(FULL_FILE_MODE)
-                                write_inhibit[board_id] = 0;
-                            #endif
-                            file_buffer[board_id] = (char*)malloc(FILE_BUF_SIZE);
-                            setvbuf(ofile[board_id], file_buffer[board_id], _IOFBF, FILE_BUF_SIZE);
-                        #endif
-                    #endif
-                #endif
-                if (is_trigger_data)
-                {
-                    #ifdef DEBUG_OUTPUT_FILE
-                        #ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
-                            #ifdef SINGLE_FILE
-                                diag_ofile = open (diag_str, O_WRONLY | O_CREAT | O_NONBLOCK, 0644);
-                            #else
-                                #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                                    // MBO 20200616: Let's try going faster on writes with O_NONBLOCK
-                                    diag_ofile[board_id][ch_id] = open (diag_str, O_WRONLY | O_CREAT | O_NONBLOCK, 0644);
-                                #else
-                                    // MBO 20200616: Let's try going faster on writes with O_NONBLOCK
-                                    diag_ofile[board_id] = open (diag_str, O_WRONLY | O_CREAT | O_NONBLOCK, 0644);
-                                #endif
-                            #endif
-                        #else
-                            #ifdef SINGLE_FILE
-                                diag_ofile = fopen (diag_str, "wb");
-                                diag_file_buffer = (char*)malloc(FILE_BUF_SIZE);
-                                setvbuf(diag_ofile, diag_file_buffer, _IOFBF, FILE_BUF_SIZE);
-                            #else
-                                #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                                    diag_ofile[board_id][ch_id] = fopen (diag_str, "wb");
-                                    diag_file_buffer[board_id][ch_id] = (char*)malloc(FILE_BUF_SIZE);
-                                    setvbuf(diag_ofile[board_id][ch_id], diag_file_buffer[board_id][ch_id], _IOFBF, FILE_BUF_SIZE);
-                                #else
-                                    diag_ofile[board_id] = fopen (diag_str, "wb");
-                                    diag_file_buffer[board_id] = (char*)malloc(FILE_BUF_SIZE);
-                                    setvbuf(diag_ofile[board_id], diag_file_buffer[board_id], _IOFBF, FILE_BUF_SIZE);
-                                #endif
-                            #endif
-                        #endif
-                    #endif // DEBUG_OUTPUT_FILE
-                }
+	if (singleshot == SHOT_OFF)
+		for (i = 1; i <= nslots; i++)
+			if (totbytesInLargestFile < slots[i].bytes)
+				totbytesInLargestFile = slots[i].bytes;
 
-                printf("First event received from: ");
-                #ifdef SINGLE_FILE
-                #else
-                    printf("BOARD_ID: %3.3i ",board_id);
-                    #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                        printf("CH_ID: %01X ",ch_id);
-                    #endif
-                #endif
-                #ifdef SINGLE_FILE
-                if (FILE_OPEN_CHECK(ofile)){
-                #else
-                #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                if (FILE_OPEN_CHECK(ofile[board_id][ch_id])){
-                #else
-                if (FILE_OPEN_CHECK(ofile[board_id])){
-                #endif
-                    if (min_board_id > board_id)
-                        min_board_id = board_id;
-                    if (max_board_id < board_id)
-                        max_board_id = board_id;
-                #endif
-                    printf ("Opened new file %s\n", str);
-                }
-                else
-                    {
-                        printf ("ERROR\nERROR: failed to open file %s, quit\n", str);
-                        forced_stop();
-                    };
-            };
+	/* open the next chunk's files while this one fills, looking one buffer
+	   ahead as the check for the end of the chunk does */
 
-        /* write GEB header out */
-        #ifndef NO_SAVE_BUT_STILL_PROCESS
-            #ifdef WRITEGTFORMAT
-                #ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
-                    #ifdef SINGLE_FILE
-                        wstat = nonblocking_file_write(ofile, (char *) &Geb, sizeof (GEBDATA));
-                    #else
-                        #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                            wstat = nonblocking_file_write(ofile[board_id][ch_id], (char *) &Geb, sizeof (GEBDATA));
-                        #else
-                            wstat = nonblocking_file_write(ofile[board_id], (char *) &Geb, sizeof (GEBDATA));
-                        #endif
-                    #endif
-                    if (wstat != sizeof (GEBDATA))
-                    {
-                        printf("FILE WRITE ERROR: BOARD: %i CH: %0X", board_id, ch_id);
-                        forced_stop();
-                        return -4;
-                    }
-                #else
-                    #ifdef SINGLE_FILE
-                        wstat = fwrite ((char *) &Geb, sizeof (GEBDATA), 1, ofile);
-                    #else
-                        #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                            wstat = fwrite ((char *) &Geb, sizeof (GEBDATA), 1, ofile[board_id][ch_id]);
-                        #else
-                            wstat = fwrite ((char *) &Geb, sizeof (GEBDATA), 1, ofile[board_id]);
-                        #endif
-                    #endif
-                    if (wstat != 1)
-                    {
-                        printf("FILE WRITE ERROR: BOARD: %i CH: %0X", board_id, ch_id);
-                        forced_stop();
-                        return -4;
-                    }
-                #endif
-                #ifdef SINGLE_FILE
-                    bytes_written_to_file += sizeof (GEBDATA);
-                #else
-                    #ifdef FILE_PER_CHANNEL	// MBO 20200620:
-                        bytes_written_to_file[board_id][ch_id] += sizeof (GEBDATA);
-                    #else
-                        bytes_written_to_file[board_id] += sizeof (GEBDATA);
-                    #endif
-                #endif
-
-                *writtenBytes += sizeof (GEBDATA);
-            #else // if not defined WRITEGTFORMAT
-                #ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
-                    #ifdef SINGLE_FILE
-                        wstat = nonblocking_file_write(ofile, (char *) &(soe), sizeof (soe));
-                    #else
-                        #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                            wstat = nonblocking_file_write(ofile[board_id][ch_id], (char *) &(soe), sizeof (soe));
-                        #else
-                            wstat = nonblocking_file_write(ofile[board_id], (char *) &(soe), sizeof (soe));
-                        #endif
-                    #endif
-                    if (wstat != sizeof (soe))
-                    {
-                        printf("FILE WRITE ERROR: BOARD: %i CH: %0X", board_id, ch_id);
-                        forced_stop();
-                        return -4;
-                    }
-                #else
-                    #ifdef SINGLE_FILE
-                        wstat = fwrite ((char *) &(soe), sizeof (soe), 1, ofile);
-                    #else
-                        #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                            wstat = fwrite ((char *) &(soe), sizeof (soe), 1, ofile[board_id][ch_id]);
-                        #else
-                            wstat = fwrite ((char *) &(soe), sizeof (soe), 1, ofile[board_id]);
-                        #endif
-                    #endif
-                    if (wstat != 1)
-                    {
-                        printf("FILE WRITE ERROR: BOARD: %i CH: %0X", board_id, ch_id);
-                        forced_stop();
-                        return -4;
-                    }
-                #endif
-                #ifdef SINGLE_FILE
-                    bytes_written_to_file += sizeof (soe);
-                #else
-                    #ifdef FILE_PER_CHANNEL	// MBO 20200620:
-                        bytes_written_to_file[board_id][ch_id] += sizeof (soe);
-                    #else
-                        bytes_written_to_file[board_id] += sizeof (soe);
-                    #endif
-                #endif
-
-                *writtenBytes += sizeof (soe);
-            #endif // WRITEGTFORMAT
-
-            /* write payload out */
-            if (is_digitizer_data)
-            {
-                #ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
-                    #ifdef SINGLE_FILE
-                        wstat = nonblocking_file_write(ofile, (char *) (buffer + buffer_position), packet_length_in_bytes);
-                    #else
-                        #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                            wstat = nonblocking_file_write(ofile[board_id][ch_id], (char *) (buffer + buffer_position), packet_length_in_bytes);
-                        #else
-                            wstat = nonblocking_file_write(ofile[board_id], (char *) (buffer + buffer_position), packet_length_in_bytes);
-                        #endif
-                    #endif
-                    if (wstat != packet_length_in_bytes)
-                    {
-                        printf("FILE WRITE ERROR: BOARD: %i CH: %0X", board_id, ch_id);
-                        forced_stop();
-                        return -4;
-                    }
-                #else
-                    #ifdef SINGLE_FILE
-                        wstat = fwrite ((char *) (buffer + buffer_position), packet_length_in_bytes, 1, ofile);
-                    #else
-                        #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                            wstat = fwrite ((char *) (buffer + buffer_position), packet_length_in_bytes, 1, ofile[board_id][ch_id]);
-                        #else
-                            wstat = fwrite ((char *) (buffer + buffer_position), packet_length_in_bytes, 1, ofile[board_id]);
-                        #endif
-                    #endif
-                    if (wstat != 1)
-                    {
-                        printf("FILE WRITE ERROR: BOARD: %i CH: %0X", board_id, ch_id);
-                        forced_stop();
-                        return -4;
-                    }
-                #endif
-            }
-            else if (is_trigger_data)
-            {
-                #ifdef DEBUG_OUTPUT_FILE
-                    #ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
-                    #else
-                        #ifdef SINGLE_FILE
-                        #else
-                            #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                                for( unsigned int i = 0; i < 12; i++){
-                                    fprintf(diag_ofile[board_id][ch_id], "%08X\n", reformatted_hdr[i]);
-                                }
-                            #else
-                                fprintf(diag_ofile[board_id], "%08X\n", (char *)(&(reformatted_hdr[0])));
-                            #endif
-                        #endif
-                    #endif
-                #endif // DEBUG_OUTPUT_FILE
-                #ifdef USE_POSIX_FILE_LIB	// MBO 20200616:
-                    #ifdef SINGLE_FILE
-                        wstat = nonblocking_file_write(ofile, (char *)(&(reformatted_hdr[1])), packet_length_in_bytes);
-                    #else
-                        #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                            wstat = nonblocking_file_write(ofile[board_id][ch_id], (char *)(&(reformatted_hdr[1])), packet_length_in_bytes);
-                        #else
-                            wstat = nonblocking_file_write(ofile[board_id], (char *)(&(reformatted_hdr[1])), packet_length_in_bytes);
-                        #endif
-                    #endif
-                    if (wstat != packet_length_in_bytes)
-                    {
-                        printf("FILE WRITE ERROR: BOARD: %i CH: %0X", board_id, ch_id);
-                        forced_stop();
-                        return -4;
-                    }
-                #else
-                    #ifdef SINGLE_FILE
-                        wstat = fwrite ((char *)(&(reformatted_hdr[1])), packet_length_in_bytes, 1, ofile);
-                    #else
-                        #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                            wstat = fwrite ((char *)(&(reformatted_hdr[1])), packet_length_in_bytes, 1, ofile[board_id][ch_id]);
-                        #else
-                            wstat = fwrite ((char *)(&(reformatted_hdr[1])), packet_length_in_bytes, 1, ofile[board_id]);
-                        #endif
-                    #endif
-                    if (wstat != 1)
-                    {
-                        printf("FILE WRITE ERROR: BOARD: %i CH: %0X", board_id, ch_id);
-                        forced_stop();
-                        return -4;
-                    }
-                #endif
-            }
-        #endif // NO_SAVE_BUT_STILL_PROCESS
-        #ifdef SINGLE_FILE
-            bytes_written_to_file += packet_length_in_bytes;
-        #else
-            #ifdef FILE_PER_CHANNEL	// MBO 20200620:
-                bytes_written_to_file[board_id][ch_id] += packet_length_in_bytes;
-            #else
-                bytes_written_to_file[board_id] += packet_length_in_bytes;
-            #endif
-        #endif
-        *writtenBytes += packet_length_in_bytes;
-        #ifdef FILTER_TYPE_F
-        }	// end if header_type != 0xF
-        #else
-        }   // end else
-        #endif
-        if (is_trigger_data)
-        {
-            buffer_position += TRIG_MIN_HEADER_LENGTH_BYTES;
-        }
-        else
-        {
-            buffer_position += packet_length_in_bytes;
-        }
-        buffer_uint32 = (uint32_t *) (buffer + buffer_position);
+	if (singleshot == SHOT_OFF && save_mode == SAVE_FILES && !preopen_asked
+		&& (totbytesInLargestFile + num_bytes_read) > max_file_size / 100 * PREOPEN_PERCENT)
+		chunk_preopen_ask ();
 
-//		if (header_type == 0xF)
-//		{
-//			printf("\n\ntype F: %08X %08X %08X %X %X \n\n", hdr[0],  hdr[1],  hdr[2], event_type, ch_id);
-//		}
+	// the chunk thread closes stdio files through io_uring too
+	if (use_uring)
+		{
+			pthread_mutex_lock (&ur_lock);
+			uringWriteSubmit (0);
+			pthread_mutex_unlock (&ur_lock);
+		}
+}
 
-        if ((header_type == 0xF) && (event_type == 0x0) && (ch_id == 0xD))
-        {
-            close_board(board_id);
-            exit_if_all_files_closed();
-        }
-    };
+/*----------------------------------------------------------------------*/
 
-	if (badctr)
-		printf ("%d write failures out of %d packets\n", badctr, badctr + goodctr);
+void writeLoop (void)
+{
+	struct rcvBuffer *buf;
+	int64_t tnow = 0, tthen = 0, tparse;
 
+	while (1)
+		{
+			// a second at most between looks at caught_signal
+			buf = rcvRingGetFull (1);
+			if (buf)
+				{
+					tparse = nowRealNs ();
+					writeBuffer (buf->data, buf->len);
+					stagesDone (buf, tparse, nowRealNs ());
+					rcvRingRelease (buf, 1);
+				}
+			if (caught_signal)
+				signal_stop ();
 
-	return retval;
-}
+			/* keep user informed even if we have no counts */
 
+			tnow = time (NULL);
+			if ((tnow - tthen) >= SUMMARY_OUTPUT_INTERVAL)
+				{
+					if (has_connected == 1)
+						print_info (totbytes);
+					else
+						{
+							int32_t i;
+
+							for (i = 0; i < nrcvr; i++)
+								if (rcvr[i]->state != RCVR_CONNECTED)
+									printf ("waiting for connection to %s... (%i attempts)\n", rcvr[i]->host, rcvr[i]->nattempts);
+							puts ("");
+						}
+					tthen = tnow;
+				};
+		}
+}
 
 /*----------------------------------------------------------------------*/
 
@@ -2162,86 +4251,273 @@ main (int32_t argc, char **argv)
 
 	/* declarations */
 
-	int32_t st, ns, nwritten;
-	char *Receiver;
-	int64_t tnow = 0, tthen = 0;
-	char hostIP[INET_ADDRSTRLEN];
+	struct rcvrInstance *Receiver;
+	char hostIP[INET_ADDRSTRLEN + 8];			 /* with :port */
+	char hostlist[512];
+	char *host;
+	char *port;
 	struct hostent *hp;
-	int8_t *input1;
-	int8_t *input2;
-	int32_t num_bytes_read = 0;
-	//int64_t bytes_written_to_file = 0; // MBO 20200619:  changed to array
+	pthread_t rcv_thread;
+	sigset_t sigs;
+	int32_t opt;
 
-	#ifdef SINGLE_FILE
-	#else
-		#if defined(SINGLESHOT) && defined(FULL_FILE_MODE)
-			uint32_t all_inhibited;
-		#endif // defined
-		uint32_t i;
-		#ifdef FILE_PER_CHANNEL	// MBO 20200616:
-			int32_t j;
-		#endif // FILE_PER_CHANNEL
-	#endif // SINGLE_FILE
+	#ifdef __WIN32__
+		// Declare and initialize variables
+		WSADATA wsaData;
+		int32_t iResult;
+		// Initialize Winsock
+		iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
+		if (iResult != 0) {
+			printf("WSAStartup failed: %d\n", iResult);
+			return 1;
+		}
+	#endif // __WIN32__
+
+	/* options, ahead of the positional arguments */
+
+	while ((opt = getopt (argc, argv, "w:aub:L:P:r:Sj:q:Q:W:D:F:fn:1:po:R")) != -1)
+		switch (opt)
+			{
+			case 'w':
+				request_window = atoi (optarg);
+				if (request_window < 1 || request_window > MAX_REQUEST_WINDOW)
+					{
+						printf ("request window must be 1 to %i\n", MAX_REQUEST_WINDOW);
+						exit (1);
+					};
+				break;
+			case 'a':
+				adaptive_window = 1;
+				break;
+			case 'u':
+				use_uring = 1;
+				break;
+			case 'L':
+				low_latency = 1;
+				rcv_cpu = atoi (optarg);
+				break;
+			case 'P':
+				rcv_priority = atoi (optarg);
+				if (rcv_priority < sched_get_priority_min (SCHED_FIFO) || rcv_priority > sched_get_priority_max (SCHED_FIFO))
+					{
+						printf ("SCHED_FIFO priority must be %i to %i\n", sched_get_priority_min (SCHED_FIFO), sched_get_priority_max (SCHED_FIFO));
+						exit (1);
+					};
+				break;
+			case 'S':
+				use_credit = 1;
+				break;
+			case 'r':
+				retry_min_ms = atoi (optarg);
+				retry_max_ms = strchr (optarg, ':') ? atoi (strchr (optarg, ':') + 1) : retry_min_ms;
+				if (retry_min_ms < 1 || retry_max_ms < retry_min_ms)
+					{
+						printf ("reconnect delays must be 1 <= min <= max ms\n");
+						exit (1);
+					};
+				break;
+			case 'j':
+				nwriters = atoi (optarg);
+				if (nwriters < 1 || nwriters > WRITE_THREADS_MAX)
+					{
+						printf ("writer threads must be 1 to %i\n", WRITE_THREADS_MAX);
+						exit (1);
+					};
+				break;
+			case 'q':
+				io_threads = atoi (optarg);
+				if (io_threads < 0 || io_threads > IO_THREADS_MAX)
+					{
+						printf ("IO threads must be 0 to %i\n", IO_THREADS_MAX);
+						exit (1);
+					};
+				break;
+			case 'Q':
+				io_limit = atoi (optarg);
+				if (io_limit < 1)
+					{
+						printf ("the IO queue must be at least 1 MB\n");
+						exit (1);
+					};
+				break;
+			case 'W':
+				pace_bytes = (int64_t) atoi (optarg) * 1024 * 1024;
+				if (pace_bytes < 0)
+					{
+						printf ("the writeback window must be 0 (off) or more MB\n");
+						exit (1);
+					};
+				break;
+			case 'D':
+				if (strcmp (optarg, "geb") == 0)
+					gt_format = 1;
+				else if (strcmp (optarg, "raw") == 0)
+					gt_format = 0;
+				else
+					argc = 0;
+				break;
+			case 'F':
+				if (strcmp (optarg, "channel") == 0)
+					file_layout = FILES_PER_CHANNEL;
+				else if (strcmp (optarg, "board") == 0)
+					file_layout = FILES_PER_BOARD;
+				else if (strcmp (optarg, "single") == 0)
+					file_layout = FILES_SINGLE;
+				else
+					argc = 0;
+				break;
+			case 'f':
+				filter_type_f = 1;
+				break;
+			case 'n':
+				if (strcmp (optarg, "process") == 0)
+					save_mode = SAVE_PROCESS_ONLY;
+				else if (strcmp (optarg, "none") == 0)
+					save_mode = SAVE_NOTHING;
+				else
+					argc = 0;
+				break;
+			case '1':
+				if (strcmp (optarg, "first") == 0)
+					singleshot = SHOT_FIRST;
+				else if (strcmp (optarg, "all") == 0)
+					singleshot = SHOT_ALL;
+				else
+					argc = 0;
+				break;
+			case 'p':
+				file_io = FILE_IO_POSIX;
+				direct_io = 0;
+				break;
+			case 'o':
+				direct_io = 0;
+				if (strcmp (optarg, "staged") == 0)
+					file_io = FILE_IO_STAGED;
+				else if (strcmp (optarg, "direct") == 0)
+				{
+					file_io = FILE_IO_STAGED;
+					direct_io = 1;
+				}
+				else if (strcmp (optarg, "stdio") == 0)
+					file_io = FILE_IO_STDIO;
+				else if (strcmp (optarg, "posix") == 0)
+					file_io = FILE_IO_POSIX;
+				else
+					argc = 0;
+				break;
+			case 'R':
+				resync = 1;
+				break;
+			case 'b':
+				rcvbuf_fixed = atoi (optarg);
+				if (rcvbuf_fixed < 4096)
+					{
+						printf ("socket receive buffer must be at least 4096 bytes\n");
+						exit (1);
+					};
+				break;
+			default:
+				argc = 0;
+			}
+	argv += optind - 1;
+	argc -= optind - 1;
+
+	/* the io_uring write engine sits under stdio */
+
+	if (use_uring && file_io == FILE_IO_STAGED)
+		{
+			if (direct_io)
+				printf ("-o direct ignored: -u writes through stdio\n");
+			file_io = FILE_IO_STDIO;
+			direct_io = 0;
+		}
+
+	/* the IO threads write staged blocks; -Q is kept in blocks */
+
+	if (io_threads > 0 && file_io != FILE_IO_STAGED)
+		{
+			printf ("-q ignored: only staged writes (-o staged or direct, no -u) are queued\n");
+			io_threads = 0;
+		}
+	io_limit = (int32_t) (((int64_t) io_limit * 1024 * 1024 + FILE_STAGE_SIZE - 1) / FILE_STAGE_SIZE);
+
+	/* pacing follows the staged blocks; O_DIRECT has no page cache to pace */
+
+	if (pace_bytes && (file_io != FILE_IO_STAGED || direct_io))
+		{
+			printf ("-W ignored: only -o staged writes are paced\n");
+			pace_bytes = 0;
+		}
 
+	/* one file cannot be shared out by board */
 
-	// Show version and all build switches"
+	if (file_layout == FILES_SINGLE && nwriters > 1)
+		{
+			printf ("-j ignored: a single file is written by one thread\n");
+			nwriters = 1;
+		}
+
+	// Show version, the output mode and the build switches
 	printf ("dgsReceiver.cpp V%s \n", VERSION);
 	printf ("\n");
 	// Now list build parameteres:
-	printf ("Compiled with the following options:\n");
-    #if defined(NO_SAVE) || defined(NO_SAVE_BUT_STILL_PROCESS)
+	printf ("Running with the following options:\n");
+    if (save_mode != SAVE_FILES)
         for (int32_t sim = 0; sim < 20; sim++)
             printf ("!!! SIMULATION MODE !!!  NO DATA WILL BE SAVED !!!\n");
-    #else
-        #ifdef WRITEGTFORMAT
-            printf ("Data Format: Geb\n");
-        #else
-            printf ("Data Format: RAW\n");
-        #endif
-    #endif // defined
-    #ifdef SINGLESHOT
+    else if (gt_format)
+        printf ("Data Format: Geb\n");
+    else
+        printf ("Data Format: RAW\n");
+    if (singleshot != SHOT_OFF)
+    {
         printf ("Operating Mode: Single Shot\n");
-		#ifdef FULL_FILE_MODE
-			printf ("Stop Mode: All Files Full\n");
-		#else
-			printf ("Stop Mode: First File Full\n");
-		#endif // FULL_FILE_MODE
-	#else
-	    printf ("Operating Mode: Continuous\n");
-    #endif // SINGLESHOT
-    #ifdef USE_POSIX_FILE_LIB
+        if (singleshot == SHOT_ALL)
+            printf ("Stop Mode: All Files Full\n");
+        else
+            printf ("Stop Mode: First File Full\n");
+    }
+    else
+        printf ("Operating Mode: Continuous\n");
+    if (file_io == FILE_IO_POSIX)
         printf ("Disk IO Library: POSIX\n");
-    #else
+    else if (file_io == FILE_IO_STAGED && direct_io)
+        printf ("Disk IO Library: POSIX O_DIRECT, %i kB staged blocks, files preallocated\n", FILE_STAGE_SIZE / 1024);
+    else if (file_io == FILE_IO_STAGED)
+        printf ("Disk IO Library: POSIX, %i kB staged blocks\n", FILE_STAGE_SIZE / 1024);
+    else
         printf ("Disk IO Library: ANSI C\n");
-    #endif
     #ifdef __WIN32__
         printf ("Network Library: Winsock2\n");
     #else
         printf ("Network Library: GNU\n");
     #endif
-    #ifdef FILTER_TYPE_F
+    printf ("Header Decode: %s\n", dgsDecodeInit ());
+    if (filter_type_f)
         printf ("Type F Message Filter: Enabled\n");
-    #else
+    else
         printf ("Type F Message Filter: Disabled\n");
-    #endif // FILTER_TYPE_F
-    #ifdef SINGLE_FILE
+    if (file_layout == FILES_SINGLE)
         printf ("Data Organization: File per IOC\n");
-    #else
-        #ifdef FILE_PER_CHANNEL
-            printf ("Data Organization: File per Channel\n");
-        #else
-            printf ("Data Organization: File per Digitizer\n");
-        #endif // FILE_PER_CHANNEL
-    #endif // SINGLE_FILE
+    else if (file_layout == FILES_PER_CHANNEL)
+        printf ("Data Organization: File per Channel\n");
+    else
+        printf ("Data Organization: File per Digitizer\n");
     #ifdef FOLDER_PER_RUN
         printf ("Folder Organization: Folder per Run\n");
     #else
         printf ("Folder Organization: Common Folder\n")
     #endif // FOLDER_PER_RUN
 	#ifndef DUMP_UNKNOWN_DATA_TO_DISK
-        printf ("Unknown Data Handling Mode: Stop Run\n");
+        if (resync)
+            printf ("Unknown Data Handling Mode: Skip to the Next Packet\n");
+        else
+            printf ("Unknown Data Handling Mode: Stop Run\n");
 	#else
-        printf ("Unknown Data Handling Mode: Write to Diagnostic File\n");
+        if (resync)
+            printf ("Unknown Data Handling Mode: Write to Diagnostic File, Skip to the Next Packet\n");
+        else
+            printf ("Unknown Data Handling Mode: Write to Diagnostic File\n");
 	#endif
 	#ifndef DEBUG_OUTPUT_FILE
 	    printf ("Diagnostic ASCII File Output: Disabled\n");
@@ -2252,87 +4528,102 @@ main (int32_t argc, char **argv)
 	printf ("\n");
 	printf ("\n");
 
-	#ifdef __WIN32__
-		// Declare and initialize variables
-		WSADATA wsaData;
-		int32_t iResult;
-		// Initialize Winsock
-		iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
-		if (iResult != 0) {
-			printf("WSAStartup failed: %d\n", iResult);
-			return 1;
-		}
-	#endif // __WIN32__
-
-	#ifdef SINGLE_FILE
-		bytes_written_to_file = 0;
-		ofile = 0;
-	#else
-		min_board_id = 0xFFFF;
-		max_board_id = 0x0000;
-		#ifdef FILE_PER_CHANNEL	// MBO 20200616:
-			for (i = 0; i < MAXBOARDID; i++)
-				for (j = 0; j < MAXCHID; j++) {
-					bytes_written_to_file[i][j] = 0;
-					ofile[i][j] = 0;
-					#if defined(SINGLESHOT) && defined(FULL_FILE_MODE)
-						write_inhibit[i][j] = 2;
-					#endif // FULL_FILE_MODE
-				}
-		#else
-			for (i = 0; i < MAXBOARDID; i++) {
-				bytes_written_to_file[i] = 0;
-				ofile[i] = 0;
-				#if defined(SINGLESHOT) && defined(FULL_FILE_MODE)
-					write_inhibit[i] = 2;
-				#endif // FULL_FILE_MODE
-			}
-		#endif // FILE_PER_CHANNEL
-	#endif // SINGLE_FILE
-
 	/* help */
 
-	#ifdef WRITEGTFORMAT
-	if (argc == 7)
-		debug = 1;
-	#else
-	if (argc == 6)
+	if (argc == 6 + gt_format)
 		debug = 1;
-	#endif
 
-	#ifdef WRITEGTFORMAT
-	if (argc < 5)
-	#else
-	if (argc < 4)
-	#endif
+	if (argc < 4 + gt_format)
 		{
 			printf ("\n");
 			printf ("argc=%i\n",argc);
 			printf ("\n");
-			#ifdef WRITEGTFORMAT
-				printf ("use: dgsReceiver <server> <filename> <extension_prefix> <maxfilesize> <GEBID> \n");
+			if (gt_format)
+			{
+				printf ("use: dgsReceiver [options] <server> <filename> <extension_prefix> <maxfilesize> <GEBID> \n");
 				printf ("                  1        2        3      4       5       \n");
 				printf ("e.g: dgsReceiver ioc1 data_run_001 gtd 2000000000 14		\n");
-			#else
-				printf ("use: dgsReceiver <server> <filename> <extension_prefix> <maxfilesize> \n");
+			}
+			else
+			{
+				printf ("use: dgsReceiver [options] <server> <filename> <extension_prefix> <maxfilesize> \n");
 				printf ("                    1         2     3      4      \n");
 				printf ("e.g: dgsReceiver ioc1 data_run_001 gtd 2000000000 \n");
-			#endif //WRITEGTFORMAT
+			}
+			printf ("\n");
+			printf ("<server> may also be a comma-separated list of IOCs, e.g. ioc1,ioc2,ioc3.\n");
+			printf ("All of them are then served by this one receiver process.\n");
+			printf ("Each IOC may be given as host:port to use a port other than %i.\n", SERVER_PORT);
+			printf ("\n");
+			printf ("options:\n");
+			printf ("  -w <n>  keep n requests outstanding with each IOC (default %i, max %i)\n", REQUEST_WINDOW, MAX_REQUEST_WINDOW);
+			printf ("  -a      adapt the request window to the replies, starting from -w:\n");
+			printf ("          wider while summaries come back full, narrower while\n");
+			printf ("          INSUFF_DATA replies dominate\n");
+			printf ("  -S      credit-based streaming: grant the IOC credit for -w buffers and\n");
+			printf ("          let it stream them, instead of one request per buffer.  The IOC\n");
+			printf ("          must support it (psNet.h, CLIENT_GRANT_CREDIT).\n");
+			printf ("  -u      use io_uring for socket receives and file writes, if the\n");
+			printf ("          kernel supports it (default epoll and -o)\n");
+			printf ("  -b <n>  socket receive buffer of n bytes per IOC (default: sized from\n");
+			printf ("          the SERVER_SUMMARY recLen, %i kB to %i MB)\n", RCVBUF_MIN / 1024, RCVBUF_MAX / 1048576);
+			printf ("  -L <c>  low-latency profile: the receive thread spins instead of sleeping,\n");
+			printf ("          pinned to cpu c (-1 = not pinned), with SO_BUSY_POLL, TCP_NODELAY\n");
+			printf ("          and TCP_QUICKACK on the sockets, and INSUFF_DATA is asked again at\n");
+			printf ("          once instead of after a pause.  Give it a core of its own.\n");
+			printf ("  -P <p>  run the receive thread SCHED_FIFO at priority p (needs CAP_SYS_NICE)\n");
+			printf ("  -r <min>[:<max>]  reconnect delay in ms, doubling from min to max after each\n");
+			printf ("          failed attempt (default %i:%i).  A lost connection is retried at once.\n", CONNECT_RETRY_MIN_MS, CONNECT_RETRY_MAX_MS);
+			printf ("  -j <n>  write with n threads (default 1, max %i); the files are shared out\n", WRITE_THREADS_MAX);
+			printf ("          by board id, so each file is still written by one thread in order\n");
+			printf ("  -q <n>  with -o staged or direct, queue the full blocks of each file for n IO threads\n");
+			printf ("          (max %i) instead of writing them in line, so a slow disk or file\n", IO_THREADS_MAX);
+			printf ("          does not hold up the others (default 0)\n");
+			printf ("  -Q <MB> most data queued for the IO threads; the writers wait beyond it\n");
+			printf ("          (default %i)\n", IO_QUEUE_MB);
+			printf ("  -W <MB> with -o staged, pace the writeback: every <MB> of a file start\n");
+			printf ("          writing it out, wait for the <MB> before and drop it from the page\n");
+			printf ("          cache, so dirty pages stay flat and closing a chunk is quick\n");
+			printf ("          (default 0, off)\n");
+			printf ("  -R      resync: after a corrupt or misaligned packet, skip to the next SOE\n");
+			printf ("          that starts a sound packet instead of dropping the rest of the\n");
+			printf ("          buffer.  The skipped bytes go to the diagnostic file.\n");
+			printf ("\n");
+			printf ("output mode (the defaults are the build switches):\n");
+			printf ("  -D geb|raw  GEB headers (<GEBID> is then given), or the raw packets with\n");
+			printf ("          their 0xAAAAAAAA words (default %s)\n", DEFAULT_GT_FORMAT ? "geb" : "raw");
+			printf ("  -F channel|board|single  a file per channel, per digitizer or per IOC\n");
+			printf ("          (default %s)\n", DEFAULT_FILE_LAYOUT == FILES_SINGLE ? "single" : DEFAULT_FILE_LAYOUT == FILES_PER_BOARD ? "board" : "channel");
+			printf ("  -f      drop the type F headers\n");
+			printf ("  -n process|none  save nothing: parse the data but do not write it, or\n");
+			printf ("          only receive it\n");
+			printf ("  -1 first|all  single shot: stop when the first file, or all open files,\n");
+			printf ("          reach <maxfilesize>, instead of starting a new chunk\n");
+			printf ("  -o staged|direct|stdio|posix  how the files are written: staged in %i kB\n", FILE_STAGE_SIZE / 1024);
+			printf ("          blocks per file that go out with one writev each; the same with\n");
+			printf ("          O_DIRECT, past the page cache, each file preallocated %i MB ahead\n", PREALLOC_MB);
+			printf ("          of its data, up to <maxfilesize>;\n");
+			printf ("          through stdio; or with a write() per header and payload\n");
+			printf ("          (default %s; stdio with -u)\n", DEFAULT_FILE_IO == FILE_IO_POSIX ? "posix" : "staged");
+			printf ("  -p      same as -o posix\n");
 			printf ("\n");
 			printf ("<filename> specifies the base file name.\n");
 			printf ("<extension_prefix> specifies the start of the second part of the file name.\n");
-            #ifdef SINGLE_FILE
+            if (file_layout == FILES_SINGLE)
+            {
 			printf ("The actual file name will be <filename>_<chunk number>\n");
 			printf ("e.g. data_run_001.gtd_001\n");
-            #else
-                #ifdef FILE_PER_CHANNEL
+            }
+            else if (file_layout == FILES_PER_CHANNEL)
+            {
             printf ("The actual file name will be <filename>.<extension_prefix>_<chunk number>_<board_id>_<ch_id>\n");
             printf ("e.g. data_run_001.gtd_001_1234_3 = Chunk:1, Board_ID:1234, Ch_ID:3\n");
-                #else
+            }
+            else
+            {
             printf ("The actual file name will be <filename>.<extension_prefix>_<chunk number>_<board_id>\n");
             printf ("e.g. data_run_001.gtd_001_1234 = Chunk:1, Board_ID:1234\n");
-                #endif // FILE_PER_CHANNEL
-            #endif // SINGLE_FILE
+            }
  			printf ("\n");
 			printf ("<maxfilesize> specifies the max file size in bytes. If a file\n");
 			printf ("runs over the limit a new file will be opened with a new\n");
@@ -2342,10 +4633,12 @@ main (int32_t argc, char **argv)
 			printf ("\n");
 			printf ("When any file in a chunk reaches the chunk files size limit,\n");
 			printf ("all files in that chunk are closed and new data will be stored in\n");
-			printf ("the next chunk.\n");
+			printf ("the next chunk.  The next chunk's files are opened ahead once the\n");
+			printf ("largest file is %i%% full; any that get no data are removed.\n", PREOPEN_PERCENT);
 			printf ("\n");
 			printf ("\n");
-			#ifdef WRITEGTFORMAT
+			if (gt_format)
+			{
 				printf ("<GEBID> has no effect on the operation of the receiver.  This number\n");
 				printf ("is simply passed to the geb headers in the output data files.\n");
 				printf ("\n");
@@ -2358,7 +4651,7 @@ main (int32_t argc, char **argv)
 				printf ("      appropriate type 'F' message from the IOC, and it will close\n");
 				printf ("      out any open files cleanly and properly shutdown for either scenario.\n");
 				printf ("\n");
-			#endif // WRITEGTFORMAT
+			}
 			exit (0);
 		};
 
@@ -2372,15 +4665,9 @@ main (int32_t argc, char **argv)
 
 	/* get/hide output file name in global string */
 
-	#ifdef FOLDER_PER_RUN
-		#ifdef __WIN32__
-			sprintf (fn, "%s\\%s.%s_%3.3i", argv[2], argv[2], argv[3], chunck);
-		#else
-			sprintf (fn, "%s/%s.%s_%3.3i", argv[2], argv[2], argv[3], chunck);
-		#endif // __WIN32__
-    #else
-        sprintf (fn, "%s.%s_%3.3i", argv[2], argv[3], chunck);
-    #endif // FOLDER_PER_RUN
+	runname = argv[2];
+	extprefix = argv[3];
+	set_file_name ();
 
     #ifdef FOLDER_PER_RUN
         int32_t mkdir_ret;
@@ -2399,231 +4686,125 @@ main (int32_t argc, char **argv)
 	signal (SIGINT, signal_catcher);
 
 	/* find the servers IP address and check */
+	/* <server> may list several IOCs, separated by commas */
 
-	hp = gethostbyname (argv[1]);
-
-	if (hp == NULL)
-		{
-			printf ("cannot find IP for host \"%s\", gethostbyname returns %p\n", argv[1], (void*)(hp));
-			fflush (stdout);
-			exit (1);
-		};
-
-	if (hp->h_addrtype != AF_INET)
+	snprintf (hostlist, sizeof (hostlist), "%s", argv[1]);
+	for (host = strtok (hostlist, ","); host != NULL; host = strtok (NULL, ","))
 		{
-			printf (" hp->h_addrtype != AF_INET for \"%s\"\n", argv[1]);
-			fflush (stdout);
-			exit (1);
-		};
-	#ifdef __WIN32__
-		sprintf (hostIP, "%s", inet_ntoa (*(in_addr*)(hp->h_addr)));
-	#else
-		sprintf (hostIP, "%s", inet_ntop (hp->h_addrtype, hp->h_addr, hostIP, sizeof (hostIP)));
-	#endif // __WIN32__
-
-	Receiver = (char *) calloc (sizeof (struct rcvrInstance), 1);
-	Receiver = initReceiver (hostIP);
+			if (nrcvr >= MAXIOC)
+				{
+					printf ("too many IOCs, at most %i can be served by one receiver\n", MAXIOC);
+					fflush (stdout);
+					exit (1);
+				};
 
-	#ifdef WRITEGTFORMAT
-		/* get the GEBID */
-		GEB_TYPE_DGS = atoi (argv[5]);
-	#endif // WRITEGTFORMAT
+			/* an IOC may be given as host:port, e.g. a mock IOC on localhost */
+			port = strchr (host, ':');
+			if (port)
+				*port = 0;
 
-	/* request and receive max_file_size data buffers */
-	/* ns and usleep is used to slow down */
-	/* requests if there is no data or not */
-	/* enough data */
+			hp = gethostbyname (host);
 
-	max_file_size = atoi (argv[4]);
+			if (hp == NULL)
+				{
+					printf ("cannot find IP for host \"%s\", gethostbyname returns %p\n", host, (void*)(hp));
+					fflush (stdout);
+					exit (1);
+				};
 
-	ns = 1;
-	while (1)
-		{
-			/* get a data buffer */
+			if (hp->h_addrtype != AF_INET)
+				{
+					printf (" hp->h_addrtype != AF_INET for \"%s\"\n", host);
+					fflush (stdout);
+					exit (1);
+				};
+			#ifdef __WIN32__
+				sprintf (hostIP, "%s", inet_ntoa (*(in_addr*)(hp->h_addr)));
+			#else
+				sprintf (hostIP, "%s", inet_ntop (hp->h_addrtype, hp->h_addr, hostIP, sizeof (hostIP)));
+			#endif // __WIN32__
 
-			st = getReceiverData2 (Receiver, &input1, &num_bytes_read);
+			if (port)
+				{
+					*port = ':';
+					strncat (hostIP, port, sizeof (hostIP) - strlen (hostIP) - 1);
+				};
 
-			/* if we failed x.1_000delay, else */
-			/* write buffer to disk */
+			Receiver = (struct rcvrInstance *) initReceiver (hostIP);
+			if (!Receiver)
+				exit (1);
+			snprintf (Receiver->host, sizeof (Receiver->host), "%s", host);
+			Receiver->index = nrcvr;
+			rcvr[nrcvr++] = Receiver;
+		}
 
-			if (st != 0)
-				{
-					usleep (ns);
-					ns = (ns << 1);
-					if (ns > MAXNS)
-						ns = MAXNS;
+	/* get the GEBID */
+	if (gt_format)
+		GEB_TYPE_DGS = atoi (argv[5]);
 
-					/* keep user informed even if we have no counts */
+	/* request and receive max_file_size data buffers */
+	max_file_size = atoi (argv[4]);
 
-					if (ns >= MAXNS)
-						{
-							tnow = time (NULL);
-							if ((tnow - tthen) >= SUMMARY_OUTPUT_INTERVAL)
-								{
-									if (has_connected == 1)
-										print_info (totbytes);
-									else
-										puts("waiting for connection...\n");
-									tthen = tnow;
-								};
-						};
+	rcvRingInit (RCV_RING_SLOTS + nrcvr);
 
+	if (use_uring)
+		{
+			if (uringInit (&rxring, 4 * MAXIOC) < 0 || uringWriteInit () < 0)
+				{
+					printf ("io_uring not available (%s), using epoll and stdio\n", strerror (errno));
+					use_uring = 0;
 				}
 			else
 				{
-					has_connected  = 1;
-					if (ns != 1)			// MBO 20200615: added line.
-						ns = (ns >> 1);	// MBO 20200615: added line.
-                    input2 = input1;
-					do
-						{
-
-							/* if we get here we have data to dump to disk */
-							#ifndef NO_SAVE_BUT_STILL_PROCESS
-								#ifdef SINGLESHOT
-                                    #if defined(FULL_FILE_MODE) && (!defined(SINGLE_FILE))
-                                        if (min_board_id <= max_board_id)
-                                        {
-                                            all_inhibited = 1;
-                                            #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                                                for (i = min_board_id; i <= max_board_id; i++)
-                                                    for (j = 0; j < MAXCHID; j++)
-                                                        if (write_inhibit[i][j] == 0)
-                                                            all_inhibited = 0;
-                                            #else
-                                                for (i = min_board_id; i <= max_board_id; i++)
-                                                    if (write_inhibit[i] == 0)
-                                                        all_inhibited = 0;
-                                            #endif // FILE_PER_CHANNEL
-                                            if (all_inhibited == 1)
-                                                forced_stop();
-                                        }
-									#endif // defined
-								#else
-									if ((totbytesInLargestFile + num_bytes_read) > max_file_size)
-										{
-
-											/* set the new file name */
-
-											#ifdef __WIN32__
-												printf ("file size reached %I64d of %I64d limit\n", totbytesInLargestFile, max_file_size);
-											#else
-												printf ("file size reached %" PRId64 " of %" PRId64 " limit\n", totbytesInLargestFile, max_file_size);
-												
-											#endif // __WIN32__
-
-											/* properly close the old files */
-											#ifdef SINGLESHOT
-												forced_stop();
-											#else
-												close_all();
-											#endif // SINGLESHOT
-
-											chunck++;
-                                            #ifdef FOLDER_PER_RUN
-												#ifdef __WIN32__
-													sprintf (fn, "%s\\%s.%s_%3.3i", argv[2], argv[2], argv[3], chunck);
-												#else
-													sprintf (fn, "%s/%s.%s_%3.3i", argv[2], argv[2], argv[3], chunck);
-												#endif // __WIN32__
-                                            #else
-                                                sprintf (fn, "%s.%s_%3.3i", argv[2], argv[3], chunck);
-                                            #endif // FOLDER_PER_RUN
-
-											printf ("Starting new data chunk: #%3.3i\n", chunck);
-											fflush (stdout);
-
-		//									print_info (totbytes);
-										}
-								#endif // defined
-							#endif // not NO_SAVE_BUT_STILL_PROCESS
-
-
-
-							#ifndef NO_SAVE
-								st = writeEvents2 (input2, num_bytes_read, &nwritten);
-
-								if (st == 0)
-                                {
-                                    // ok
-                                }
-                                else if(st <= -3)
-                                {
-                                    printf ("failed to write data to disk\n");
-                                }
-                                else if(st == -2)
-                                {
-									#ifndef DUMP_UNKNOWN_DATA_TO_DISK
-										printf ("skipping data block\n");
-									#else
-										// Carry on.
-										st = 0;
-									#endif
-                                }
-                                else if(st == -1)
-                                {
-                                    printf ("unknown fault\n");
-                                }
-                                else
-                                {
-                                    input2 += st;
-                                    num_bytes_read -= st;
-								#if defined(SINGLESHOT) && ((!defined(FULL_FILE_MODE)) || (defined(SINGLE_FILE)))
-                                    /* properly close the old files */
-                                    forced_stop();
-                                #endif // defined
-                                }
-							#else
-								nwritten = num_bytes_read;
-							#endif
-
-							/* keep user informed */
-
-							totbytes += nwritten;
-#if(0)
-							printf ("nwritten=%i, totbytes=%lli\n", nwritten, totbytes);
-#endif
-							tnow = time (NULL);
-							if ((tnow - tthen) >=  SUMMARY_OUTPUT_INTERVAL)
-								{
-									print_info (totbytes);
-									tthen = tnow;
-								};
-
-							/* new files */
-
-							/* NOTE: we close all files at the same time	*/
-							/* so that they all have the same time stamp	*/
-							/* range because that makes it much easier	*/
-							/* to merger the data later on */
-
-							#ifndef SINGLESHOT
-                                #ifdef SINGLE_FILE
-                                    if (totbytesInLargestFile < bytes_written_to_file)
-                                        totbytesInLargestFile = bytes_written_to_file;
-                                #else
-                                    if (min_board_id <= max_board_id)
-                                    {
-                                        #ifdef FILE_PER_CHANNEL	// MBO 20200616:
-                                            for (i = min_board_id; i <= max_board_id; i++)
-                                                for (j = 0; j < MAXCHID; j++)
-                                                    if (totbytesInLargestFile < bytes_written_to_file[i][j])
-                                                        totbytesInLargestFile = bytes_written_to_file[i][j];
-                                        #else
-                                            for (i = min_board_id; i <= max_board_id; i++)
-                                                if (totbytesInLargestFile < bytes_written_to_file[i])
-                                                    totbytesInLargestFile = bytes_written_to_file[i];
-                                        #endif // FILE_PER_CHANNEL
-                                    }
-                                #endif // SINGLE_FILE
-                            #endif // SINGLESHOT
-						} while (st > 0);
+					rx_registered = (uringRegisterSparse (&rxring, ring.nslots) == 0);
+					printf ("using io_uring: %s receive buffers, %s write buffers\n",
+						rx_registered ? "fixed" : "plain", tx_registered ? "fixed" : "plain");
+				}
+		}
 
+	/* SIGINT is handled on the writer thread, which owns the files */
+
+	sigemptyset (&sigs);
+	sigaddset (&sigs, SIGINT);
+	pthread_sigmask (SIG_BLOCK, &sigs, NULL);
+	pthread_create (&rcv_thread, NULL, use_uring ? uringReceiveLoop : receiveLoop, NULL);
+	writeShardMode = pickWriter ();
+	startShards ();
+	if (nwriters > 1)
+		printf ("writing with %i threads\n", nwriters);
+	startIO ();
+	startChunks ();
+	if (pace_bytes)
+		printf ("writeback paced every %" PRId64 " MB per file\n", pace_bytes / 1024 / 1024);
+	if (io_threads > 0)
+		printf ("%i IO threads, at most %i blocks (%i MB) queued\n", io_threads, io_limit, io_limit * (FILE_STAGE_SIZE / 1024) / 1024);
+	pthread_sigmask (SIG_UNBLOCK, &sigs, NULL);
+
+	/* low-latency profile: the spinning receive thread gets a core to itself */
+
+	if (rcv_cpu >= 0)
+		{
+			cpu_set_t cpus;
 
-				};
+			CPU_ZERO (&cpus);
+			CPU_SET (rcv_cpu, &cpus);
+			if (pthread_setaffinity_np (rcv_thread, sizeof (cpus), &cpus) != 0)
+				printf ("could not pin the receive thread to cpu %i\n", rcv_cpu);
+			else
+				printf ("receive thread pinned to cpu %i\n", rcv_cpu);
+		}
+	if (rcv_priority > 0)
+		{
+			struct sched_param sp;
 
+			sp.sched_priority = rcv_priority;
+			if (pthread_setschedparam (rcv_thread, SCHED_FIFO, &sp) != 0)
+				printf ("could not make the receive thread SCHED_FIFO %i (needs CAP_SYS_NICE)\n", rcv_priority);
+			else
+				printf ("receive thread runs SCHED_FIFO %i\n", rcv_priority);
 		}
 
+	writeLoop ();
 
 	/* done (we should never really get here) */
 
@@ -0,0 +1,536 @@
+//--------------------------------------------------------------------------------
+// Company:		Argonne National Laboratory
+// Division:	Physics
+// Project:		DGS Receiver
+// File:		mockIOC.cpp
+// Description: Stand-in for a digitizer IOC.  Answers the psNet.h request
+//              protocol with synthetic DGS data, so dgsReceiver and tcp_Receiver
+//              can be run and benchmarked without a VME crate.
+//--------------------------------------------------------------------------------
+
+//g++ mockIOC.cpp -O3 -Wall -Wextra -o mockIOC
+
+#define VERSION "1.02"
+//  V1.02: -g corrupts a packet every n replies, to exercise the receiver's resync (-R).
+//  V1.01: Credit-based streaming (CLIENT_GRANT_CREDIT) besides request/response.  -q skips
+//         sequence numbers, to check the receiver notices.
+//  V1.00: Digitizer, trigger, type F and type D packets at a set rate and size.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "psNet.h"
+
+// BUILD PARAMETERS:
+// SUMMARY_OUTPUT_INTERVAL: The delay between summary updates, in seconds.
+#define SUMMARY_OUTPUT_INTERVAL 5
+// MAX_REPLY_SIZE: The largest payload of one SERVER_SUMMARY.  tcp_Receiver
+//  cannot take more than 280000 bytes in one reply.
+#define MAX_REPLY_SIZE 10000000
+// MAX_REQUESTS: Requests read from the socket at once.
+#define MAX_REQUESTS 64
+// STREAM_POLL_NS: With credit left but no event due yet, the longest wait before
+//  looking again.  Shorter waits are used when the next event is due sooner.
+#define STREAM_POLL_NS 1000000
+
+// Packet layout, as parsed by the receivers.
+#define DIG_SOE 0xAAAAAAAA
+#define TRIG_SOE 0xAAAA0000
+#define TRIG_LENGTH_UINT32 16
+#define DIG_HEADER_LENGTH_UINT32 3
+#define TYPE_F_CH_ID 0xF
+#define TYPE_D_CH_ID 0xD
+// TRIG_BOARD_ID: dgsReceiver files trigger packets under this board id.
+#define TRIG_BOARD_ID 0xF
+
+/* what to send */
+
+int32_t first_board = 1;
+int32_t nboards = 1;
+int32_t nchannels = 10;
+int32_t packet_words = 64;							 /* words after the SOE of a digitizer packet */
+int32_t reply_size = 65536;							 /* payload bytes per SERVER_SUMMARY, at most */
+double event_rate = 0;								 /* digitizer packets/s, 0 = as fast as possible */
+int32_t trigger_every = 0;							 /* one trigger packet per this many events, 0 = none */
+int32_t typef_every = 0;							 /* one type F packet per this many events, 0 = none */
+int64_t run_events = 0;								 /* type D after this many events, 0 = endless */
+int8_t sender_off = 0;								 /* SERVER_SENDER_OFF after the run instead of INSUFF_DATA */
+int32_t skip_seq_every = 0;							 /* streaming: skip a sequence number every n buffers */
+int32_t garble_every = 0;							 /* corrupt a packet every n replies, 0 = never */
+
+/* generator state, kept across connections */
+
+int64_t events = 0;									 /* digitizer packets generated */
+uint64_t timestamp = 0;
+int32_t next_channel = 0;
+int8_t run_done = 0;
+
+/* statistics */
+
+int64_t nrequests = 0, ngrants = 0, nsummary = 0, ninsuff = 0, bytessent = 0, ngarbled = 0;
+
+uint8_t *reply;
+
+/*----------------------------------------------------------------------*/
+
+double now_seconds (void)
+{
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*----------------------------------------------------------------------*/
+
+/* Words are stored big-endian, the way the IOC sends them. */
+void put_word (uint8_t *p, uint32_t w)
+{
+	uint32_t be = htonl (w);
+
+	memcpy (p, &be, sizeof (be));
+}
+
+/* One digitizer format packet at the current timestamp; length counts the
+ * words after the SOE, as in the header.
+ */
+int32_t put_digitizer (uint8_t *p, int32_t board, int32_t ch_id, int32_t length, uint32_t header_type, uint32_t event_type)
+{
+	int32_t i;
+
+	//word	| 31..27 Geo Addr | 26..16 PACKET LENGTH | 15..4 USER PACKET DATA | 3..0 CHANNEL ID
+	//		|              LEADING EDGE DISCRIMINATOR TIMESTAMP[31:0]
+	//		| 25..23 EVENT TYPE | 19..16 HEADER TYPE | 15..0 TIMESTAMP[47:32]
+	put_word (p, DIG_SOE);
+	put_word (p + 4, (length << 16) | (board << 4) | ch_id);
+	put_word (p + 8, timestamp & 0xFFFFFFFF);
+	put_word (p + 12, (event_type << 23) | (header_type << 16) | ((timestamp >> 32) & 0xFFFF));
+	for (i = DIG_HEADER_LENGTH_UINT32; i < length; i++)
+		put_word (p + 4 + 4 * i, (uint32_t) (timestamp + i) & 0x3FFF);
+	return 4 * (length + 1);
+}
+
+/* One trigger packet, 16 words with a 16-bit value in each. */
+int32_t put_trigger (uint8_t *p, uint64_t ts)
+{
+	const uint32_t trig_soe = TRIG_SOE;
+	uint16_t slot[TRIG_LENGTH_UINT32];
+	int32_t i;
+
+	// one 16-bit value per word: trigger type, timestamp 47:32, 31:16, 15:0,
+	// then wheel, multiplicity, user register, coarse timestamp, mask,
+	// four TDC offsets and the verniers
+	memset (slot, 0, sizeof (slot));
+	slot[1] = 1;
+	slot[2] = (ts >> 32) & 0xFFFF;
+	slot[3] = (ts >> 16) & 0xFFFF;
+	slot[4] = ts & 0xFFFF;
+	for (i = 5; i < TRIG_LENGTH_UINT32; i++)
+		slot[i] = (ts + i) & 0xFFFF;
+
+	// the receivers test the start of a trigger packet before swapping it
+	memcpy (p, &trig_soe, sizeof (trig_soe));
+	for (i = 1; i < TRIG_LENGTH_UINT32; i++)
+		put_word (p + 4 * i, slot[i]);
+	return 4 * TRIG_LENGTH_UINT32;
+}
+
+/*----------------------------------------------------------------------*/
+
+/* Fill up to max bytes with whole packets, as many events as the rate
+ * allows.  Returns the payload size, 0 if there is nothing to send yet.
+ * The trigger packets due go first: the receivers only accept a trigger
+ * packet at the start of a block or after another trigger packet, as on a
+ * real crate, where trigger data comes from its own IOC.
+ */
+int32_t fill_reply (uint8_t *p, int32_t max, double start)
+{
+	int32_t dig_bytes = 4 * (packet_words + 1);
+	int32_t f_bytes = 4 * (DIG_HEADER_LENGTH_UINT32 + 1);
+	int32_t trig_bytes = 4 * TRIG_LENGTH_UINT32;
+	int32_t len = 0, need, board, ch_id, i;
+	int64_t allowed, n, e;
+
+	if (run_done)
+		return 0;
+
+	allowed = (event_rate > 0) ? (int64_t) ((now_seconds () - start) * event_rate) : INT64_MAX;
+	if (run_events > 0 && allowed > run_events)
+		allowed = run_events;
+
+	/* how many events fit, with the trigger and type F packets they bring */
+	for (n = 0, need = 0, e = events; e < allowed; e++, n++)
+		{
+			need += dig_bytes;
+			if (trigger_every > 0 && (e + 1) % trigger_every == 0)
+				need += trig_bytes;
+			if (typef_every > 0 && (e + 1) % typef_every == 0)
+				need += f_bytes;
+			if (need > max)
+				break;
+		}
+
+	if (trigger_every > 0)
+		for (e = events + 1; e <= events + n; e++)
+			if (e % trigger_every == 0)
+				len += put_trigger (p + len, timestamp + 10 * (e - events - 1));
+
+	for (e = 0; e < n; e++)
+		{
+			board = first_board + next_channel / nchannels;
+			ch_id = next_channel % nchannels;
+			if (++next_channel >= nboards * nchannels)
+				next_channel = 0;
+
+			len += put_digitizer (p + len, board, ch_id, packet_words, 0, 0);
+			events++;
+			if (typef_every > 0 && events % typef_every == 0)
+				len += put_digitizer (p + len, board, TYPE_F_CH_ID, DIG_HEADER_LENGTH_UINT32, 0xF, 1);
+			timestamp += 10;
+		}
+
+	// end of run: one type D packet per board, and for the trigger files
+	if (run_events > 0 && events >= run_events && len + f_bytes * (nboards + 1) <= max)
+		{
+			for (i = 0; i < nboards; i++)
+				len += put_digitizer (p + len, first_board + i, TYPE_D_CH_ID, DIG_HEADER_LENGTH_UINT32, 0xF, 0);
+			if (trigger_every > 0)
+				len += put_digitizer (p + len, TRIG_BOARD_ID, TYPE_D_CH_ID, DIG_HEADER_LENGTH_UINT32, 0xF, 0);
+			run_done = 1;
+			printf ("run done after %lli events, sent type D\n", (long long) events);
+			fflush (stdout);
+		}
+
+	return len;
+}
+
+/* -g: overwrite the SOE of the packet about halfway into the reply, so the
+ * receiver finds the packet before it not followed by an SOE, and this one
+ * not starting with one.
+ */
+void garble (uint8_t *p, int32_t len)
+{
+	uint32_t w;
+	int32_t pos = 0;
+
+	if (garble_every <= 0 || (nsummary + 1) % garble_every != 0)
+		return;
+	while (pos < len / 2)
+		{
+			memcpy (&w, p + pos, sizeof (w));
+			if (ntohl (w) == DIG_SOE)
+				{
+					memcpy (&w, p + pos + 4, sizeof (w));
+					pos += 4 + 4 * ((ntohl (w) >> 16) & 0x7FF);
+				}
+			else
+				pos += 4 * TRIG_LENGTH_UINT32;
+		}
+	if (pos < len)
+		{
+			put_word (p + pos, 0x12345678);
+			ngarbled++;
+		}
+}
+
+/*----------------------------------------------------------------------*/
+
+int32_t send_all (int32_t sock, const uint8_t *p, int32_t len)
+{
+	int32_t n;
+
+	while (len > 0)
+		{
+			n = send (sock, p, len, MSG_NOSIGNAL);
+			if (n <= 0)
+				return -1;
+			p += n;
+			len -= n;
+		}
+	return 0;
+}
+
+/* Send the reply header, then the payload.  recLen is the total payload
+ * size, which is what both receivers expect from a DGS IOC, and recs is 1,
+ * or the sequence number of a SERVER_STREAM_SUMMARY.
+ */
+int32_t send_reply (int32_t sock, int32_t type, int32_t len, uint32_t recs)
+{
+	evtServerRetStruct *ret = (evtServerRetStruct *) reply;
+
+	ret->type = htonl (type);
+	ret->recLen = htonl (len);
+	ret->status = htonl (0);
+	ret->recs = htonl (recs);
+	if (send_all (sock, reply, sizeof (evtServerRetStruct) + len) < 0)
+		return -1;
+	bytessent += len;
+	return 0;
+}
+
+/*----------------------------------------------------------------------*/
+
+void print_info (double start)
+{
+	double t = now_seconds () - start;
+
+	printf ("%lli requests, %lli credit grants, %lli summary, %lli insuff_data, %lli events, %.1f MB in %.1f s = %.1f MB/s\n",
+		(long long) nrequests, (long long) ngrants, (long long) nsummary, (long long) ninsuff, (long long) events,
+		bytessent / 1e6, t, t > 0 ? bytessent / 1e6 / t : 0);
+	if (ngarbled > 0)
+		printf ("%lli packets corrupted\n", (long long) ngarbled);
+	fflush (stdout);
+}
+
+/*----------------------------------------------------------------------*/
+
+/* Wait for the receiver to say something.  With credit left, wait no longer
+ * than until the next event is due, so data is streamed as it comes up.
+ */
+int32_t wait_input (int32_t sock, int32_t credit, double start)
+{
+	struct pollfd pfd;
+	struct timespec ts;
+	double due;
+	int64_t ns = STREAM_POLL_NS;
+
+	if (credit > 0 && event_rate > 0)
+		{
+			due = (events + 1) / event_rate - (now_seconds () - start);
+			if (due * 1e9 < ns)
+				ns = due > 0 ? (int64_t) (due * 1e9) : 0;
+		}
+	ts.tv_sec = ns / 1000000000;
+	ts.tv_nsec = ns % 1000000000;
+	pfd.fd = sock;
+	pfd.events = POLLIN;
+	return ppoll (&pfd, 1, credit > 0 ? &ts : NULL, NULL);
+}
+
+/* Answer requests, and stream data while there is credit, until the
+ * receiver goes away.
+ */
+void serve (int32_t sock, double start)
+{
+	uint32_t in[2 * MAX_REQUESTS];
+	double lastprint = now_seconds ();
+	int32_t n, i, len, type;
+	int32_t have = 0, credit = 0;
+	int8_t ended = 0;
+	uint32_t seq = 0;
+
+	while (1)
+		{
+			n = wait_input (sock, credit, start);
+			if (n < 0 && errno != EINTR)
+				return;
+			if (n > 0)
+				{
+					n = recv (sock, (char *) in + have, sizeof (in) - have, 0);
+					if (n <= 0)
+						return;
+					have += n;
+				}
+
+			// whole request and grant packets; a partial one waits for the next read
+			for (i = 0; (i + 1) * 4 <= have; )
+				{
+					type = ntohl (in[i]);
+					if (type == CLIENT_GRANT_CREDIT)
+						{
+							if ((i + 2) * 4 > have)
+								break;
+							credit += ntohl (in[i + 1]);
+							ngrants++;
+							i += 2;
+							continue;
+						}
+					if (type != CLIENT_REQUEST_EVENTS)
+						{
+							printf ("unknown request type %d, closing\n", type);
+							return;
+						};
+					nrequests++;
+					i++;
+
+					len = fill_reply (reply + sizeof (evtServerRetStruct), reply_size, start);
+					if (len > 0)
+						{
+							garble (reply + sizeof (evtServerRetStruct), len);
+							type = SERVER_SUMMARY;
+							nsummary++;
+						}
+					else
+						{
+							type = (run_done && sender_off) ? SERVER_SENDER_OFF : INSUFF_DATA;
+							ninsuff++;
+						};
+					if (send_reply (sock, type, len, len > 0 ? 1 : 0) < 0)
+						return;
+				}
+			memmove (in, in + i, have - 4 * i);
+			have -= 4 * i;
+
+			// streaming: whatever is due, as far as the credit goes
+			while (credit > 0 && !ended)
+				{
+					len = fill_reply (reply + sizeof (evtServerRetStruct), reply_size, start);
+					if (len == 0)
+						{
+							if (run_done && sender_off)
+								{
+									if (send_reply (sock, SERVER_SENDER_OFF, 0, 0) < 0)
+										return;
+									ninsuff++;
+									ended = 1;
+								}
+							break;
+						}
+					garble (reply + sizeof (evtServerRetStruct), len);
+					if (skip_seq_every > 0 && (seq + 1) % skip_seq_every == 0)
+						seq++;
+					if (send_reply (sock, SERVER_STREAM_SUMMARY, len, seq++) < 0)
+						return;
+					nsummary++;
+					credit--;
+				}
+
+			if (now_seconds () - lastprint >= SUMMARY_OUTPUT_INTERVAL)
+				{
+					print_info (start);
+					lastprint = now_seconds ();
+				}
+		}
+}
+
+/*----------------------------------------------------------------------*/
+
+void usage (void)
+{
+	printf ("\n");
+	printf ("use: mockIOC [options]\n");
+	printf ("\n");
+	printf ("Serves synthetic DGS data with the IOC request protocol (psNet.h) to\n");
+	printf ("one receiver at a time, e.g. for 'dgsReceiver 127.0.0.1:9001 run gtd 2000000000 14'.\n");
+	printf ("\n");
+	printf ("options:\n");
+	printf ("  -p <port>     listen on this port (default %i)\n", SERVER_PORT);
+	printf ("  -H <address>  listen on this address only (default all)\n");
+	printf ("  -b <id>       first board id (default 1)\n");
+	printf ("  -n <boards>   number of boards (default 1)\n");
+	printf ("  -c <ch>       channels per board, at most 10 (default 10)\n");
+	printf ("  -l <words>    digitizer packet length in words after the SOE, at least %i (default 64)\n", DIG_HEADER_LENGTH_UINT32);
+	printf ("  -s <bytes>    largest SERVER_SUMMARY payload (default 65536)\n");
+	printf ("  -r <rate>     digitizer packets per second, 0 = as fast as possible (default 0)\n");
+	printf ("  -t <n>        add a trigger packet every n events (default none)\n");
+	printf ("  -f <n>        add a type F packet every n events (default none)\n");
+	printf ("  -e <n>        end the run with type D packets after n events (default never)\n");
+	printf ("  -o            answer SERVER_SENDER_OFF after the run, not INSUFF_DATA\n");
+	printf ("  -x            exit when the first receiver disconnects\n");
+	printf ("  -q <n>        when streaming, skip a sequence number every n buffers (default never)\n");
+	printf ("  -g <n>        corrupt the SOE of one packet every n replies (default never)\n");
+	printf ("\n");
+	printf ("When less than one packet is due, requests get INSUFF_DATA.  A receiver that\n");
+	printf ("grants credit (dgsReceiver -S) is streamed data as it comes up instead.\n");
+	printf ("\n");
+}
+
+/*----------------------------------------------------------------------*/
+
+int main (int argc, char **argv)
+{
+	struct sockaddr_in addr;
+	int32_t lsock, sock, opt, one = 1;
+	int32_t port = SERVER_PORT;
+	int8_t once = 0;
+	double start = 0;
+
+	memset (&addr, 0, sizeof (addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl (INADDR_ANY);
+
+	while ((opt = getopt (argc, argv, "p:H:b:n:c:l:s:r:t:f:e:oxq:g:h")) != -1)
+		switch (opt)
+			{
+			case 'p': port = atoi (optarg); break;
+			case 'H': addr.sin_addr.s_addr = inet_addr (optarg); break;
+			case 'b': first_board = atoi (optarg); break;
+			case 'n': nboards = atoi (optarg); break;
+			case 'c': nchannels = atoi (optarg); break;
+			case 'l': packet_words = atoi (optarg); break;
+			case 's': reply_size = atoi (optarg); break;
+			case 'r': event_rate = atof (optarg); break;
+			case 't': trigger_every = atoi (optarg); break;
+			case 'f': typef_every = atoi (optarg); break;
+			case 'e': run_events = atoll (optarg); break;
+			case 'o': sender_off = 1; break;
+			case 'x': once = 1; break;
+			case 'q': skip_seq_every = atoi (optarg); break;
+			case 'g': garble_every = atoi (optarg); break;
+			default: usage (); exit (1);
+			}
+
+	if (nchannels < 1 || nchannels > 10 || nboards < 1 || first_board < 0 || first_board + nboards > 0xFFF
+		|| packet_words < DIG_HEADER_LENGTH_UINT32 || packet_words > 0x7FF
+		|| reply_size < 4 * (packet_words + 1) + 4 * TRIG_LENGTH_UINT32 + 4 * (DIG_HEADER_LENGTH_UINT32 + 1) * (nboards + 1)
+		|| reply_size > MAX_REPLY_SIZE || addr.sin_addr.s_addr == INADDR_NONE)
+		{
+			printf ("bad option value\n");
+			usage ();
+			exit (1);
+		};
+
+	reply = (uint8_t *) malloc (sizeof (evtServerRetStruct) + reply_size);
+
+	addr.sin_port = htons (port);
+	lsock = socket (AF_INET, SOCK_STREAM, 0);
+	setsockopt (lsock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof (one));
+	if (bind (lsock, (struct sockaddr *) &addr, sizeof (addr)) < 0 || listen (lsock, 1) < 0)
+		{
+			printf ("cannot listen on port %i: %s\n", port, strerror (errno));
+			exit (1);
+		};
+
+	printf ("mockIOC V%s on port %i: boards %i..%i, %i channels, %i words/packet, %i bytes/reply, ",
+		VERSION, port, first_board, first_board + nboards - 1, nchannels, packet_words, reply_size);
+	if (event_rate > 0)
+		printf ("%.0f events/s\n", event_rate);
+	else
+		printf ("unlimited rate\n");
+	fflush (stdout);
+
+	while (1)
+		{
+			sock = accept (lsock, NULL, NULL);
+			if (sock < 0)
+				continue;
+			setsockopt (sock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof (one));
+			printf ("receiver connected\n");
+			fflush (stdout);
+
+			// the rate clock starts with the first receiver
+			if (start == 0)
+				start = now_seconds ();
+			serve (sock, start);
+			close (sock);
+
+			printf ("receiver disconnected\n");
+			print_info (start);
+			if (once)
+				break;
+		}
+
+	close (lsock);
+	return 0;
+}
@@ -18,6 +18,19 @@ struct reqPacket {
    int type;
 };
 
+/* Credit-based streaming, an optional protocol version.  Instead of one
+ * reqPacket per buffer, the receiver grants the sender credit for a number
+ * of buffers at a time.  While it has data and credit left, the sender
+ * streams SERVER_STREAM_SUMMARY replies: an evtServerRetStruct whose recs
+ * holds a sequence number (0, 1, 2, ... on each connection), followed by
+ * recLen bytes of data.  It does not answer INSUFF_DATA, it waits for data.
+ * SERVER_SENDER_OFF still ends the stream.
+ */
+struct creditPacket {
+   int type;		/* CLIENT_GRANT_CREDIT */
+   int credit;		/* buffers granted, on top of any not used yet */
+};
+
 struct incoming {
    struct sockaddr_in client_addr;
    int addrlen;
@@ -65,4 +78,6 @@ int  sendRetStruct(struct incoming *req);
 #define SERVER_SENDER_OFF 3
 #define SERVER_SUMMARY 4
 #define INSUFF_DATA 5
+#define CLIENT_GRANT_CREDIT 6
+#define SERVER_STREAM_SUMMARY 7
 #define TARGSIZE (7*1024)
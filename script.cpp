@@ -1,4 +1,5 @@
 #include "reader.h"
+#include "dgsDecode.h"
 
 #include "TH1F.h"
 #include "TStyle.h"
@@ -6,29 +7,11 @@
 #include "TCanvas.h"
 #include "TString.h"
 
+// data: the 16 slot values of a trigger packet, in host order
 uint32_t * packData(uint32_t * data){
-  uint32_t * payload = new uint32_t[10];
+  uint32_t * payload = new uint32_t[DGS_TRIG_RECORD_WORDS];
 
-  payload[0] = 0xAAAAAAAA;
-      
-  payload[1]  = 0;
-  payload[1] |= 99 << 4;
-  payload[1] |= 10 << 16;  // always 8 words payload
-  
-  payload[2]  = data[4]   ;
-  payload[2] |= data[3]  << 16;  // timestamp 31:0
-  
-  payload[3]  = data[2]   ;  // timestamp 47:32
-  payload[3] |= 0xE  << 16; // header_type
-  //payload[3] |= 0x0  << 23; // event_type
-  payload[3] |= 3 << 26;
-  
-  payload[4] = (data[ 1] << 16) + data[ 5];  // trigType, wheel
-  payload[5] = (data[ 6] << 16) + data[ 7];  // multiplicity, userRegister
-  payload[6] = (data[ 8] << 16) + data[ 9];  // coarseTS, triggerBitMask
-  payload[7] = (data[10] << 16) + data[11];  // tdcOffset[0], tdcOffset[1]
-  payload[8] = (data[12] << 16) + data[13];  // tdcOffset[2], tdcOffset[3]
-  payload[9] = (data[14] << 16) + data[15];  // vernierAB, vernierCD
+  dgsTrigPack(data, dgsTrigWord1(99, 0), payload);
 
   return payload;
 }
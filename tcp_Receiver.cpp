@@ -8,6 +8,8 @@
 #include <time.h>
 #include <sys/stat.h>
 
+#include "dgsDecode.h"
+
 int debug = 0;
 
 int displayCount = 0;
@@ -16,6 +18,10 @@ int displayCount = 0;
 
 #define TRIG_DATA_SIZE 16 // words
 
+#define DEFAULT_REQUEST_WINDOW 4  // requests kept outstanding with the IOC
+#define MAX_REQUEST_WINDOW 64
+#define MAX_REPLY_BYTE 64*1024*1024 // refuse replies larger than this
+
 // #define ENABLE_GEB_HEADER
 
 enum ReplyType{
@@ -51,7 +57,12 @@ int netSocket = -1;
   typedef struct gebData GEBDATA;
 #endif
 
-uint32_t data[70000];
+// Receive buffer, reused for every reply and grown to the largest one seen.
+uint32_t * data = NULL;
+size_t dataCapacity = 0; // byte
+
+int requestWindow = DEFAULT_REQUEST_WINDOW;
+int outstanding = 0; // requests sent and not yet answered
 
 std::string serverIP = "192.168.203.211";
 int serverPort = 9001;
@@ -160,6 +171,7 @@ void SetUpConnection(){
     // Attempt to connect
     if (connect(netSocket, (struct sockaddr*)&server_addr, sizeof(server_addr)) == 0) {
       printf("Connected to server. %s\n", serverIP.c_str());
+      outstanding = 0; // a new peer has none of our requests
       break;
     } else {
       if( retryCount == 0 ) printf("Connection failed %s, retrying in %.2f seconds... (retry will not display)\n", serverIP.c_str(), waitSec);
@@ -174,26 +186,68 @@ void SetUpConnection(){
 
 }
 
+// The stream is out of step with the IOC (a reply not read, or a lost
+// connection): start again on a new connection, with no requests out.
+void Reconnect(){
+  close(netSocket);
+  netSocket = -1;
+  SetUpConnection();
+}
+
+bool ReserveData(size_t byte){
+  if( byte <= dataCapacity ) return true;
+  size_t newCapacity = dataCapacity ? dataCapacity : 256*1024;
+  while( newCapacity < byte ) newCapacity *= 2;
+  uint32_t * newData = (uint32_t *) realloc(data, newCapacity);
+  if( !newData ){
+    printf("\033[31m Failed to grow the receive buffer to %zu bytes. \033[0m\n", newCapacity);
+    return false;
+  }
+  data = newData;
+  dataCapacity = newCapacity;
+  if( debug > 0 ) printf("Receive buffer grown to %zu bytes\n", dataCapacity);
+  return true;
+}
+
+// recv() until exactly len bytes are in. false on error or closed connection.
+bool RecvAll(void * buf, size_t len){
+  size_t got = 0;
+  while( got < len ){
+    ssize_t n = recv(netSocket, (char *) buf + got, len - got, 0);
+    if( n <= 0 ) return false;
+    got += n;
+  }
+  return true;
+}
+
+// Keep requestWindow requests outstanding, so the IOC always has the next one
+// while we are still receiving or writing the previous reply.
+bool TopUpRequests(){
+  int request[MAX_REQUEST_WINDOW];
+  int n = requestWindow - outstanding;
+  if( n <= 0 ) return true;
+  for( int i = 0; i < n; i++) request[i] = htonl(1);
+  if( send(netSocket, request, n * sizeof(int), MSG_NOSIGNAL) != (ssize_t)(n * sizeof(int)) ) return false;
+  outstanding += n;
+  if( debug > 3 ) printf("%d request(s) sent. ", n);
+  return true;
+}
+
 int GetData(){ //return bytes_received.
   int replyType = 0;
   int reply[4]; // 0 = Type, 1 = Record Size in Byte, 2 = Status, 3 = num. of record
 
-  int request = htonl(1);
-  if( send(netSocket, &request, sizeof(request), 0) < 0 ){
+  if( !TopUpRequests() ){
     printf("fail to send request. \n");
-    // printf("fail to send request. retry after 2 sec.\n");
-    // sleep(2);
-    // continue;
+    Reconnect();
     return Fail_to_connect;
-  }else{
-    if( debug > 3 ) printf("Request sent. ");
   }
   
-  int bytes_received  = recv(netSocket, ((char *) &reply), sizeof(reply), 0);
-  if (bytes_received > 0) {
+  if( RecvAll(reply, sizeof(reply)) ) {
+    outstanding --;
     if( debug > 1){
       printf("\n");
-      printf("Byte received : %d \n", bytes_received);
+      printf("Byte received : %zu \n", sizeof(reply));
       printf("received data = \n");
       printf("          Type : %d\n", ntohl(reply[0]) );
       printf("   Record size : %d Byte\n", ntohl(reply[1]) );
@@ -215,21 +269,30 @@ int GetData(){ //return bytes_received.
 
     int recordByte = ntohl(reply[1]);
     int numRecord = ntohl(reply[3]);
+    long long replyByte = (long long) recordByte * numRecord;
 
-    int total_bytes_received = 0;
+    if( replyByte < 0 || replyByte > MAX_REPLY_BYTE ){
+      printf("\033[31m ERROR. Reply of %lld bytes, refusing it. \033[0m\n", replyByte);
+      Reconnect();
+      return No_respone;
+    }
+    if( !ReserveData(replyByte) ){
+      Reconnect();
+      return No_respone;
+    }
 
-    do{
-      int bytes_received = recv(netSocket, &data[total_bytes_received/4], recordByte * numRecord, 0);
-      int word_received = bytes_received/4;
-      total_bytes_received += bytes_received;
-      if( debug > 0 ) printf("Received %d bytes = %d words | total received %d Bytes, Record size %d bytes\n", bytes_received, word_received, total_bytes_received, recordByte*numRecord);
-    }while(total_bytes_received < recordByte * numRecord);
-    printf("total received %d Bytes = %d words, Record size %d bytes\n", total_bytes_received, total_bytes_received/4, recordByte*numRecord);
+    if( !RecvAll(data, replyByte) ){
+      printf("No response or connection closed.\n");
+      Reconnect();
+      return No_respone;
+    }
+    if( debug > 0 ) printf("total received %lld Bytes = %lld words, Record size %d x %d bytes\n", replyByte, replyByte/4, numRecord, recordByte);
     
-    return total_bytes_received;
+    return replyByte;
 
   } else {
     printf("No response or connection closed.\n");
+    Reconnect();
     return No_respone;
   }
   
@@ -301,11 +364,10 @@ DataStatus WriteData(int bytes_received){
         int timestamp_lower 		    = (header[1] & 0xFFFFFFFF) >> 0;	// Word 2: 31..0
         int timestamp_upper 		    = (header[2] & 0x0000FFFF) >> 0;	// Word 3: 15..0
         // int header_type				      = (header[2] & 0x000F0000) >> 16;	// Word 3: 19..16
-        int packet_length_in_bytes	= packet_length_in_words * 4;
 
         gebData GEB_data;
         GEB_data.type = 0;
-        GEB_data.length = packet_length_in_bytes;
+        GEB_data.length = packet_length_in_words * 4;
         GEB_data.timestamp  = ((uint64_t)(timestamp_upper)) << 32;
         GEB_data.timestamp |=  (uint64_t)(timestamp_lower);
       #endif
@@ -328,69 +390,56 @@ DataStatus WriteData(int bytes_received){
     
     }else if(data[index] == 0xAAAA0000){ //==== TRIG data
 
-      int header[TRIG_DATA_SIZE];
-      for( int i = 0; i < TRIG_DATA_SIZE; i++) {
-        header[i] = ntohl(data[index+i]);
-        if( displayCount < 4 ) printf("%2d | 0x%08X\n", index+i, header[i]);
+      // the run of trigger packets from here, reformatted in one go (dgsDecode.h)
+      int nTrig = 0;
+      while( nTrig < DGS_TRIG_BATCH && index + (nTrig + 1) * TRIG_DATA_SIZE <= words_received
+             && data[index + nTrig * TRIG_DATA_SIZE] == 0xAAAA0000 ) nTrig++;
+
+      if (nTrig == 0){
+        printf("\033[31m ERROR. TRIG DATA. Word received < packet length. \033[0m\n");
+        PrintData(index, words_received-1);
+        return TRIG_inComplete;
+      }
+
+      for( int j = 0; j < nTrig && displayCount + j < 4; j++){
+        for( int i = 0; i < TRIG_DATA_SIZE; i++) {
+          printf("%2d | 0x%08X\n", index + j * TRIG_DATA_SIZE + i, ntohl(data[index + j * TRIG_DATA_SIZE + i]));
+        }
       }
 
       int ch_id					    = 0x0;
       int board_id	        =  99;
-      int header_type       = 0xE;
-      
-      int packet_length_in_words  = 10;
-      
-      int payload[10];
+      const int recordByte  = DGS_TRIG_RECORD_LENGTH * 4; // SOE and words 1..9
 
-      payload[0] = 0xAAAAAAAA;
-      
-      payload[1]  = ch_id;
-      payload[1] |= board_id << 4;
-      payload[1] |= packet_length_in_words << 16;  // always 8 words payload
-      
-      payload[2]  = header[4]   ;
-      payload[2] |= header[3]  << 16;  // timestamp 31:0
-      
-      payload[3]  = header[2]   ;  // timestamp 47:32
-      payload[3] |= header_type  << 16; // header_type
-      //payload[3] |= 0x0  << 23; // event_type
-      payload[3] |= 3 << 26;
-      
-      payload[4] = (header[ 1] << 16) + header[ 5];  // trigType, wheel
-      payload[5] = (header[ 6] << 16) + header[ 7];  // multiplicity, userRegister
-      payload[6] = (header[ 8] << 16) + header[ 9];  // coarseTS, triggerBitMask
-      payload[7] = (header[10] << 16) + header[11];  // tdcOffset[0], tdcOffset[1]
-      payload[8] = (header[12] << 16) + header[13];  // tdcOffset[2], tdcOffset[3]
-      payload[9] = (header[14] << 16) + header[15];  // vernierAB, vernierCD
-
-      // if( displayCount < 10 ) { 
-      //   for( int i = 0; i < 10; i++) printf("%d | 0x%08X\n", i, payload[i]);
-      // }
-
-      displayCount ++;
+      uint32_t records[DGS_TRIG_BATCH * DGS_TRIG_RECORD_WORDS];
+      uint64_t timestamps[DGS_TRIG_BATCH];
+      dgsTrigRecords((const int8_t *) &data[index], nTrig, dgsTrigWord1(board_id, ch_id), records, timestamps);
 
+      // one write for the whole run
       #ifdef ENABLE_GEB_HEADER
-        gebData GEB_data;
-        GEB_data.type = 0;
-        GEB_data.length = packet_length_in_bytes;
-        GEB_data.timestamp  = ((uint64_t)(header[2])) << 32;
-        GEB_data.timestamp |= ((uint64_t)(header[3])) << 16;
-        GEB_data.timestamp |=  (uint64_t)(header[4]);
+        char out[DGS_TRIG_BATCH * (sizeof(gebData) + recordByte)];
+      #else
+        char out[DGS_TRIG_BATCH * recordByte];
       #endif
-
-      if (TRIG_DATA_SIZE + index  > words_received){
-        printf("\033[31m ERROR. TRIG DATA. Word received < packet length. \033[0m\n");
-        PrintData(index, words_received-1);
-        return TRIG_inComplete;
+      size_t outByte = 0;
+      for( int j = 0; j < nTrig; j++){
+        #ifdef ENABLE_GEB_HEADER
+          gebData GEB_data;
+          GEB_data.type = 0;
+          GEB_data.length = recordByte;
+          GEB_data.timestamp = timestamps[j];
+          memcpy(out + outByte, &GEB_data, sizeof(gebData));
+          outByte += sizeof(gebData);
+        #endif
+        memcpy(out + outByte, &records[j * DGS_TRIG_RECORD_WORDS], recordByte);
+        outByte += recordByte;
       }
 
-      index += TRIG_DATA_SIZE;
+      displayCount += nTrig;
+      index += nTrig * TRIG_DATA_SIZE;
 
       outFile[board_id][ch_id].OpenFile("_trig", board_id, ch_id);
-      #ifdef ENABLE_GEB_HEADER
-        outFile[board_id][ch_id].Write(&GEB_data, sizeof(gebData));
-      #endif
-      outFile[board_id][ch_id].Write(payload, sizeof(payload));
+      outFile[board_id][ch_id].Write(out, outByte);
       totalFileSize += outFile[board_id][ch_id].GetWrittenByte();
 
     }else{
@@ -416,20 +465,27 @@ DataStatus WriteData(int bytes_received){
 //###############################################################
 int main(int argc, char **argv) {
 
-  if( argc != 4){
+  if( argc != 4 && argc != 5){
     printf("usage:\n");
-    printf("%s [IP] [Port] [file_prefix]", argv[0]);
+    printf("%s [IP] [Port] [file_prefix] [request_window, default %d]\n", argv[0], DEFAULT_REQUEST_WINDOW);
     return -1;
   }
 
   serverIP = argv[1];
   serverPort = atoi(argv[2]);
   runName = argv[3];
+  if( argc == 5 ) requestWindow = atoi(argv[4]);
+  if( requestWindow < 1 || requestWindow > MAX_REQUEST_WINDOW ){
+    printf("request_window must be 1 to %d\n", MAX_REQUEST_WINDOW);
+    return -1;
+  }
 
   #ifdef ENABLE_GEB_HEADER
-  printf("GEB HEADER enabled.\n\n").
+  printf("GEB HEADER enabled.\n\n");
   #endif
 
+  printf("Trigger reformat: %s\n", dgsDecodeInit());
+
   SetUpConnection();
 
   time_t startTime = time(NULL);
@@ -442,7 +498,7 @@ int main(int argc, char **argv) {
     int bytes_received = GetData();
 
     //============ Write data to file
-    if( bytes_received >= 0 ) status = WriteData(bytes_received); // it decodes the data, and save the data for each channel.
+    if( bytes_received > 0 ) status = WriteData(bytes_received); // it decodes the data, and save the data for each channel.
     
     //============ Status
     time_t now = time(NULL);
@@ -0,0 +1,185 @@
+//--------------------------------------------------------------------------------
+// Company:		Argonne National Laboratory
+// Division:	Physics
+// Project:		DGS Receiver
+// File:		uring.h
+// Description: Minimal io_uring access through the raw system calls, for hosts
+//              that do not have liburing installed.  Only what the receiver
+//              needs: one submission/completion ring, fixed buffers and a
+//              submit-and-wait with timeout.
+//--------------------------------------------------------------------------------
+
+#ifndef _DGS_URING_H
+#define _DGS_URING_H
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+struct uring
+{
+	int32_t fd;
+	uint32_t *sq_head, *sq_tail, *sq_mask, *sq_array;
+	uint32_t *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	uint32_t sq_entries;
+	uint32_t sqe_tail;								 /* SQEs handed out, published at submit */
+	uint32_t submitted;								 /* SQEs already published */
+	void *sq_ptr, *cq_ptr;
+	size_t sq_len, cq_len, sqes_len;
+};
+
+/* Returns 0, or -1 with errno set if the kernel has no io_uring. */
+static inline int32_t uringInit (struct uring *r, uint32_t entries)
+{
+	struct io_uring_params p;
+	uint32_t i;
+
+	memset (r, 0, sizeof (*r));
+	memset (&p, 0, sizeof (p));
+	r->fd = syscall (__NR_io_uring_setup, entries, &p);
+	if (r->fd < 0)
+		return -1;
+
+	r->sq_len = p.sq_off.array + p.sq_entries * sizeof (uint32_t);
+	r->cq_len = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+	r->sqes_len = p.sq_entries * sizeof (struct io_uring_sqe);
+
+	r->sq_ptr = mmap (0, r->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	r->cq_ptr = mmap (0, r->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+	r->sqes = (struct io_uring_sqe *) mmap (0, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	if (r->sq_ptr == MAP_FAILED || r->cq_ptr == MAP_FAILED || r->sqes == MAP_FAILED)
+		{
+			// undo the mappings that did succeed, keeping the mmap errno
+			int32_t err = errno;
+
+			if (r->sq_ptr != MAP_FAILED)
+				munmap (r->sq_ptr, r->sq_len);
+			if (r->cq_ptr != MAP_FAILED)
+				munmap (r->cq_ptr, r->cq_len);
+			if (r->sqes != MAP_FAILED)
+				munmap (r->sqes, r->sqes_len);
+			close (r->fd);
+			r->fd = -1;
+			errno = err;
+			return -1;
+		}
+
+	r->sq_head = (uint32_t *) ((char *) r->sq_ptr + p.sq_off.head);
+	r->sq_tail = (uint32_t *) ((char *) r->sq_ptr + p.sq_off.tail);
+	r->sq_mask = (uint32_t *) ((char *) r->sq_ptr + p.sq_off.ring_mask);
+	r->sq_array = (uint32_t *) ((char *) r->sq_ptr + p.sq_off.array);
+	r->cq_head = (uint32_t *) ((char *) r->cq_ptr + p.cq_off.head);
+	r->cq_tail = (uint32_t *) ((char *) r->cq_ptr + p.cq_off.tail);
+	r->cq_mask = (uint32_t *) ((char *) r->cq_ptr + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *) ((char *) r->cq_ptr + p.cq_off.cqes);
+	r->sq_entries = p.sq_entries;
+
+	// SQEs are always used in ring order, so the index array is the identity.
+	for (i = 0; i < p.sq_entries; i++)
+		r->sq_array[i] = i;
+	r->sqe_tail = r->submitted = *r->sq_tail;
+	return 0;
+}
+
+/* Next free SQE, cleared, or NULL if the submission queue is full. */
+static inline struct io_uring_sqe *uringGetSqe (struct uring *r)
+{
+	struct io_uring_sqe *sqe;
+
+	if (r->sqe_tail - __atomic_load_n (r->sq_head, __ATOMIC_ACQUIRE) >= r->sq_entries)
+		return NULL;
+	sqe = &r->sqes[r->sqe_tail & *r->sq_mask];
+	r->sqe_tail++;
+	memset (sqe, 0, sizeof (*sqe));
+	return sqe;
+}
+
+/* SQEs free to be handed out. */
+static inline uint32_t uringSqSpace (struct uring *r)
+{
+	return r->sq_entries - (r->sqe_tail - __atomic_load_n (r->sq_head, __ATOMIC_ACQUIRE));
+}
+
+/* Publish the SQEs handed out so far and wait for at least wait_nr
+ * completions, or at most timeout_ns if that is not 0.
+ * Returns the number submitted, or -1 with errno (ETIME on timeout).
+ */
+static inline int32_t uringSubmit (struct uring *r, uint32_t wait_nr, int64_t timeout_ns)
+{
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	uint32_t to_submit, flags = 0;
+	int32_t ret;
+
+	to_submit = r->sqe_tail - r->submitted;
+	__atomic_store_n (r->sq_tail, r->sqe_tail, __ATOMIC_RELEASE);
+	r->submitted = r->sqe_tail;
+
+	if (wait_nr > 0)
+		flags |= IORING_ENTER_GETEVENTS;
+	if (wait_nr > 0 && timeout_ns > 0)
+		{
+			memset (&arg, 0, sizeof (arg));
+			ts.tv_sec = timeout_ns / 1000000000;
+			ts.tv_nsec = timeout_ns % 1000000000;
+			arg.ts = (uint64_t) (uintptr_t) &ts;
+			ret = syscall (__NR_io_uring_enter, r->fd, to_submit, wait_nr, flags | IORING_ENTER_EXT_ARG, &arg, sizeof (arg));
+		}
+	else
+		ret = syscall (__NR_io_uring_enter, r->fd, to_submit, wait_nr, flags, NULL, 0);
+	return ret;
+}
+
+/* The oldest unseen completion, or NULL. */
+static inline struct io_uring_cqe *uringPeekCqe (struct uring *r)
+{
+	uint32_t head = *r->cq_head;
+
+	if (head == __atomic_load_n (r->cq_tail, __ATOMIC_ACQUIRE))
+		return NULL;
+	return &r->cqes[head & *r->cq_mask];
+}
+
+static inline void uringCqeSeen (struct uring *r)
+{
+	__atomic_store_n (r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+/* Register a fixed set of buffers for READ_FIXED/WRITE_FIXED. */
+static inline int32_t uringRegisterBuffers (struct uring *r, struct iovec *iov, uint32_t n)
+{
+	return syscall (__NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS, iov, n);
+}
+
+/* Register n empty fixed buffer slots, to be filled by uringUpdateBuffer. */
+static inline int32_t uringRegisterSparse (struct uring *r, uint32_t n)
+{
+	struct io_uring_rsrc_register reg;
+
+	memset (&reg, 0, sizeof (reg));
+	reg.nr = n;
+	reg.flags = IORING_RSRC_REGISTER_SPARSE;
+	return syscall (__NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS2, &reg, sizeof (reg));
+}
+
+/* Point fixed buffer slot idx at a new memory area. */
+static inline int32_t uringUpdateBuffer (struct uring *r, uint32_t idx, struct iovec *iov)
+{
+	struct io_uring_rsrc_update2 up;
+
+	memset (&up, 0, sizeof (up));
+	up.offset = idx;
+	up.data = (uint64_t) (uintptr_t) iov;
+	up.nr = 1;
+	return syscall (__NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS_UPDATE, &up, sizeof (up));
+}
+
+#endif // _DGS_URING_H